@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <errno.h>
+#include "common.h"
+#include "buffer.h"
+
+int read_buffer_init(ReadBuffer* rb, int fd, size_t capacity) {
+    rb->fd = fd;
+    rb->start = 0;
+    rb->end = 0;
+    rb->cap = capacity;
+    rb->data = malloc(capacity);
+    return rb->data == NULL ? ERROR : SUCCESS;
+}
+
+void read_buffer_free(ReadBuffer* rb) {
+    free(rb->data);
+    rb->data = NULL;
+    rb->cap = rb->start = rb->end = 0;
+}
+
+size_t read_buffer_length(const ReadBuffer* rb) {
+    return rb->end - rb->start;
+}
+
+char* read_buffer_peek(ReadBuffer* rb) {
+    return rb->data + rb->start;
+}
+
+// Makes room for at least one more read, moving unread bytes to the front
+// before growing the allocation
+static int read_buffer_reserve(ReadBuffer* rb, size_t wanted) {
+    if (rb->start == rb->end) rb->start = rb->end = 0;
+    if (rb->cap - rb->end >= wanted) return SUCCESS;
+
+    if (rb->start > 0) {
+        memmove(rb->data, rb->data + rb->start, rb->end - rb->start);
+        rb->end -= rb->start;
+        rb->start = 0;
+        if (rb->cap - rb->end >= wanted) return SUCCESS;
+    }
+
+    size_t new_cap = rb->cap ? rb->cap : READ_BUFFER_SIZE;
+    while (new_cap - rb->end < wanted) new_cap *= 2;
+    char* grown = realloc(rb->data, new_cap);
+    if (grown == NULL) return ERROR;
+    rb->data = grown;
+    rb->cap = new_cap;
+    return SUCCESS;
+}
+
+char* read_buffer_space(ReadBuffer* rb, size_t* len) {
+    if (read_buffer_reserve(rb, 1) == ERROR) return NULL;
+    *len = rb->cap - rb->end;
+    return rb->data + rb->end;
+}
+
+void read_buffer_commit(ReadBuffer* rb, size_t len) {
+    rb->end += len;
+}
+
+ssize_t read_buffer_fill(ReadBuffer* rb) {
+    size_t space;
+    char* free_space = read_buffer_space(rb, &space);
+    if (free_space == NULL) return -1;
+
+    ssize_t n;
+    do {
+        n = read(rb->fd, free_space, space);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) read_buffer_commit(rb, n);
+    return n;
+}
+
+int read_buffer_slice(ReadBuffer* rb, const char** field, size_t* len, size_t max_len) {
+    // Skip leading space if present
+    if (rb->start == rb->end && read_buffer_fill(rb) <= 0) return ERROR;
+    if (rb->data[rb->start] == ' ') rb->start++;
+
+    // Scan until space or newline, refilling keeps the field contiguous
+    size_t i = 0;
+    while (i < max_len) {
+        if (rb->start + i == rb->end && read_buffer_fill(rb) <= 0) return ERROR;
+        char c = rb->data[rb->start + i];
+        if (c == ' ' || c == '\n') {
+            *field = rb->data + rb->start;
+            *len = i;
+            rb->start += i + 1;
+            return c == ' ' ? SUCCESS : EOM;
+        }
+        i++;
+    }
+    *field = rb->data + rb->start;
+    *len = i;
+    rb->start += i;
+    return SUCCESS;
+}
+
+void read_buffer_drop(ReadBuffer* rb, size_t offset, size_t len) {
+    char* from = rb->data + rb->start + offset;
+    memmove(from, from + len, rb->end - rb->start - offset - len);
+    rb->end -= len;
+}
+
+const char* read_buffer_take(ReadBuffer* rb, size_t len) {
+    if (read_buffer_length(rb) < len && read_buffer_reserve(rb, len - read_buffer_length(rb)) == ERROR)
+        return NULL;
+    while (read_buffer_length(rb) < len) {
+        if (read_buffer_fill(rb) <= 0) return NULL;
+    }
+    const char* data = rb->data + rb->start;
+    rb->start += len;
+    return data;
+}
@@ -0,0 +1,120 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define READ_BUFFER_SIZE 8192
+
+/**
+ * @brief Connection-scoped input buffer.
+ *
+ * Refilled with large reads from the socket; fields are handed out as
+ * slices of the buffered bytes instead of reading the socket byte by byte.
+ * Unread bytes live in data[start, end).
+ */
+typedef struct {
+    int fd;
+    char* data;
+    size_t cap;
+    size_t start;
+    size_t end;
+} ReadBuffer;
+
+/**
+ * @brief Initializes an empty buffer reading from a socket.
+ *
+ * @param rb Buffer to initialize
+ * @param fd Source file descriptor
+ * @param capacity Initial capacity in bytes
+ * @return int SUCCESS on success, ERROR on allocation failure
+ */
+int read_buffer_init(ReadBuffer* rb, int fd, size_t capacity);
+
+/**
+ * @brief Releases the buffer memory.
+ *
+ * @param rb Buffer to free
+ */
+void read_buffer_free(ReadBuffer* rb);
+
+/**
+ * @brief Number of buffered bytes not yet consumed.
+ *
+ * @param rb Buffer
+ * @return size_t Unread byte count
+ */
+size_t read_buffer_length(const ReadBuffer* rb);
+
+/**
+ * @brief Pointer to the first unread byte.
+ *
+ * @param rb Buffer
+ * @return char* Start of the unread bytes
+ */
+char* read_buffer_peek(ReadBuffer* rb);
+
+/**
+ * @brief Free space after the buffered bytes, for a read done by the caller.
+ *
+ * Consumed bytes are compacted away first; the buffer grows when it is full.
+ * The space stays valid until the next call that changes the buffer.
+ *
+ * @param rb Buffer
+ * @param len Set to the size of the free space
+ * @return char* Start of the free space, NULL on allocation failure
+ */
+char* read_buffer_space(ReadBuffer* rb, size_t* len);
+
+/**
+ * @brief Appends bytes the caller read into read_buffer_space().
+ *
+ * @param rb Buffer
+ * @param len Number of bytes read
+ */
+void read_buffer_commit(ReadBuffer* rb, size_t len);
+
+/**
+ * @brief Performs one read() into the free space of the buffer.
+ *
+ * Consumed bytes are compacted away first; the buffer grows when it is full.
+ *
+ * @param rb Buffer
+ * @return ssize_t Bytes read, 0 on peer close, -1 on error (errno is kept)
+ */
+ssize_t read_buffer_fill(ReadBuffer* rb);
+
+/**
+ * @brief Returns the next space-delimited field as a slice of the buffer.
+ *
+ * Skips one leading space and stops at the next space or newline, or after
+ * max_len bytes. Refills from the socket when the buffered bytes run out.
+ * The slice stays valid until the next call on the buffer.
+ *
+ * @param rb Buffer
+ * @param field Set to the first byte of the field
+ * @param len Set to the field length
+ * @param max_len Maximum length of the field
+ * @return int SUCCESS if terminated by space, EOM if terminated by newline, ERROR on failure
+ */
+int read_buffer_slice(ReadBuffer* rb, const char** field, size_t* len, size_t max_len);
+
+/**
+ * @brief Removes unread bytes from the middle of the buffer.
+ *
+ * @param rb Buffer
+ * @param offset Position of the first byte to remove, relative to the unread bytes
+ * @param len Number of bytes to remove
+ */
+void read_buffer_drop(ReadBuffer* rb, size_t offset, size_t len);
+
+/**
+ * @brief Consumes exactly len bytes, refilling as needed.
+ *
+ * @param rb Buffer
+ * @param len Number of bytes
+ * @return const char* Slice with the bytes, NULL if the peer closed or on error
+ */
+const char* read_buffer_take(ReadBuffer* rb, size_t len);
+
+#endif
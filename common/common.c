@@ -1,3 +1,7 @@
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <stdint.h>
 #include "common.h"
 
 int tcp_send_message(int fd, char* message) {
@@ -15,6 +19,25 @@ int tcp_send_message(int fd, char* message) {
     return SUCCESS;
 }
 
+// Hands the whole file to the kernel, returns FALSE if sendfile() is not
+// supported for this file so the caller can copy it instead
+static int tcp_sendfile(int fd, int file_fd) {
+    struct stat st;
+    if (fstat(file_fd, &st) != 0) return ERROR;
+
+    off_t offset = 0;
+    while (offset < st.st_size) {
+        ssize_t n = sendfile(fd, file_fd, &offset, st.st_size - offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (offset == 0 && (errno == EINVAL || errno == ENOSYS)) return FALSE;
+            return ERROR;
+        }
+        if (n == 0) return ERROR;
+    }
+    return SUCCESS;
+}
+
 int tcp_send_file(int fd, char* file_name) {
     // Open file for byte reading
     FILE* file = fopen(file_name, "rb");
@@ -22,11 +45,19 @@ int tcp_send_file(int fd, char* file_name) {
         perror("ERROR: Failed to open file");
         return ERROR;
     }
+
+    int status = tcp_sendfile(fd, fileno(file));
+    if (status == ERROR) {
+        perror("ERROR: Failed to send file data");
+        fclose(file);
+        return ERROR;
+    }
+
     // Read and send file in chunks of 1024 bytes
     char buffer[TCP_BUFFER_SIZE];
     size_t bytes_read;
     ssize_t bytes_sent;
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    while (status == FALSE && (bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
         size_t total_sent = 0;
         while (total_sent < bytes_read) {
             bytes_sent = write(fd, buffer + total_sent, bytes_read - total_sent);
@@ -60,6 +91,18 @@ int tcp_read(int fd, void* buf, size_t len) {
     return SUCCESS;
 }
 
+int tcp_read_line(ReadBuffer* rb, char* line, size_t size) {
+    size_t copied = 0;
+    while (copied < size - 1) {
+        if (read_buffer_length(rb) == 0 && read_buffer_fill(rb) <= 0) break;
+        char c = *read_buffer_take(rb, 1);
+        line[copied++] = c;
+        if (c == '\n') break; // End of message
+    }
+    line[copied] = '\0';
+    return copied > 0 ? SUCCESS : ERROR;
+}
+
 // Reliable helper that keeps writing until everything is sent
 int tcp_write(int fd, const char* buffer, size_t length) {
     size_t total = 0;
@@ -71,48 +114,38 @@ int tcp_write(int fd, const char* buffer, size_t length) {
     return SUCCESS;
 }
 
-// Helper function to read a single space-delimited field from TCP socket
-int tcp_read_field(int fd, char* buffer, size_t max_len) {
-    size_t i = 0;
-    char c;
-    ssize_t n;
-
-    // Skip leading space if present
-    n = read(fd, &c, 1);
-    if (n <= 0) return ERROR;
-    if (c != ' ') {
-        buffer[i++] = c;
-    }
-
-    // Read until space or newline
-    while (i < max_len) {
-        n = read(fd, &c, 1);
-        if (n <= 0) return ERROR;
-        if (c == ' ') {
-            buffer[i] = '\0';
-            return SUCCESS;
-        } else if (c == '\n') {
-            buffer[i] = '\0';
-            return EOM;
-        }
-        buffer[i++] = c;
-    }
-    buffer[i] = '\0';
-    return SUCCESS;
+// Copies the next space-delimited field out of the connection buffer
+int tcp_read_field(ReadBuffer* rb, char* buffer, size_t max_len) {
+    const char* field;
+    size_t len;
+    int status = read_buffer_slice(rb, &field, &len, max_len);
+    if (status == ERROR) return ERROR;
+    memcpy(buffer, field, len);
+    buffer[len] = '\0';
+    return status;
 }
 
-int tcp_read_file(int fd, char* file_name, long file_size) {
+int tcp_read_file(ReadBuffer* rb, char* file_name, long file_size) {
     FILE* file = fopen(file_name, "wb");
     if (!file) return ERROR;
 
-    char buffer[TCP_BUFFER_SIZE];
     long total_received = 0;
+
+    // Whatever the field parser already buffered belongs to the file first
+    size_t buffered = read_buffer_length(rb);
+    if (buffered > 0) {
+        size_t take = buffered < (size_t)file_size ? buffered : (size_t)file_size;
+        fwrite(read_buffer_take(rb, take), 1, take, file);
+        total_received += take;
+    }
+
+    char buffer[READ_BUFFER_SIZE];
     ssize_t n;
 
     while (total_received < file_size) {
-        size_t to_read = (file_size - total_received) < TCP_BUFFER_SIZE ?
-                         (file_size - total_received) : TCP_BUFFER_SIZE;
-        n = read(fd, buffer, to_read);
+        size_t to_read = (file_size - total_received) < READ_BUFFER_SIZE ?
+                         (file_size - total_received) : READ_BUFFER_SIZE;
+        n = read(rb->fd, buffer, to_read);
         if (n == 0) break;
         if (n < 0) {
             fclose(file);
@@ -131,6 +164,20 @@ int tcp_read_file(int fd, char* file_name, long file_size) {
 
 // ---------------- RequestType ----------------
 
+// Packs a protocol code of up to 3 characters into one integer, so a code is
+// matched by a single switch instead of a chain of string compares
+#define CODE3(a, b, c) (((uint32_t)(unsigned char)(a) << 16) | \
+                        ((uint32_t)(unsigned char)(b) << 8) | (uint32_t)(unsigned char)(c))
+
+// With exact set, a string longer than 3 characters packs to 0, which no code uses
+static uint32_t pack_code(const char* code, int exact) {
+    if (code[0] == '\0') return 0;
+    if (code[1] == '\0') return CODE3(code[0], 0, 0);
+    if (code[2] == '\0') return CODE3(code[0], code[1], 0);
+    if (exact && code[3] != '\0') return 0;
+    return CODE3(code[0], code[1], code[2]);
+}
+
 // RequestType -> Human-readable command name
 const char* command_to_str(RequestType command) {
     switch (command) {
@@ -146,6 +193,9 @@ const char* command_to_str(RequestType command) {
         case SHOW: return "Show";
         case RESERVE: return "Reserve";
         case MYRESERVATIONS: return "My reservations";
+        case KEEPALIVE: return "Keep-alive";
+        case LIST_DELTA: return "List changes";
+        case SESSION: return "Session";
         default: return "Unknown";
     }
 }
@@ -164,43 +214,57 @@ const char* get_command_request(RequestType command) {
         case SHOW: return "SED";
         case RESERVE: return "RID";
         case MYRESERVATIONS: return "LMR";
+        case KEEPALIVE: return "KAL";
+        case LIST_DELTA: return "LSD";
+        case SESSION: return "SES";
         default: return "UNK";
     }
 }
 
 RequestType identify_command_request(char* command_buff) {
-    if (strncmp(command_buff, "LIN", 3) == 0) return LOGIN;
-    if (strncmp(command_buff, "CPS", 3) == 0) return CHANGEPASS;
-    if (strncmp(command_buff, "UNR", 3) == 0) return UNREGISTER;
-    if (strncmp(command_buff, "LOU", 3) == 0) return LOGOUT;
-    if (strncmp(command_buff, "CRE", 3) == 0) return CREATE;
-    if (strncmp(command_buff, "CLS", 3) == 0) return CLOSE;
-    if (strncmp(command_buff, "LME", 3) == 0) return MYEVENTS;
-    if (strncmp(command_buff, "LST", 3) == 0) return LIST;
-    if (strncmp(command_buff, "SED", 3) == 0) return SHOW;
-    if (strncmp(command_buff, "RID", 3) == 0) return RESERVE;
-    if (strncmp(command_buff, "LMR", 3) == 0) return MYRESERVATIONS;
-    else return UNKNOWN;
+    // Only the first 3 bytes count, like the protocol's fixed-width command field
+    switch (pack_code(command_buff, FALSE)) {
+        case CODE3('L', 'I', 'N'): return LOGIN;
+        case CODE3('C', 'P', 'S'): return CHANGEPASS;
+        case CODE3('U', 'N', 'R'): return UNREGISTER;
+        case CODE3('L', 'O', 'U'): return LOGOUT;
+        case CODE3('C', 'R', 'E'): return CREATE;
+        case CODE3('C', 'L', 'S'): return CLOSE;
+        case CODE3('L', 'M', 'E'): return MYEVENTS;
+        case CODE3('L', 'S', 'T'): return LIST;
+        case CODE3('S', 'E', 'D'): return SHOW;
+        case CODE3('R', 'I', 'D'): return RESERVE;
+        case CODE3('L', 'M', 'R'): return MYRESERVATIONS;
+        case CODE3('K', 'A', 'L'): return KEEPALIVE;
+        case CODE3('L', 'S', 'D'): return LIST_DELTA;
+        case CODE3('S', 'E', 'S'): return SESSION;
+        default: return UNKNOWN;
+    }
 }
 
 
 // SERVER -> USER
 // "RXX" -> RequestType
 RequestType identify_command_response(char* command) {
-    if (strcmp(command, "RLI") == 0) return LOGIN;
-    if (strcmp(command, "RCP") == 0) return CHANGEPASS;
-    if (strcmp(command, "RUR") == 0) return UNREGISTER;
-    if (strcmp(command, "RLO") == 0) return LOGOUT;
-    if (strcmp(command, "REX") == 0) return EXIT;
-    if (strcmp(command, "RCE") == 0) return CREATE;
-    if (strcmp(command, "RCL") == 0) return CLOSE;
-    if (strcmp(command, "RME") == 0) return MYEVENTS;
-    if (strcmp(command, "RLS") == 0) return LIST;
-    if (strcmp(command, "RSE") == 0) return SHOW;
-    if (strcmp(command, "RRI") == 0) return RESERVE;
-    if (strcmp(command, "RMR") == 0) return MYRESERVATIONS;
-    if(strcmp(command, "ERR") == 0) return ERROR_REQUEST;
-    return UNKNOWN;
+    switch (pack_code(command, TRUE)) {
+        case CODE3('R', 'L', 'I'): return LOGIN;
+        case CODE3('R', 'C', 'P'): return CHANGEPASS;
+        case CODE3('R', 'U', 'R'): return UNREGISTER;
+        case CODE3('R', 'L', 'O'): return LOGOUT;
+        case CODE3('R', 'E', 'X'): return EXIT;
+        case CODE3('R', 'C', 'E'): return CREATE;
+        case CODE3('R', 'C', 'L'): return CLOSE;
+        case CODE3('R', 'M', 'E'): return MYEVENTS;
+        case CODE3('R', 'L', 'S'): return LIST;
+        case CODE3('R', 'S', 'E'): return SHOW;
+        case CODE3('R', 'R', 'I'): return RESERVE;
+        case CODE3('R', 'M', 'R'): return MYRESERVATIONS;
+        case CODE3('R', 'K', 'A'): return KEEPALIVE;
+        case CODE3('R', 'L', 'D'): return LIST_DELTA;
+        case CODE3('R', 'S', 'S'): return SESSION;
+        case CODE3('E', 'R', 'R'): return ERROR_REQUEST;
+        default: return UNKNOWN;
+    }
 }
 
 // SERVER -> USER
@@ -219,6 +283,9 @@ const char* get_command_response_code(RequestType command) {
         case SHOW: return "RSE";
         case RESERVE: return "RRI";
         case MYRESERVATIONS: return "RMR";
+        case KEEPALIVE: return "RKA";
+        case LIST_DELTA: return "RLD";
+        case SESSION: return "RSS";
         case ERROR_REQUEST: return "ERR";
         default: return "UNK";
     }
@@ -229,22 +296,25 @@ const char* get_command_response_code(RequestType command) {
 // SERVER -> USER
 // "XXX" -> ReplyStatus
 ReplyStatus identify_status_code(const char* status) {
-    if (strcmp(status, "ERR") == 0) return STATUS_ERROR;
-    if (strcmp(status, "OK") == 0) return STATUS_OK;
-    if (strcmp(status, "NOK") == 0) return STATUS_NOK;
-    if (strcmp(status, "REG") == 0) return STATUS_REGISTERED;
-    if (strcmp(status, "NLG") == 0) return STATUS_NOT_LOGGED_IN;
-    if (strcmp(status, "WRP") == 0) return STATUS_WRONG_PASSWORD;
-    if (strcmp(status, "UNR") == 0) return STATUS_USER_NOT_REGISTERED;
-    if (strcmp(status, "NID") == 0) return STATUS_USER_NOT_FOUND;
-    if (strcmp(status, "NOE") == 0) return STATUS_NO_EVENT_ID;
-    if (strcmp(status, "SLD") == 0) return STATUS_EVENT_SOLD_OUT;
-    if (strcmp(status, "PST") == 0) return STATUS_PAST_EVENT;
-    if (strcmp(status, "CLS") == 0) return STATUS_EVENT_CLOSED;
-    if (strcmp(status, "ACC") == 0) return STATUS_EVENT_RESERVED;
-    if (strcmp(status, "REJ") == 0) return STATUS_EVENT_RESERVATION_REJECTION;
-    if (strcmp(status, "CLO") == 0) return STATUS_EVENT_CLOSE_CLOSED;
-    return STATUS_UNEXPECTED_RESPONSE;
+    switch (pack_code(status, TRUE)) {
+        case CODE3('E', 'R', 'R'): return STATUS_ERROR;
+        case CODE3('O', 'K', 0): return STATUS_OK;
+        case CODE3('N', 'O', 'K'): return STATUS_NOK;
+        case CODE3('R', 'E', 'G'): return STATUS_REGISTERED;
+        case CODE3('N', 'L', 'G'): return STATUS_NOT_LOGGED_IN;
+        case CODE3('W', 'R', 'P'): return STATUS_WRONG_PASSWORD;
+        case CODE3('U', 'N', 'R'): return STATUS_USER_NOT_REGISTERED;
+        case CODE3('N', 'I', 'D'): return STATUS_USER_NOT_FOUND;
+        case CODE3('N', 'O', 'E'): return STATUS_NO_EVENT_ID;
+        case CODE3('S', 'L', 'D'): return STATUS_EVENT_SOLD_OUT;
+        case CODE3('P', 'S', 'T'): return STATUS_PAST_EVENT;
+        case CODE3('C', 'L', 'S'): return STATUS_EVENT_CLOSED;
+        case CODE3('A', 'C', 'C'): return STATUS_EVENT_RESERVED;
+        case CODE3('R', 'E', 'J'): return STATUS_EVENT_RESERVATION_REJECTION;
+        case CODE3('C', 'L', 'O'): return STATUS_EVENT_CLOSE_CLOSED;
+        case CODE3('T', 'C', 'P'): return STATUS_USE_TCP;
+        default: return STATUS_UNEXPECTED_RESPONSE;
+    }
 }
 
 // SERVER -> USER
@@ -266,6 +336,7 @@ const char* get_status_code(ReplyStatus status) {
         case STATUS_EVENT_RESERVED: return "ACC";
         case STATUS_EVENT_RESERVATION_REJECTION: return "REJ";
         case STATUS_EVENT_CLOSE_CLOSED: return "CLO";
+        case STATUS_USE_TCP: return "TCP";
         default: return "UNK";
     }
 }
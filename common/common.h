@@ -7,6 +7,7 @@
 #include <string.h>
 #include <fcntl.h>
 #include "data.h"
+#include "buffer.h"
 
 #define BASE_PORT 58000
 #define GROUP_NUMBER 32
@@ -21,6 +22,8 @@
 
 #define TIMEOUT_SECONDS 5
 #define PASSWORD_LENGTH 8
+#define SESSION_TOKEN_LENGTH 16 // hex, sent in place of the password
+#define SESSION_TIMEOUT_SECONDS 1800 // idle time before a session token expires
 #define COMMAND_LENGTH 3
 #define UID_LENGTH 6
 #define EID_LENGTH 3
@@ -69,8 +72,8 @@ int tcp_send_message(int fd, char *message);
 /**
  * @brief Sends a file's contents over a TCP connection.
  * 
- * Reads the file in chunks and sends each chunk, handling partial writes.
- * Appends a newline character to indicate end of file transfer.
+ * Uses sendfile() so the data never enters userspace; falls back to reading
+ * the file in chunks when the kernel refuses. Appends a newline character to indicate end of file transfer.
  * 
  * @param fd File descriptor of the TCP socket
  * @param file_name Path to the file to send
@@ -88,6 +91,18 @@ int tcp_send_file(int fd, char *file_name);
  */
 int tcp_read(int fd, void *buf, size_t len);
 
+/**
+ * @brief Reads one reply line through a connection buffer.
+ * 
+ * Stops after the newline, so bytes of a following reply stay buffered.
+ * 
+ * @param rb Connection buffer
+ * @param line Buffer to store the line, null-terminated
+ * @param size Size of the line buffer
+ * @return int SUCCESS if anything was read, ERROR if the peer closed first
+ */
+int tcp_read_line(ReadBuffer* rb, char* line, size_t size);
+
 /**
  * @brief Writes data to a TCP socket, handling partial writes.
  * 
@@ -99,26 +114,29 @@ int tcp_read(int fd, void *buf, size_t len);
 int tcp_write(int fd, const char* buffer, size_t length);
 
 /**
- * @brief Reads a single space-delimited field from a TCP socket.
+ * @brief Reads a single space-delimited field from a buffered TCP connection.
  * 
  * Skips leading spaces and reads until the next space or newline.
+ * The socket is only read when the buffer runs out.
  * 
- * @param fd File descriptor of the TCP socket
+ * @param rb Input buffer of the TCP connection
  * @param buffer Buffer to store the field
  * @param max_len Maximum length of the field
  * @return int SUCCESS if terminated by space, EOM if terminated by newline, ERROR on failure
  */
-int tcp_read_field(int fd, char* buffer, size_t max_len);
+int tcp_read_field(ReadBuffer* rb, char* buffer, size_t max_len);
 
 /**
  * @brief Receives a file over TCP and writes it to disk.
  * 
- * @param fd File descriptor of the TCP socket
+ * Bytes already buffered are written first, the rest is read directly.
+ * 
+ * @param rb Input buffer of the TCP connection
  * @param file_name Path where the file will be saved
  * @param file_size Expected size of the file in bytes
  * @return int SUCCESS if file received completely, ERROR on failure
  */
-int tcp_read_file(int fd, char *file_name, long file_size);
+int tcp_read_file(ReadBuffer* rb, char *file_name, long file_size);
 
 /**
  * @brief From command RequestType, get human-readable command name.
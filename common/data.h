@@ -14,6 +14,9 @@ typedef enum RequestType {
     SHOW,
     RESERVE,
     MYRESERVATIONS,
+    KEEPALIVE,
+    LIST_DELTA,
+    SESSION,
     UNKNOWN,
     ERROR_REQUEST,
 } RequestType;
@@ -40,6 +43,7 @@ typedef enum ReplyStatus {
     STATUS_EVENT_CLOSED, // CLS - event was already closed
     STATUS_EVENT_CLOSE_CLOSED, // CLO - event was already closed
     STATUS_EVENT_RESERVATION_REJECTION, // REJ - seats reservation rejected
+    STATUS_USE_TCP,         // TCP - reply too large for a datagram, ask again over TCP
 
     // Communication errors
     STATUS_SEND_FAILED,     // Failed to send request
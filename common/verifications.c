@@ -1,13 +1,76 @@
 #include "verifications.h"
 #include "common.h"
 #include <string.h>
-#include <ctype.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Plain ASCII like the "C" locale the programs run in, without the
+// per-call locale lookup of <ctype.h>
+const unsigned char char_class[256] = {
+    ['0' ... '9'] = CLASS_DIGIT | CLASS_HEX,
+    ['A' ... 'Z'] = CLASS_ALPHA,
+    ['a' ... 'f'] = CLASS_ALPHA | CLASS_HEX,
+    ['g' ... 'z'] = CLASS_ALPHA,
+    ['_'] = CLASS_FILE,
+    ['-'] = CLASS_FILE,
+    ['.'] = CLASS_FILE,
+};
+
+// Checks that every one of the first len characters has one of the classes
+static int all_of_class(const char* str, size_t len, unsigned char mask) {
+    for (size_t i = 0; i < len; i++) {
+        if (!has_class(str[i], mask)) return INVALID;
+    }
+    return VALID;
+}
+
+// Removes the trailing newline left by fgets/getline, returns the new length
+static size_t strip_newline(char* str) {
+    size_t len = strlen(str);
+    if (len > 0 && str[len - 1] == '\n') str[--len] = '\0';
+    return len;
+}
+
+#ifdef __SSE2__
+// Fixed-width fields are checked 16 lanes at a time. SSE2 only has signed
+// byte compares, so lo <= c <= hi is tested as c - lo - 128 < hi - lo - 127.
+static inline __m128i in_range(__m128i v, char lo, char hi) {
+    return _mm_cmplt_epi8(_mm_add_epi8(v, _mm_set1_epi8((char)(-128 - lo))),
+                          _mm_set1_epi8((char)(-127 + (hi - lo))));
+}
+
+static inline __m128i is_digit_lanes(__m128i v) {
+    return in_range(v, '0', '9');
+}
+
+static inline __m128i is_alnum_lanes(__m128i v) {
+    // Setting bit 5 folds 'A'-'Z' onto 'a'-'z' and leaves no other byte there
+    return _mm_or_si128(is_digit_lanes(v), in_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z'));
+}
+
+// Loads a field of at most 16 bytes, zero-filling the lanes past its end.
+// Short fields are assembled in a register: pieces stored to the stack and
+// reloaded as one 64-bit word would stall store forwarding.
+static inline __m128i load_field(const char* str, size_t len) {
+    if (len <= 8) {
+        uint32_t low = 0, high = 0;
+        memcpy(&low, str, len < 4 ? len : 4);
+        if (len > 4) memcpy(&high, str + 4, len - 4);
+        return _mm_set_epi32(0, 0, (int)high, (int)low);
+    }
+    char lanes[16] = {0};
+    memcpy(lanes, str, len);
+    return _mm_loadu_si128((const __m128i*)lanes);
+}
+#endif
 
 int is_number(const char *str) {
     for (int i = 0; str[i] != '\0'; i++) {
-        if (!isdigit(str[i])) return INVALID;
+        if (!has_class(str[i], CLASS_DIGIT)) return INVALID;
     }
     return VALID;
 }
@@ -35,10 +98,11 @@ int verify_argument_count(char* args, int expected_count) {
 
     int count = 0;
     char* temp = strdup(args);
-    char* token = strtok(temp, " ");
+    char* save = NULL;
+    char* token = strtok_r(temp, " ", &save);
     while (token != NULL) {
         count++;
-        token = strtok(NULL, " ");
+        token = strtok_r(NULL, " ", &save);
     }
     free(temp);
 
@@ -47,15 +111,14 @@ int verify_argument_count(char* args, int expected_count) {
 
 int verify_uid_format(char* uid) {
     if (uid == NULL) return INVALID;
+    if (strip_newline(uid) != UID_LENGTH) return INVALID;
 
-    size_t len = strlen(uid);
-    if (len > 0 && uid[len - 1] == '\n') {
-        uid[len - 1] = '\0';
-        len--;
-    }
-
-    if (len != UID_LENGTH) return INVALID;
-    if(!is_number(uid)) return INVALID;
+#ifdef __SSE2__
+    int digits = _mm_movemask_epi8(is_digit_lanes(load_field(uid, UID_LENGTH)));
+    if ((digits & ((1 << UID_LENGTH) - 1)) != (1 << UID_LENGTH) - 1) return INVALID;
+#else
+    if (!all_of_class(uid, UID_LENGTH, CLASS_DIGIT)) return INVALID;
+#endif
 
     return VALID;
 }
@@ -70,54 +133,57 @@ int verify_eid_format(char* eid) {
 
 int verify_password_format(char* password) {
     if (password == NULL) return INVALID;
+    if (strip_newline(password) != PASSWORD_LENGTH) return INVALID;
 
-    size_t len = strlen(password);
-    if (len > 0 && password[len - 1] == '\n') {
-        password[len - 1] = '\0';
-        len--;
-    }
+#ifdef __SSE2__
+    int alnum = _mm_movemask_epi8(is_alnum_lanes(load_field(password, PASSWORD_LENGTH)));
+    if ((alnum & ((1 << PASSWORD_LENGTH) - 1)) != (1 << PASSWORD_LENGTH) - 1) return INVALID;
+#else
+    if (!all_of_class(password, PASSWORD_LENGTH, CLASS_ALNUM)) return INVALID;
+#endif
 
-    if (len != PASSWORD_LENGTH) return INVALID;
+    return VALID;
+}
 
-    // verify alphanumeric
-    for (size_t i = 0; i < PASSWORD_LENGTH; i++) {
-        if (!isalnum((unsigned char)password[i])) return INVALID;
-    }
+int verify_session_token_format(char* token) {
+    if (token == NULL || strlen(token) != SESSION_TOKEN_LENGTH) return INVALID;
 
+#ifdef __SSE2__
+    __m128i v = load_field(token, SESSION_TOKEN_LENGTH);
+    __m128i hex = _mm_or_si128(is_digit_lanes(v), in_range(v, 'a', 'f'));
+    if (_mm_movemask_epi8(hex) != 0xFFFF) return INVALID;
+#else
+    if (!all_of_class(token, SESSION_TOKEN_LENGTH, CLASS_HEX)) return INVALID;
+#endif
     return VALID;
 }
 
+int verify_credential_format(char* credential) {
+    return verify_password_format(credential) || verify_session_token_format(credential);
+}
+
 int verify_event_name_format(char* event_name) {
     if (event_name == NULL) return INVALID;
 
-    size_t len = strlen(event_name);
-    if (len > 0 && event_name[len - 1] == '\n') {
-        event_name[len - 1] = '\0';
-        len--;
-    }
-    
+    size_t len = strip_newline(event_name);
     if (len == 0 || len > MAX_EVENT_NAME) return INVALID;
 
-    // Verify alphanumeric
-    for (size_t i = 0; i < len; i++) {
-        if (!isalnum((unsigned char)event_name[i])) return INVALID;
-    }
-
-    return VALID;
+    return all_of_class(event_name, len, CLASS_ALNUM);
 }
 
 int verify_event_date_format(char* date_str) {
     // Expected format: DD-MM-YYYY HH:MM
     if (date_str == NULL) return INVALID;
     
-    size_t len = strlen(date_str);
-    if (len > 0 && date_str[len - 1] == '\n') {
-        date_str[len - 1] = '\0';
-        len--;
-    }
-    
-    if (len != 16) return INVALID;  // DD-MM-YYYY HH:MM = 16 characters
-
+    if (strip_newline(date_str) != 16) return INVALID;  // DD-MM-YYYY HH:MM = 16 characters
+
+#ifdef __SSE2__
+    // Separators must match the template, every other position must be a digit
+    __m128i v = load_field(date_str, 16);
+    int separators = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_loadu_si128((const __m128i*)"00-00-0000 00:00")));
+    int digits = _mm_movemask_epi8(is_digit_lanes(v));
+    if ((separators & 0x2424) != 0x2424 || (digits | 0x2424) != 0xFFFF) return INVALID;
+#else
     // Check fixed positions for '-', ' ', and ':'
     if (date_str[2] != '-' || date_str[5] != '-' || date_str[10] != ' ' || date_str[13] != ':') {
         return INVALID;
@@ -126,8 +192,9 @@ int verify_event_date_format(char* date_str) {
     // Check numeric parts (skip separators at positions 2, 5, 10, 13)
     for (int i = 0; i < 16; i++) {
         if (i == 2 || i == 5 || i == 10 || i == 13) continue; // Skip separators
-        if (!isdigit((unsigned char)date_str[i])) return INVALID;
+        if (!has_class(date_str[i], CLASS_DIGIT)) return INVALID;
     }
+#endif
 
     // Extract day, month, year, hour, minute
     int day = (date_str[0] - '0') * 10 + (date_str[1] - '0');
@@ -160,7 +227,8 @@ int verify_event_date_format(char* date_str) {
 
     // Verify date is today or in the future
     time_t now = time(NULL);
-    struct tm *today = localtime(&now);
+    struct tm today_tm;
+    struct tm *today = localtime_r(&now, &today_tm);
 
     int current_day = today->tm_mday;
     int current_month = today->tm_mon + 1;  // tm_mon is 0-11
@@ -209,28 +277,13 @@ int verify_reserved_seats(char* reserved_str, char* total_str) {
 int verify_file_name_format(char* file_name) {
     if (file_name == NULL) return INVALID;
 
-    size_t len = strlen(file_name);
-    if (len > 0 && file_name[len - 1] == '\n') {
-        file_name[len - 1] = '\0';
-        len--;
-    }
-
+    size_t len = strip_newline(file_name);
     if (len == 0 || len > FILE_NAME_LENGTH) return INVALID;
 
-    // Reject path traversal attempts (.., /)
-    if (strstr(file_name, "..") != NULL || strstr(file_name, "/") != NULL) {
-        return INVALID;
-    }
-
-    // Verify alphanumeric, dots, underscores, and hyphens
-    for (size_t i = 0; i < len; i++) {
-        if (!isalnum((unsigned char)file_name[i]) && 
-            file_name[i] != '_' && 
-            file_name[i] != '-' && 
-            file_name[i] != '.') {
-            return INVALID;
-        }
-    }
+    // Alphanumeric, dots, underscores and hyphens; a '/' is never allowed,
+    // so path traversal is left with ".."
+    if (!all_of_class(file_name, len, CLASS_ALNUM | CLASS_FILE)) return INVALID;
+    if (strstr(file_name, "..") != NULL) return INVALID;
 
     return VALID;
 }
@@ -1,6 +1,27 @@
 #ifndef VERIFICATIONS_H
 #define VERIFICATIONS_H
 
+// Character classes of the protocol fields
+#define CLASS_DIGIT 0x01
+#define CLASS_ALPHA 0x02
+#define CLASS_HEX   0x04    // lowercase hex, as in session tokens
+#define CLASS_FILE  0x08    // punctuation allowed in file names
+#define CLASS_ALNUM (CLASS_DIGIT | CLASS_ALPHA)
+
+// Classes of every byte, indexed by its unsigned value
+extern const unsigned char char_class[256];
+
+/**
+ * @brief Checks if a character has one of the given classes.
+ * 
+ * @param c 
+ * @param mask CLASS_* flags
+ * @return int Non-zero if it has one of them, 0 otherwise.
+ */
+static inline int has_class(char c, unsigned char mask) {
+    return char_class[(unsigned char)c] & mask;
+}
+
 /**
  * @brief Checks if a string represents a valid number.
  * 
@@ -49,6 +70,22 @@ int verify_eid_format(char* eid);
  */
 int verify_password_format(char* pass);
 
+/**
+ * @brief Verifies if the session token format is correct (16 lowercase hex characters).
+ * 
+ * @param token 
+ * @return int VALID if the token format is correct, INVALID otherwise.
+ */
+int verify_session_token_format(char* token);
+
+/**
+ * @brief Verifies if a credential is either a password or a session token.
+ * 
+ * @param credential 
+ * @return int VALID if the credential format is correct, INVALID otherwise.
+ */
+int verify_credential_format(char* credential);
+
 /**
  * @brief Verifies if the argument count is correct.
  * 
@@ -19,14 +19,60 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <sys/select.h>
+#include <sys/epoll.h>
+#include <fcntl.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 
 #include "../../common/common.h"
 
 #define ERROR -1
 #define EMPTY_FILE -2
 #define DIR_ALREADY_EXISTS -3
-#define MAX_TCP_CLIENTS 10 
+#define MAX_TCP_CLIENTS 1024
+#define MAX_EPOLL_EVENTS 256
+#define UDP_BATCH_SIZE 64
+#define UDP_SEND_WAIT_MS 100     // longest wait for room in a full UDP send buffer
+#define UDP_REPLY_DELAY_US 200   // longest time a batched UDP reply waits for company
+#define CONN_READ_CHUNK 4096
+#define CONN_OUT_CHUNK 4096
+#define CONN_SPLICE_CHUNK 65536
+#define MAX_REQUEST_HEADER 512
+#define UPLOAD_TEMPLATE "EVENTS/.upload_XXXXXX"
+#define UPLOAD_PREFIX ".upload_"
+#define USER_TABLE_SIZE 1024
+#define EID_BITMAP_WORDS ((MAX_EVENTS + 64) / 64)
+#define WAL_PATH "ES.wal"
+#define WAL_RECORD_SIZE 256
+#define WAL_BATCH_SIZE 65536
+#define WAL_CHECKPOINT_SIZE (4 * 1024 * 1024)  // log size that triggers a checkpoint
+#define USER_SLOT_EMPTY -1
+#define USER_SLOT_DELETED -2
+#define RECENT_RESERVATIONS 50      // reservations listed by RMR
+#define RECENT_LOCKS 64
+#define USER_LOCKS 256
+#define MY_EVENTS_ENTRY_LENGTH 6    // " EID s" in an RME reply
+#define MY_RESERVATIONS_ENTRY_LENGTH 28  // " EID DD-MM-YYYY HH:MM:SS seats" in an RMR reply
+#define UDP_REPLY_LIMIT 1400        // largest reply sent as one unfragmented datagram
+#define TIMER_TICK_MS 100
+#define TIMER_WHEEL_BITS 8
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 2
+#define HEADER_TIMEOUT_MS 10000     // whole request header, from its first byte
+#define BODY_TIMEOUT_MS 30000       // longest pause inside a CRE upload
+#define WRITE_TIMEOUT_MS 30000      // longest pause while the reply is flushed
+#define IDLE_TIMEOUT_MS 60000       // keep-alive connection between requests
+#define MAX_WORKERS 256
+#define MAX_LOOPS 64
+#define RING_ENTRIES 256
+#define RING_IOVECS 8              // reply chunks gathered into one io_uring send
+#define LIST_VERSION_LENGTH 20      // digits of a 64-bit state version
+#define LIST_SHARD_EVENTS 32        // EIDs per pre-rendered slice of the RLS reply
+#define LIST_SHARDS ((MAX_EVENTS + LIST_SHARD_EVENTS) / LIST_SHARD_EVENTS)
+#define LIST_ENTRY_LENGTH 40        // "EID name state DD-MM-YYYY HH:MM "
+#define DEFAULT_QUEUE_SIZE 1024
+#define MAX_QUEUE_SIZE 65536
 
 #define PAST '0'
 #define ACCEPTING '1'
@@ -38,11 +84,226 @@ typedef struct {
     char* port;
     int udp_socket;
     int tcp_socket;
-    fd_set read_fds;
-    fd_set temp_fds;
-    struct timeval timeout;
+    int n_loops;        // event loops, each with its own SO_REUSEPORT sockets
+    int use_uring;      // io_uring engine instead of epoll
+    int n_workers;      // 0 handles requests inline in the event loop
+    int queue_size;
 } Settings;
 
+// Intrusive timer, linked into one slot of a TimerWheel while armed
+typedef struct TimerNode {
+    struct TimerNode* prev;
+    struct TimerNode* next;
+    uint64_t expires;       // tick at which the timer fires
+} TimerNode;
+
+// Hierarchical timer wheel: level 0 has one slot per tick, each level 1 slot
+// covers a full turn of level 0 and is cascaded down when that turn starts
+typedef struct {
+    TimerNode slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];   // list heads
+    uint64_t now;           // last tick processed
+    size_t armed;
+} TimerWheel;
+
+// What the deadline of a connection is guarding
+typedef enum TimeoutKind {
+    TIMEOUT_NONE,       // a worker owns the connection
+    TIMEOUT_HEADER,     // request header still arriving
+    TIMEOUT_BODY,       // CRE file data still arriving
+    TIMEOUT_WRITE,      // reply still being flushed
+    TIMEOUT_IDLE,       // keep-alive connection waiting for the next request
+} TimeoutKind;
+
+// Submission and completion rings shared with the kernel (io_uring engine)
+typedef struct {
+    int fd;                          // -1 when the loop runs on epoll
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    struct io_uring_sqe* sqes;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+    void* sq_map;                    // ring mappings, for munmap()
+    size_t sq_map_size;
+    void* cq_map;
+    size_t cq_map_size;
+} Ring;
+
+// An event loop and the listening sockets it owns; loop 0 owns set.udp_socket
+// and set.tcp_socket
+typedef struct {
+    int epoll_fd;       // -1 when the loop runs on its ring
+    Ring ring;
+    int udp_socket;
+    int tcp_socket;
+    TimerWheel timers;  // deadlines of the loop's connections
+
+    // Workers queue finished connections here and signal wake_fd, only the
+    // loop thread changes connection state or submits to its ring
+    int wake_fd;
+    pthread_mutex_t resume_lock;
+    struct Connection* resumed;
+} EventLoop;
+
+// Lifecycle of an accepted TCP client inside the event loop
+typedef enum ConnectionState {
+    CONN_READING,       // accumulating the request bytes
+    CONN_PROCESSING,    // full request buffered, handler running
+    CONN_WRITING,       // flushing the queued reply
+    CONN_CLOSED,        // io_uring engine: freed once its operation completes
+} ConnectionState;
+
+// io_uring engine: the one operation a connection has in flight
+typedef enum RingOp {
+    RING_IDLE,          // nothing submitted
+    RING_RECV,          // request bytes into the read buffer
+    RING_RECV_FILE,     // CRE file data into the bounce buffer
+    RING_WRITE_FILE,    // bounce buffer into the upload temp file
+    RING_READ_FILE,     // file chunk of the reply into the bounce buffer
+    RING_SEND,          // memory chunk, or the file bytes in the bounce buffer
+} RingOp;
+
+// How a file chunk reaches the socket, each mode falls back to the next
+typedef enum FileSendMode {
+    SEND_SENDFILE,      // sendfile() straight from the page cache
+    SEND_SPLICE,        // splice() file -> pipe -> socket
+    SEND_COPY,          // pread() into userspace and write()
+} FileSendMode;
+
+// Immutable, reference-counted reply bytes shared by many connections
+typedef struct {
+    _Atomic int refs;
+    size_t len;
+    char data[];
+} SharedBuffer;
+
+// A pending piece of a TCP reply: bytes in memory, possibly shared, or a file region
+typedef struct OutChunk {
+    struct OutChunk* next;
+    int file_fd;        // -1 for memory chunks
+    off_t offset;       // next file byte to send (file chunks)
+    size_t len;         // bytes queued (memory) or file bytes left (file)
+    size_t sent;        // bytes already written (memory chunks)
+    SharedBuffer* shared;   // memory chunk sending a shared buffer instead of data[]
+    FileSendMode mode;
+    int pipe_fds[2];    // splice mode only, -1 until created
+    size_t piped;       // file bytes sitting in the pipe
+    size_t cap;
+    char data[];
+} OutChunk;
+
+// CRE file data streamed to a hidden temp file in EVENTS/ while it arrives
+typedef struct {
+    int fd;             // -1 while no upload is in progress
+    char path[32];      // temp file, empty once moved into place
+    size_t header_len;  // request bytes before the file data
+    size_t left;        // file bytes still to receive
+    int use_splice;     // cleared when the kernel refuses socket splices
+    int pipe_fds[2];    // -1 until the first splice
+} Upload;
+
+typedef struct Connection {
+    int fd;
+    EventLoop* loop;                 // loop whose epoll set or ring watches the socket
+    TimerNode timer;                 // deadline in the loop's timer wheel
+    TimeoutKind timeout;
+    struct sockaddr_in client_addr;
+    socklen_t addr_len;
+    _Atomic ConnectionState state;   // handed between event loop and workers
+    int peer_closed;
+    int keep_alive;                  // set by KAL: serve requests until the peer closes
+    size_t pending;                  // buffered bytes past the request being handled
+    struct Connection* next_resumed; // EventLoop.resumed list link
+
+    // Input: request bytes received so far, fields are parsed in place
+    ReadBuffer in;
+    Upload upload;
+
+    // Output: queue of reply chunks, flushed when the socket is writable
+    OutChunk* out_head;
+    OutChunk* out_tail;
+
+    // io_uring engine: every transfer completes on the ring, one at a time
+    RingOp ring_op;
+    char* bounce;       // CONN_SPLICE_CHUNK bytes for file data, NULL until needed
+    size_t bounce_len;  // bytes in it
+    size_t bounce_done; // bytes of it already written or sent
+    struct iovec ring_iov[RING_IOVECS];    // reply parts of the send in flight
+    struct msghdr ring_msg;
+} Connection;
+
+// One reservation as listed by RMR
+typedef struct {
+    char eid[EID_LENGTH + 1];
+    char datetime[EVENT_DATE_LENGHT_W_SECONDS + 1];    // DD-MM-YYYY HH:MM:SS
+    int seats;
+} ReservationEntry;
+
+// A user's most recent reservations, oldest at head, mirrored in
+// USERS/{UID}/{UID}reservations.txt
+typedef struct {
+    ReservationEntry entries[RECENT_RESERVATIONS];
+    int head;
+    int count;
+} ReservationRing;
+
+// A registered user, uid is USER_SLOT_EMPTY or USER_SLOT_DELETED for free slots
+typedef struct {
+    _Atomic int uid;            // set last, lookups on other threads probe past it
+    char password[PASSWORD_LENGTH + 1];
+    char logged_in;
+    ReservationRing* recent;    // NULL until the user's reservations are first needed
+    uint64_t created[EID_BITMAP_WORDS];    // one bit per EID listed in CREATED/
+    int created_count;
+    char token[SESSION_TOKEN_LENGTH + 1];  // session token, empty when there is none
+    _Atomic time_t session_expiry;          // pushed back by every authenticated request
+} UserEntry;
+
+typedef enum PersistKind {
+    PERSIST_LOGIN,
+    PERSIST_LOGOUT,
+    PERSIST_PASSWORD,
+} PersistKind;
+
+// A user file write handed to the persister thread
+typedef struct PersistOp {
+    struct PersistOp* next;
+    PersistKind kind;
+    char uid[UID_LENGTH + 1];
+    char password[PASSWORD_LENGTH + 1];
+} PersistOp;
+
+// Cached contents of an event's START_, RES_ and END_ files
+typedef struct {
+    _Atomic char exists;                    // set once the record is filled in
+    _Atomic char state;                     // ACCEPTING, SOLD_OUT, CLOSED or PAST
+    char uid[UID_LENGTH + 1];
+    char name[MAX_EVENT_NAME + 1];
+    char date[EVENT_DATE_LENGTH + 1];       // DD-MM-YYYY HH:MM
+    char file_name[FILE_NAME_LENGTH + 1];
+    int total_seats;
+    _Atomic int reserved_seats;             // written under the event's lock
+    time_t start_time;                      // event date, -1 if unparsable
+    _Atomic uint64_t version;               // state version of its last change
+} EventRecord;
+
+// Rendered RLS entries of one range of LIST_SHARD_EVENTS EIDs
+typedef struct {
+    uint64_t version;       // last listing change to the range when it was rendered
+    size_t len;
+    char text[LIST_SHARD_EVENTS * LIST_ENTRY_LENGTH];
+} ListShard;
+
+// Entry of the min-heap of event dates still to turn PAST
+typedef struct {
+    time_t deadline;
+    int eid;
+} EventDeadline;
+
 typedef struct {
     int client_socket;
     struct sockaddr_in client_addr;
@@ -50,8 +311,39 @@ typedef struct {
     int is_tcp;
     char buffer[BUFFER_SIZE];
     char** cursor;
+    Connection* conn;
+    char* reply;            // UDP reply held until the request's WAL records are durable
+    size_t reply_len;
 } Request;
 
+// Request whose reply waits until its WAL records are on disk
+typedef struct WalWaiter {
+    struct WalWaiter* next;
+    uint64_t lsn;
+    void (*done)(Request* req, int durable);
+    Request req;
+} WalWaiter;
+
+// UDP reply waiting to go out in the next sendmmsg() batch
+typedef struct {
+    int socket;             // UDP socket the request arrived on
+    struct sockaddr_in client_addr;
+    socklen_t addr_len;
+    char* data;
+    size_t len;
+} UdpReply;
+
+// Bounded MPMC queue feeding requests from the event loop to the workers
+typedef struct {
+    Request* slots;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} TaskQueue;
+
 extern Settings set;
 
 #endif
\ No newline at end of file
@@ -12,43 +12,593 @@
 #include <arpa/inet.h>
 #include "globals.h"
 
-// =============== socket_manager.c ===============
+// =============== event_loop.c ===============
+
+/**
+ * @brief Creates one epoll instance (or io_uring with -u) per event loop and
+ *        registers its UDP and TCP listening sockets.
+ * 
+ * Loop 0 uses set.udp_socket and set.tcp_socket; every other loop binds its
+ * own SO_REUSEPORT pair. Sockets are switched to non-blocking mode and
+ * watched edge-triggered. A loop whose ring cannot be created falls back
+ * to epoll.
+ * 
+ * @return int SUCCESS on success, ERROR on failure
+ */
+int event_loop_setup();
+
+/**
+ * @brief Runs the server event loops forever.
+ * 
+ * Loops 1..n run on their own threads, loop 0 on the calling thread. Each
+ * drains its UDP datagrams, accepts its TCP clients and drives every client
+ * socket as a non-blocking state machine: the request is buffered until
+ * complete, handled, and the queued reply is flushed whenever the socket is
+ * writable.
+ */
+void event_loop_run();
+
+/**
+ * @brief Parses the command of a buffered TCP request and runs its handler.
+ * 
+ * @param req Request bound to the client connection
+ */
+void serve_tcp_request(Request* req);
+
+/**
+ * @brief Hands a connection back to the event loop once its reply is queued.
+ * 
+ * Queues the connection for its loop and wakes the loop through an eventfd;
+ * the loop thread marks it as writing and flushes the reply. Safe to call
+ * from worker threads.
+ * 
+ * @param conn Client connection
+ */
+void connection_resume(Connection* conn);
+
+/**
+ * @brief Closes a CRE upload and deletes its temp file unless it was moved into place.
+ * 
+ * @param upload Upload state of a connection
+ */
+void upload_discard(Upload* upload);
+
+
+// =============== threads.c ===============
+
+/**
+ * @brief Creates the request queue and starts the worker threads.
+ * 
+ * Does nothing when the server runs with zero workers.
+ * 
+ * @return int SUCCESS on success, ERROR on failure
+ */
+int thread_pool_setup();
+
+/**
+ * @brief Hands a request to the worker pool.
+ * 
+ * The request is copied into the bounded queue, blocking while the queue is
+ * full. Without workers the request is handled inline.
+ * 
+ * @param req Request to handle
+ */
+void dispatch_request(Request* req);
+
+/**
+ * @brief Runs the UDP or TCP handler for a request.
+ * 
+ * Every request holds the state lock shared, and requests that carry a UID
+ * also hold that user's lock, so only requests of the same user serialize.
+ * A request that logged changes is parked with wal_park() until they are
+ * durable; the reply, or the TCP connection, is then handed back to the
+ * event loop.
+ * 
+ * @param req Request to handle
+ */
+void handle_task(Request* req);
+
+/**
+ * @brief Waits until no request holds the state lock and takes it exclusively.
+ * 
+ * @param wait FALSE to give up at once when the lock is held
+ * @return int TRUE once the lock is held, FALSE if it was busy and wait is FALSE
+ */
+int state_lock_exclusive(int wait);
+
+/**
+ * @brief Releases the state lock taken with state_lock_exclusive().
+ */
+void state_unlock();
+
+
+// =============== timer_wheel.c ===============
+
+/**
+ * @brief Current time in timer ticks (TIMER_TICK_MS) on the monotonic clock.
+ * 
+ * @return uint64_t Tick count
+ */
+uint64_t timer_now();
+
+/**
+ * @brief Initializes an empty timer wheel starting at the current tick.
+ * 
+ * @param wheel Wheel to initialize
+ */
+void timer_wheel_init(TimerWheel* wheel);
+
+/**
+ * @brief Arms a timer, replacing its previous deadline if it was armed.
+ * 
+ * O(1): the timer is linked into the slot of its expiry tick. Deadlines past
+ * the reach of the wheel are clamped to its last slot.
+ * 
+ * @param wheel Wheel owning the timer
+ * @param node Timer, zero-initialized before its first use
+ * @param timeout_ms Delay from now, rounded up to whole ticks
+ */
+void timer_arm(TimerWheel* wheel, TimerNode* node, uint64_t timeout_ms);
+
+/**
+ * @brief Disarms a timer, does nothing if it is not armed.
+ * 
+ * @param wheel Wheel owning the timer
+ * @param node Timer
+ */
+void timer_cancel(TimerWheel* wheel, TimerNode* node);
+
+/**
+ * @brief Advances the wheel to the current tick and fires every expired timer.
+ * 
+ * Level 1 slots are cascaded into level 0 as each turn of level 0 begins.
+ * Timers are disarmed before their callback runs, so the callback may free them.
+ * 
+ * @param wheel Wheel to advance
+ * @param fire Callback run for each expired timer
+ */
+void timer_wheel_advance(TimerWheel* wheel, void (*fire)(TimerNode*));
+
+/**
+ * @brief epoll_wait() timeout that keeps the wheel ticking.
+ * 
+ * @param wheel Wheel
+ * @return int TIMER_TICK_MS while timers are armed, -1 otherwise
+ */
+int timer_wheel_timeout(const TimerWheel* wheel);
+
+
+// =============== uring.c ===============
+
+/**
+ * @brief Creates an io_uring instance and maps its rings, without liburing.
+ * 
+ * The kernel must also take multishot accept and multishot poll (5.19+):
+ * both are tried first on a scratch ring, so older kernels fall back to
+ * epoll instead of failing every accept.
+ * 
+ * @param ring Ring to set up, ring->fd is -1 on failure
+ * @param entries Submission queue size
+ * @return int SUCCESS on success, ERROR if io_uring (5.19+) is unavailable
+ */
+int ring_setup(Ring* ring, unsigned entries);
+
+/**
+ * @brief Queues a multishot, edge-triggered poll of a socket.
+ * 
+ * Each readiness change completes with the epoll event mask in res and
+ * IORING_CQE_F_MORE set; a completion without the flag ends the poll.
+ * 
+ * @param ring Ring of the calling loop
+ * @param fd Socket to watch
+ * @param events Epoll event mask
+ * @param tag User data of the completions
+ */
+void ring_poll(Ring* ring, int fd, uint32_t events, void* tag);
+
+/**
+ * @brief Queues the cancellation of the request with the given tag.
+ * 
+ * Its completion has a NULL tag; the cancelled request still completes,
+ * with -ECANCELED unless it finished first.
+ * 
+ * @param ring Ring of the calling loop
+ * @param tag User data the request was queued with
+ */
+void ring_cancel(Ring* ring, void* tag);
+
+/**
+ * @brief Queues a receive from a socket, completing with the byte count in
+ *        res (0 on peer close) once data arrives.
+ * 
+ * @param ring Ring of the calling loop
+ * @param fd Socket to receive from
+ * @param buf Destination, untouched by the caller until the completion
+ * @param len Bytes wanted
+ * @param tag User data of the completion
+ */
+void ring_recv(Ring* ring, int fd, void* buf, size_t len, void* tag);
+
+/**
+ * @brief Queues a send to a socket, completing with the byte count in res
+ *        once the socket took some of the bytes.
+ * 
+ * @param ring Ring of the calling loop
+ * @param fd Socket to send to
+ * @param buf Bytes to send, untouched by the caller until the completion
+ * @param len Number of bytes
+ * @param tag User data of the completion
+ */
+void ring_send(Ring* ring, int fd, const void* buf, size_t len, void* tag);
+
+/**
+ * @brief Queues a gathering send of every buffer in msg->msg_iov.
+ * 
+ * @param ring Ring of the calling loop
+ * @param fd Socket to send to
+ * @param msg Message and its buffers, untouched by the caller until the completion
+ * @param tag User data of the completion
+ */
+void ring_sendmsg(Ring* ring, int fd, const struct msghdr* msg, void* tag);
 
 /**
- * @brief Handles incoming connections using select() multiplexing.
+ * @brief Queues a read from a file at an offset.
  * 
- * Monitors both UDP and TCP sockets for incoming data and dispatches
- * to appropriate handlers.
+ * @param ring Ring of the calling loop
+ * @param fd File to read
+ * @param buf Destination, untouched by the caller until the completion
+ * @param len Bytes wanted
+ * @param offset File offset, -1 for the file position
+ * @param tag User data of the completion
+ */
+void ring_read(Ring* ring, int fd, void* buf, size_t len, off_t offset, void* tag);
+
+/**
+ * @brief Queues a write to a file at an offset.
  * 
- * @return int SUCCESS on normal operation, ERROR on critical failure
+ * @param ring Ring of the calling loop
+ * @param fd File to write
+ * @param buf Bytes to write, untouched by the caller until the completion
+ * @param len Number of bytes
+ * @param offset File offset, -1 for the file position
+ * @param tag User data of the completion
  */
-int select_handler();
+void ring_write(Ring* ring, int fd, const void* buf, size_t len, off_t offset, void* tag);
 
 /**
- * @brief Handles an incoming UDP connection.
+ * @brief Queues a multishot accept, every client completes with its
+ *        non-blocking socket in res.
  * 
- * Receives a UDP datagram and dispatches it to the UDP request handler.
+ * @param ring Ring of the calling loop
+ * @param fd Listening socket
+ * @param tag User data of the completions
  */
-void udp_connection();
+void ring_accept(Ring* ring, int fd, void* tag);
 
 /**
- * @brief Handles an incoming TCP connection.
+ * @brief Submits every queued SQE and waits for at least one completion,
+ *        all in a single io_uring_enter().
  * 
- * Accepts a new TCP connection, reads the request, and dispatches to handler.
+ * @param ring Ring of the calling loop
+ * @param timeout_ms Longest wait, -1 for none
+ * @return int SUCCESS (also on timeout or signal), ERROR on failure
  */
-void tcp_connection();
+int ring_wait(Ring* ring, int timeout_ms);
 
 /**
- * @brief Sends a UDP response message to the client.
+ * @brief Takes the next completion off the ring.
+ * 
+ * @param ring Ring of the calling loop
+ * @param tag Set to the user data of the request
+ * @param res Set to the result of the request
+ * @param flags Set to the completion flags
+ * @return int TRUE if a completion was taken, FALSE if none is pending
+ */
+int ring_reap(Ring* ring, void** tag, int* res, unsigned* flags);
+
+
+// =============== wal.c ===============
+
+/**
+ * @brief Replays the write-ahead log onto the USERS/ and EVENTS/ files,
+ *        truncates it and starts the group-commit flusher thread.
+ * 
+ * The flusher checkpoints the log (syncs the files and truncates it)
+ * whenever it grows past WAL_CHECKPOINT_SIZE.
+ * 
+ * Must run before the user and event tables are loaded from disk.
+ * 
+ * @return int SUCCESS on success, ERROR on failure
+ */
+int wal_setup();
+
+/**
+ * @brief Returns the LSN of the last record the calling thread appended and
+ *        forgets it.
+ * 
+ * @return uint64_t LSN, 0 if the thread appended nothing since the last call
+ */
+uint64_t wal_take_thread_lsn();
+
+/**
+ * @brief Holds a request until every record up to lsn has been fdatasync()ed,
+ *        without blocking the caller.
+ * 
+ * The request is copied and finished by the flusher thread after its sync,
+ * or at once if the records are already durable.
+ * 
+ * @param lsn Log sequence number of the request's last record
+ * @param req Request whose reply waits for the records
+ * @param done Called with durable FALSE if the log failed before the records
+ *        reached the disk
+ */
+void wal_park(uint64_t lsn, Request* req, void (*done)(Request* req, int durable));
+
+/**
+ * @brief Tells whether changes can still be logged.
+ * 
+ * @return int FALSE once a log write or sync has failed, TRUE otherwise
+ */
+int wal_writable();
+
+/**
+ * @brief Logs the registration of a new user.
+ * 
+ * @param UID User ID
+ */
+void wal_log_register(const char* UID);
+
+/**
+ * @brief Logs the removal of a user.
+ * 
+ * @param UID User ID
+ */
+void wal_log_unregister(const char* UID);
+
+/**
+ * @brief Logs a login.
+ * 
+ * @param UID User ID
+ */
+void wal_log_login(const char* UID);
+
+/**
+ * @brief Logs a logout.
+ * 
+ * @param UID User ID
+ */
+void wal_log_logout(const char* UID);
+
+/**
+ * @brief Logs a password change.
+ * 
+ * @param UID User ID
+ * @param password New password
+ */
+void wal_log_password(const char* UID, const char* password);
+
+/**
+ * @brief Logs the creation of an event.
+ * 
+ * @param EID Event ID
+ * @param UID Creator's UID
+ * @param event_name Event name
+ * @param file_name Description file name
+ * @param seat_count Number of seats
+ * @param event_date Event date (DD-MM-YYYY HH:MM)
+ */
+void wal_log_create(const char* EID, const char* UID, const char* event_name,
+                    const char* file_name, const char* seat_count, const char* event_date);
+
+/**
+ * @brief Logs a reservation together with the event's new reserved total.
+ * 
+ * @param EID Event ID
+ * @param UID User ID
+ * @param num_seats Seats reserved
+ * @param reserved_total Event's reserved seats after the reservation
+ * @param datetime Reservation time (DD-MM-YYYY HH:MM:SS)
+ */
+void wal_log_reserve(const char* EID, const char* UID, int num_seats, int reserved_total,
+                     const char* datetime);
+
+/**
+ * @brief Logs the closing of an event.
+ * 
+ * @param EID Event ID
+ * @param datetime Closing time (DD-MM-YYYY HH:MM:SS)
+ */
+void wal_log_close(const char* EID, const char* datetime);
+
+
+// =============== socket_manager.c ===============
+
+/**
+ * @brief Puts a file descriptor in non-blocking mode.
+ * 
+ * @param fd File descriptor
+ * @return int SUCCESS on success, ERROR on failure
+ */
+int set_nonblocking(int fd);
+
+/**
+ * @brief Handles incoming UDP datagrams.
+ * 
+ * Receives every datagram queued on the UDP socket, up to UDP_BATCH_SIZE per
+ * recvmmsg() call, and dispatches each one to the UDP request handler.
+ * 
+ * @param udp_socket UDP socket of the calling event loop
+ */
+void udp_connection(int udp_socket);
+
+/**
+ * @brief Queues a UDP response message for the client.
+ * 
+ * The datagram is sent by flush_udp_response() once the request's logged
+ * changes are durable.
  * 
  * @param message Response message (should end with newline)
  * @param req Request structure containing client address info
  */
 void send_udp_response(const char* message, Request *req);
 
+/**
+ * @brief Moves the queued UDP response, if any, into the calling thread's
+ *        reply batch.
+ * 
+ * The batch is sent by send_udp_replies(), as soon as it holds
+ * UDP_BATCH_SIZE replies, or by send_due_udp_replies() once it is old.
+ * 
+ * @param req Request structure containing client address info
+ */
+void flush_udp_response(Request* req);
+
+/**
+ * @brief Sends every reply batched by the calling thread with sendmmsg().
+ * 
+ * Each reply goes out on the UDP socket its request arrived on, one
+ * sendmmsg() run per socket.
+ */
+void send_udp_replies();
+
+/**
+ * @brief Sends the calling thread's batch once its oldest reply has waited
+ *        UDP_REPLY_DELAY_US, so a busy worker never holds replies back
+ *        for long.
+ */
+void send_due_udp_replies();
+
+/**
+ * @brief Queues bytes on the TCP reply of the request's connection.
+ * 
+ * @param req Request being answered
+ * @param data Bytes to send
+ * @param length Number of bytes
+ * @return int SUCCESS if queued, ERROR on allocation failure
+ */
+int send_tcp_data(Request* req, const char* data, size_t length);
+
+/**
+ * @brief Queues a TCP response message for the client.
+ * 
+ * @param message Null-terminated response message
+ * @param req Request being answered
+ * @return int SUCCESS if queued, ERROR on allocation failure
+ */
+int send_tcp_response(const char* message, Request* req);
+
+/**
+ * @brief Queues a response on the transport the request arrived on.
+ * 
+ * Used by the requests served over both UDP and TCP (LME and LMR).
+ * 
+ * @param message Null-terminated response message
+ * @param req Request being answered
+ */
+void send_response(const char* message, Request* req);
+
+/**
+ * @brief Allocates a shared buffer holding one reference.
+ * 
+ * @param cap Capacity in bytes, len starts at 0
+ * @return SharedBuffer* New buffer, NULL on allocation failure
+ */
+SharedBuffer* shared_buffer_new(size_t cap);
+
+/**
+ * @brief Takes one more reference on a shared buffer.
+ * 
+ * @param buffer Shared buffer
+ */
+void shared_buffer_retain(SharedBuffer* buffer);
+
+/**
+ * @brief Drops one reference, freeing the buffer with the last one.
+ * 
+ * @param buffer Shared buffer
+ */
+void shared_buffer_release(SharedBuffer* buffer);
+
+/**
+ * @brief Queues a shared buffer on the TCP reply without copying it.
+ * 
+ * The queued chunk holds its own reference until it is sent.
+ * 
+ * @param req Request being answered
+ * @param buffer Immutable shared buffer
+ * @return int SUCCESS if queued, ERROR on allocation failure
+ */
+int send_tcp_shared(Request* req, SharedBuffer* buffer);
+
+/**
+ * @brief Queues a file's contents followed by a newline on the TCP reply.
+ * 
+ * @param file_name Path to the file to send
+ * @param req Request being answered
+ * @return int SUCCESS if queued, ERROR if the file cannot be opened
+ */
+int send_tcp_file(const char* file_name, Request* req);
+
+/**
+ * @brief Writes as much of the queued reply as the socket accepts.
+ * 
+ * @param conn Client connection
+ * @return int TRUE if the reply was fully sent, FALSE if the socket would block,
+ *         ERROR on failure
+ */
+int flush_tcp_output(Connection* conn);
+
+/**
+ * @brief io_uring engine: queues one gathering send of the next parts of the
+ *        reply, or first the read of the file bytes it carries.
+ * 
+ * Chunks that are fully sent are released on the way.
+ * 
+ * @param conn Client connection without an operation in flight
+ * @return int TRUE if the reply was fully sent, FALSE once an operation is
+ *         queued, ERROR on failure
+ */
+int submit_tcp_output(Connection* conn);
+
+/**
+ * @brief io_uring engine: accounts the completion of the operation queued by
+ *        submit_tcp_output().
+ * 
+ * @param conn Client connection
+ * @param op RING_SEND or RING_READ_FILE
+ * @param res Result of the completion
+ * @return int SUCCESS, ERROR if the operation failed
+ */
+int complete_tcp_output(Connection* conn, RingOp op, int res);
+
+/**
+ * @brief Releases every chunk still queued on a connection's reply.
+ * 
+ * @param conn Client connection
+ */
+void free_tcp_output(Connection* conn);
+
 
 // =============== connection.c ===============
 
+/**
+ * @brief Creates a socket bound to the server port.
+ * 
+ * Sets SO_REUSEPORT when more than one event loop is configured, so every
+ * loop can bind its own socket to the same port.
+ * 
+ * @param flag Socket type (SOCK_DGRAM or SOCK_STREAM)
+ * @return int The socket file descriptor on success, ERROR on failure
+ */
+int socket_setup(int flag);
+
+/**
+ * @brief Creates a listening TCP socket bound to the server port.
+ * 
+ * @return int The socket file descriptor on success, ERROR on failure
+ */
+int tcp_listen_setup();
+
 /**
  * @brief Sets up the TCP listening socket for the server.
  * 
@@ -90,7 +640,8 @@ void server_setup();
 /**
  * @brief Parses command line arguments for server configuration.
  * 
- * Handles -p (port) and -v (verbose) flags.
+ * Handles -p (port), -v (verbose), -t (worker threads), -q (queue depth) and
+ * -w (event loops) flags.
  * 
  * @param argc Argument count
  * @param argv Argument vector
@@ -121,12 +672,18 @@ void usage(const char *prog_name);
 // =============== command_handler.c ===============
 
 /**
- * @brief Validates basic UID and password format from request buffer.
+ * @brief Validates a UDP request "CMD UID credential\n" in one pass.
  * 
- * @param req Request containing buffer with command, UID, and password
- * @return int VALID if format is correct, INVALID if verification fails
+ * The fields sit at fixed offsets, so the UID and the password or session
+ * token are checked in place and NUL-terminated inside the request buffer;
+ * nothing is copied or allocated.
+ * 
+ * @param req Request whose buffer holds the NUL-terminated datagram
+ * @param UID Set to the UID inside the buffer
+ * @param credential Set to the password or session token inside the buffer
+ * @return int VALID if the request is well formed, INVALID otherwise
  */
-int verify_uid_password(Request* req);
+int parse_udp_request(Request* req, char** UID, char** credential);
 
 /**
  * @brief Handles an incoming UDP request.
@@ -193,6 +750,24 @@ void logout_handler(Request* req, char* UID, char* password);
  */
 void unregister_handler(Request* req, char* UID, char* password);
 
+/**
+ * @brief Handles session request: SES UID password
+ * 
+ * Opens a session for a logged in user. Later requests, except LIN and CPS,
+ * may carry the returned token in place of the password.
+ * 
+ * Sends to user:
+ * - RSS OK token - session token (SESSION_TOKEN_LENGTH hex characters)
+ * - RSS NLG - user not logged in
+ * - RSS WRP - wrong password
+ * - RSS ERR - unknown user or malformed password
+ * 
+ * @param req The request structure
+ * @param UID User ID
+ * @param password User password, a token is not accepted
+ */
+void session_handler(Request* req, char* UID, char* password);
+
 /**
  * @brief Handles myevents request: LME UID password
  * 
@@ -201,6 +776,7 @@ void unregister_handler(Request* req, char* UID, char* password);
  * - RME NOK - user has no events
  * - RME NLG - user not logged in
  * - RME WRP - wrong password
+ * - RME TCP - list longer than UDP_REPLY_LIMIT, ask again over TCP
  * 
  * Event states: 0=past, 1=active, 2=sold out, 3=closed
  * 
@@ -210,19 +786,6 @@ void unregister_handler(Request* req, char* UID, char* password);
  */
 void myevents_handler(Request* req, char* UID, char* password);
 
-/**
- * @brief Formats the list of events created by a user.
- * 
- * Scans the user's CREATED directory and builds a response string
- * with each event's EID and current state.
- * 
- * @param UID User ID
- * @param message Buffer to store the formatted response
- * @param message_size Size of the message buffer
- * @return int SUCCESS on success, ERROR on failure
- */
-int format_list_of_user_events(char* UID, char* message, size_t message_size);
-
 /**
  * @brief Handles myreservations request: LMR UID password
  * 
@@ -231,6 +794,7 @@ int format_list_of_user_events(char* UID, char* message, size_t message_size);
  * - RMR NOK - user has no reservations
  * - RMR NLG - user not logged in
  * - RMR WRP - wrong password
+ * - RMR TCP - list longer than UDP_REPLY_LIMIT, ask again over TCP
  * 
  * @param req The request structure
  * @param UID User ID
@@ -280,6 +844,19 @@ void close_event_handler(Request* req);
  */
 void list_events_handler(Request* req);
 
+/**
+ * @brief Handles list changes request: LSD version
+ * 
+ * Sends to user:
+ * - RLD OK version [EID name state event_date]* - events changed after the
+ *   version the client sent, and the version to send next time
+ * - RLD NOK - no events available
+ * - RLD ERR - malformed version
+ * 
+ * @param req The request structure
+ */
+void list_changes_handler(Request* req);
+
 /**
  * @brief Handles show event request: SED EID
  * 
@@ -304,6 +881,31 @@ void show_event_handler(Request* req);
  */
 void change_password_handler(Request* req);
 
+/**
+ * @brief Handles LME and LMR received over TCP.
+ * 
+ * Clients resend these requests over TCP after a "RME TCP" or "RMR TCP"
+ * reply; the full list is then sent on the connection.
+ * 
+ * @param req The request structure
+ * @param command MYEVENTS or MYRESERVATIONS
+ */
+void user_list_handler(Request* req, RequestType command);
+
+/**
+ * @brief Handles keep-alive request: KAL
+ * 
+ * The connection then stays open after each reply and serves the next
+ * request, so clients can pipeline CRE/CLS/LST/SED/RID/CPS requests over
+ * one connection; replies come back in request order.
+ * 
+ * Sends to user:
+ * - RKA OK - connection kept open until the client closes it
+ * 
+ * @param req The request structure
+ */
+void keep_alive_handler(Request* req);
+
 /**
  * @brief Handles reserve seats request: RID UID password EID num_seats
  * 
@@ -387,13 +989,29 @@ int file_exists(const char* filename);
 int remove_directory(const char *path);
 
 /**
- * @brief Finds the first available EID (001-999) by scanning the EVENTS directory.
+ * @brief Builds the free-EID bitmap from the directories in EVENTS/.
+ * 
+ * @return int SUCCESS
+ */
+int load_eid_bitmap();
+
+/**
+ * @brief Claims the lowest free EID (001-999) from the free-EID bitmap.
+ * 
+ * Safe to call from concurrent creators: each EID is handed out once.
  * 
  * @param eid_str Buffer to store the 3-digit EID string (e.g., "001", "042")
  * @return int SUCCESS if an available EID was found, ERROR if all EIDs are taken
  */
 int find_available_eid(char* eid_str);
 
+/**
+ * @brief Returns an EID to the free-EID bitmap.
+ * 
+ * @param eid Event ID to free
+ */
+void release_eid(int eid);
+
 /**
  * @brief Writes event metadata to EVENTS/{EID}/START_{EID}.txt file.
  * 
@@ -409,15 +1027,31 @@ int write_event_start_file(const char* eid, const char* uid, const char* event_n
                            const char* desc_fname, const char* event_attend,
                            const char* event_date);
 
+/**
+ * @brief Formats the current local time as DD-MM-YYYY HH:MM:SS.
+ * 
+ * @param datetime Buffer to store the timestamp
+ * @param size Size of the buffer
+ */
+void current_datetime(char* datetime, size_t size);
+
 /**
  * @brief Writes event end marker to EVENTS/{EID}/END_{EID}.txt.
  * 
  * Creates the file to indicate the event has been closed.
  * 
  * @param eid Event ID (3-digit string, e.g., "001")
+ * @param datetime Closing time (DD-MM-YYYY HH:MM:SS)
  * @return int SUCCESS if file was created successfully, ERROR otherwise
  */
-int write_event_end_file(const char* eid);
+int write_event_end_file(const char* eid, const char* datetime);
+
+/**
+ * @brief Removes a partly written END_{EID}.txt after a failed close.
+ * 
+ * @param eid Event ID (3-digit string, e.g., "001")
+ */
+void remove_event_end_file(const char* eid);
 
 /**
  * @brief Writes event metadata to USERS/{UID}/CREATED/{EID}.txt file.
@@ -437,41 +1071,121 @@ int write_event_information_file(const char* eid, const char* uid, const char* e
                            const char* event_date);
 
 /**
- * @brief Creates or updates RES_{EID}.txt with the reserved seats count.
+ * @brief Undoes a CRE that failed before it was logged.
  * 
- * If the file doesn't exist, creates it with the provided count.
- * If it exists, reads the current value and increments by reserved_seats.
+ * Removes EVENTS/{EID}/ and USERS/{UID}/CREATED/{EID}.txt and returns the
+ * EID to the free-EID bitmap.
+ * 
+ * @param eid Event ID (3-digit string, e.g., "001")
+ * @param uid User ID of the creator (6-digit string)
+ */
+void discard_event_files(const char* eid, const char* uid);
+
+/**
+ * @brief Creates or overwrites RES_{EID}.txt with the reserved seats count.
  * 
  * @param eid Event ID (3-digit string, e.g., "001")
- * @param reserved_seats Number of seats to add to the reservation count
+ * @param reserved_seats Total number of reserved seats
  * @return int SUCCESS if file was created/updated successfully, ERROR otherwise
  */
 int update_reservations_file(const char* eid, int reserved_seats);
 
 /**
- * @brief Creates DESCRIPTION directory and stores the event description file.
+ * @brief Creates DESCRIPTION directory and moves the uploaded description into it.
+ * 
+ * The upload's temp file is renamed into place, so readers never see a
+ * partially written description. The file and the directories holding it
+ * are fsync()ed before returning, so a CRE logged afterwards never replays
+ * without its description.
  * 
  * @param eid Event ID (3-digit string, e.g., "001")
  * @param file_name Name of the description file
- * @param file_size Size of the file in bytes
- * @param file_content Content of the file
+ * @param upload Completed upload holding the file data
  * @return int SUCCESS if directory and file were created, ERROR otherwise
  */
-int write_description_file(const char* eid, const char* file_name, size_t file_size, const char* file_content);
+int write_description_file(const char* eid, const char* file_name, Upload* upload);
+
+/**
+ * @brief Deletes upload temp files left in EVENTS/ by a previous run.
+ * 
+ * @return int SUCCESS
+ */
+int remove_stale_uploads();
 
 /**
- * @brief Writes a reservation record to USERS/{UID}/RESERVED/{EID}.txt.
+ * @brief Writes a reservation record to EVENTS/{EID}/RESERVATIONS/ and
+ * USERS/{UID}/RESERVED/.
+ * 
+ * Both files are named {EID}-{datetime}-{UID}-{sequence}.txt, so reservations
+ * made on one event in the same second never overwrite each other.
  * 
  * @param UID User ID
  * @param EID Event ID
  * @param num_seats Number of seats reserved
+ * @param sequence Event's reserved total after this reservation, unique per event
+ * @param datetime Reservation time (DD-MM-YYYY HH:MM:SS)
  * @return int SUCCESS on success, ERROR on failure
  */
-int write_reservation(char* UID, char* EID, int num_seats);
+int write_reservation(char* UID, char* EID, int num_seats, int sequence, const char* datetime);
+
+/**
+ * @brief Deletes the event and user records written by write_reservation().
+ * 
+ * @param UID User ID
+ * @param EID Event ID
+ * @param sequence Sequence number the records are named after
+ * @param datetime Reservation time the records are named after
+ */
+void remove_reservation(const char* UID, const char* EID, int sequence, const char* datetime);
 
 
 // =============== users_manager.c ===============
 
+/**
+ * @brief Loads every user in USERS/ into the in-memory user table and starts
+ *        the thread that persists user changes.
+ * 
+ * Logins, logouts and password changes update the table and are written to
+ * the USERS/ files asynchronously, in order.
+ * 
+ * @return int SUCCESS on success, ERROR on failure
+ */
+int user_table_setup();
+
+/**
+ * @brief Tells whether the user table is full enough to grow before the
+ *        next registration.
+ * 
+ * @return int TRUE at half load or more, FALSE otherwise
+ */
+int user_table_needs_growth();
+
+/**
+ * @brief Doubles the user table, moving every entry.
+ * 
+ * Must be called with the state lock held exclusively.
+ * 
+ * @return int SUCCESS on success, ERROR if the new table cannot be allocated
+ */
+int user_table_grow();
+
+/**
+ * @brief Blocks until every queued login, logout and password change has
+ *        been written to the USERS/ files.
+ */
+void wait_user_files();
+
+/**
+ * @brief Applies a login, logout or password change to the user's files.
+ * 
+ * Used by the persister thread and by WAL replay.
+ * 
+ * @param kind Kind of change
+ * @param UID User ID
+ * @param password New password for PERSIST_PASSWORD, ignored otherwise
+ */
+void write_user_file(PersistKind kind, const char* UID, const char* password);
+
 /**
  * @brief Checks if a user with the given UID exists.
  * 
@@ -510,7 +1224,7 @@ int create_user(char* UID);
 int remove_user(char* UID);
 
 /**
- * @brief Removes the login marker file for a user (logs them out).
+ * @brief Logs a user out; the login marker file is removed asynchronously.
  * 
  * @param UID User ID
  * @return int SUCCESS on success, ERROR on failure
@@ -518,7 +1232,9 @@ int remove_user(char* UID);
 int erase_login(char* UID);
 
 /**
- * @brief Writes the user's password to their password file.
+ * @brief Changes the user's password; the password file is rewritten asynchronously.
+ * 
+ * The user's session token is revoked, SES must be sent again.
  * 
  * @param UID User ID
  * @param password Password to store
@@ -527,7 +1243,7 @@ int erase_login(char* UID);
 int write_password(char* UID, char* password);
 
 /**
- * @brief Creates the login marker file for a user (logs them in).
+ * @brief Logs a user in; the login marker file is created asynchronously.
  * 
  * @param UID User ID
  * @return int SUCCESS on success, ERROR on failure
@@ -535,7 +1251,7 @@ int write_password(char* UID, char* password);
 int write_login(char* UID);
 
 /**
- * @brief Reads the user's password from their password file.
+ * @brief Reads the user's password from the user table.
  * 
  * @param UID User ID
  * @param password Buffer to store the password
@@ -559,6 +1275,25 @@ int is_logged_in(char* UID);
  */
 int verify_event_file(char* event_file_name);
 
+/**
+ * @brief Adds an event to the in-memory index of events a user created.
+ * 
+ * The index mirrors USERS/{UID}/CREATED, which is read once at startup.
+ * 
+ * @param UID User ID
+ * @param EID Event ID
+ * @return int SUCCESS on success, ERROR if the user or EID is unknown
+ */
+int add_created_event(char* UID, char* EID);
+
+/**
+ * @brief Counts the events a user created, from the in-memory index.
+ * 
+ * @param UID User ID
+ * @return int Number of events, 0 for an unknown user
+ */
+int count_user_events(char* UID);
+
 /**
  * @brief Checks if a user has created any events.
  * 
@@ -568,7 +1303,48 @@ int verify_event_file(char* event_file_name);
 int has_events(char* UID);
 
 /**
- * @brief Checks if a user has made any reservations.
+ * @brief Formats the list of events created by a user.
+ * 
+ * Walks the user's index of created events in EID order and reads each
+ * state from the event table, without touching the filesystem. The buffer
+ * needs room for count_user_events() entries of MY_EVENTS_ENTRY_LENGTH.
+ * 
+ * @param UID User ID
+ * @param message Buffer to store the formatted response
+ * @param message_size Size of the message buffer
+ * @return int SUCCESS on success, ERROR on failure or if the buffer is too small
+ */
+int format_list_of_user_events(char* UID, char* message, size_t message_size);
+
+/**
+ * @brief Records a new reservation in the user's ring of recent reservations.
+ * 
+ * Keeps the last RECENT_RESERVATIONS reservations in memory and rewrites
+ * USERS/{UID}/{UID}reservations.txt with them. The ring is loaded on first
+ * use, from that file or, for older data, from the RESERVED/ directory
+ * sorted by reservation date.
+ * 
+ * @param UID User ID
+ * @param EID Event ID
+ * @param num_seats Seats reserved
+ * @param datetime Reservation time (DD-MM-YYYY HH:MM:SS)
+ * @return int SUCCESS on success, ERROR on failure
+ */
+int add_recent_reservation(char* UID, char* EID, int num_seats, const char* datetime);
+
+/**
+ * @brief Adds a replayed reservation to the user's ring file, unless it is
+ *        already there. Used by WAL replay, before the user table exists.
+ * 
+ * @param UID User ID
+ * @param EID Event ID
+ * @param num_seats Seats reserved
+ * @param datetime Reservation time (DD-MM-YYYY HH:MM:SS)
+ */
+void replay_recent_reservation(char* UID, char* EID, int num_seats, const char* datetime);
+
+/**
+ * @brief Checks if a user has made any reservations, from the reservation ring.
  * 
  * @param UID User ID
  * @return int VALID if user has reservations, INVALID otherwise
@@ -578,10 +1354,13 @@ int has_reservations(char* UID);
 /**
  * @brief Formats the list of user's reservations for the myreservations response.
  * 
+ * Served from the ring of the last RECENT_RESERVATIONS reservations, oldest
+ * first, without scanning the RESERVED/ directory.
+ * 
  * @param UID User ID
  * @param response Buffer to store the formatted response
  * @param response_size Size of the response buffer
- * @return int Number of reservations formatted, or ERROR on failure
+ * @return int Number of reservations formatted, ERROR on failure or if the buffer is too small
  */
 int format_list_of_user_reservations(char* UID, char* response, size_t response_size);
 
@@ -594,13 +1373,149 @@ int format_list_of_user_reservations(char* UID, char* response, size_t response_
  */
 int verify_correct_password(char* UID, char* password);
 
+/**
+ * @brief Opens a session for the user, or reuses the live one.
+ * 
+ * The token expires after SESSION_TIMEOUT_SECONDS without an authenticated
+ * request and is revoked by logout and by a password change.
+ * 
+ * @param UID User ID
+ * @param token Buffer of SESSION_TOKEN_LENGTH + 1 bytes for the token
+ * @return int SUCCESS on success, ERROR for an unknown user or no randomness
+ */
+int open_session(char* UID, char* token);
+
+/**
+ * @brief Verifies a password or a session token for the user.
+ * 
+ * A token is told apart by its length. Either one, when valid, extends the
+ * user's session while it is live; an expired session is never revived.
+ * 
+ * @param UID User ID
+ * @param credential Password or session token
+ * @return int VALID if it matches, INVALID if wrong or expired, ERROR for an unknown user
+ */
+int verify_credentials(char* UID, char* credential);
+
 
 // =============== events_manager.c ===============
 
 /**
- * @brief Checks if event directory exists
+ * @brief Loads every event in EVENTS/ into the in-memory event table.
+ * 
+ * Called once at startup; afterwards the table is kept up to date by
+ * event_table_add(), close_event() and reserve_event_seats().
+ * 
+ * @return int SUCCESS
+ */
+int load_event_table();
+
+/**
+ * @brief Adds a newly created event to the event table.
+ * 
+ * @param EID Event ID
+ * @param UID Creator's UID
+ * @param event_name Event name
+ * @param file_name Description file name
+ * @param total_seats Number of seats
+ * @param event_date Event date (DD-MM-YYYY HH:MM)
+ * @return int SUCCESS on success, ERROR if the EID is out of range
+ */
+int event_table_add(char* EID, char* UID, char* event_name, char* file_name,
+                    int total_seats, char* event_date);
+
+/**
+ * @brief Closes an event that still accepts reservations: writes its END_
+ *        file, logs the close and marks it closed in the event table.
+ * 
+ * Runs under the event's lock, so it cannot race a reservation.
+ * 
+ * @param EID Event ID
+ * @param state Set to the event's state when it is not closed
+ * @return int SUCCESS once closed, INVALID if the event is sold out, closed or
+ *         past, ERROR if it does not exist or the END_ file cannot be written
+ */
+int close_event(char* EID, char* state);
+
+/**
+ * @brief Reserves seats on an event if enough are still available.
+ * 
+ * The availability check, the reservation record files, the RES_ file, the
+ * WAL record and the event table are updated under a per-event lock, so
+ * concurrent reservations on the same event never oversell and reservations
+ * on different events never contend. A failed file write is undone and
+ * nothing is reserved; once SUCCESS is returned the reservation is made.
+ * 
+ * @param UID User ID
+ * @param EID Event ID
+ * @param num_seats Number of seats requested
+ * @param available Set to the seats available before the reservation
+ * @return int SUCCESS if reserved, INVALID if not enough seats are left,
+ *         ERROR on failure
+ */
+int reserve_event_seats(char* UID, char* EID, int num_seats, int* available);
+
+/**
+ * @brief Number of events in the event table.
+ * 
+ * @return int Event count
+ */
+int event_table_count();
+
+/**
+ * @brief Flips every event whose date has passed to PAST.
+ * 
+ * Pops the expired dates off a min-heap; when none has expired it costs one
+ * atomic load and no lock. Listings call it once before reading states.
+ */
+void expire_event_deadlines();
+
+/**
+ * @brief Current state version of the event table.
+ * 
+ * Every create, close, reservation and PAST transition bumps it. An event
+ * whose change got a version up to the returned one already shows that change.
+ * 
+ * @return uint64_t State version, 0 before any event exists
+ */
+uint64_t event_table_version();
+
+/**
+ * @brief Checks if an event changed after a given state version.
+ * 
+ * @param EID Event ID
+ * @param version State version last seen by the client
+ * @return int TRUE if the event exists and changed since, FALSE otherwise
+ */
+int event_changed_since(char* EID, uint64_t version);
+
+/**
+ * @brief Returns the complete RLS OK reply for the current event table.
+ * 
+ * The reply is cached and rebuilt only after a change LST shows (an event
+ * created, closed, sold out or past); a rebuild renders again just the EID
+ * ranges (LIST_SHARD_EVENTS each) that changed. Reservations alone keep it. The returned buffer is immutable and shared between requests.
+ * 
+ * @return SharedBuffer* Reply holding a reference for the caller, NULL on
+ *         allocation failure
+ */
+SharedBuffer* event_list_reply();
+
+/**
+ * @brief Gets the state shown by LST and LME for an event.
+ * 
+ * Reads the state kept up to date by reservations, closes and
+ * expire_event_deadlines(), without parsing any date.
+ * 
+ * @param EID Event ID
+ * @return int CLOSED, PAST, SOLD_OUT or ACCEPTING
+ */
+int get_event_state(char* EID);
+
+/**
+ * @brief Checks if an event exists
  * @param EID Event ID to check
- * @return TRUE if EVENTS/EID directory exists, FALSE otherwise
+ * @return TRUE if the event is in the event table, FALSE otherwise
  */
 int event_exists(char* EID);
 
@@ -630,10 +1545,10 @@ int is_event_creator(char* UID, char* EID);
 int is_event_sold_out(char* EID);
 
 /**
- * @brief Checks if an event's date has passed.
+ * @brief Checks if an event's date has passed, expiring deadlines first.
  * 
  * @param EID Event ID
- * @return int TRUE if event date is in the past, FALSE otherwise
+ * @return int TRUE if the event is PAST, FALSE otherwise (also for closed events)
  */
 int is_event_past(char* EID);
 
@@ -687,17 +1602,5 @@ int read_event_full_details(char* EID, char* UID, char* event_name,
  */
 int get_available_seats(char* EID);
 
-/**
- * @brief Creates a reservation for a user.
- * 
- * Creates records in both the event and user directories.
- * 
- * @param UID User ID
- * @param EID Event ID
- * @param num_seats Number of seats to reserve
- * @return int SUCCESS on success, ERROR on failure
- */
-int make_reservation(char* UID, char* EID, int num_seats);
-
 
 #endif
@@ -20,25 +20,8 @@ int main(int argc, char *argv[]) {
     
     server_setup();
 
-    while(1){
-        if (select_handler() == ERROR) {
-            // Something went wrong
-            continue;
-        }
-
-        // Check for UDP connection
-        if (FD_ISSET(set.udp_socket, &set.temp_fds)) {
-            udp_connection();
-            // One of the threads will handle the request, check handle_task() in threads.c
-        }
-
-        // Check for TCP connection
-        else if (FD_ISSET(set.tcp_socket, &set.temp_fds)) {
-            tcp_connection();
-            // One of the threads will handle the request, check handle_task() in threads.c
-        }
-    }
-
+    // Serves every UDP datagram and TCP client from the epoll loops
+    event_loop_run();
 
     return 0;
 }
\ No newline at end of file
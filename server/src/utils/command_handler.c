@@ -8,32 +8,40 @@
 #include <stdlib.h>
 #include <string.h>
 
-int verify_uid_password(Request* req) {
-    if(!verify_argument_count(req->buffer, 3)) return INVALID;
-
-    char UID[UID_LENGTH + 1];
-    char command[COMMAND_LENGTH + 1];
-    char password[PASSWORD_LENGTH + 1];
-
-    sscanf(req->buffer, "%3s %6s %8s", command, UID, password);
-
-    if (!verify_uid_format(UID)) return INVALID;
-    if (!verify_password_format(password)) return INVALID;
-    
+// Offsets of the fields of a UDP request: "CMD UID credential\n"
+#define UDP_UID_OFFSET (COMMAND_LENGTH + 1)
+#define UDP_CREDENTIAL_OFFSET (UDP_UID_OFFSET + UID_LENGTH + 1)
+
+int parse_udp_request(Request* req, char** UID, char** credential) {
+    char* buffer = req->buffer;
+    if (buffer[COMMAND_LENGTH] != ' ' || buffer[UDP_CREDENTIAL_OFFSET - 1] != ' ') return INVALID;
+    for (int i = UDP_UID_OFFSET; i < UDP_CREDENTIAL_OFFSET - 1; i++)
+        if (!has_class(buffer[i], CLASS_DIGIT)) return INVALID;
+
+    // One pass tells a password (8 alphanumeric) from a token (16 lowercase hex)
+    char* end = buffer + UDP_CREDENTIAL_OFFSET;
+    int hex = TRUE;
+    for (; *end != '\n'; end++) {
+        if (end - buffer == UDP_CREDENTIAL_OFFSET + SESSION_TOKEN_LENGTH ||
+            !has_class(*end, CLASS_ALNUM))
+            return INVALID;
+        if (!has_class(*end, CLASS_HEX)) hex = FALSE;
+    }
+    long length = end - (buffer + UDP_CREDENTIAL_OFFSET);
+    if (end[1] != '\0') return INVALID;
+    if (length != PASSWORD_LENGTH && !(length == SESSION_TOKEN_LENGTH && hex)) return INVALID;
+
+    // The fields become strings where they lie in the receive buffer
+    buffer[UDP_CREDENTIAL_OFFSET - 1] = '\0';
+    *end = '\0';
+    *UID = buffer + UDP_UID_OFFSET;
+    *credential = buffer + UDP_CREDENTIAL_OFFSET;
     return VALID;
 }
 
 void handle_udp_request(Request* req) {
-    char *cursor = req->buffer;
-    
-    // Get 3-letter command
-    char command_buff[COMMAND_LENGTH + 1];
-    if(get_next_arg(&cursor, command_buff) == ERROR){
-        send_udp_response("ERR\n", req);
-        return;
-    }
-
-    RequestType command = identify_command_request(command_buff);
+    // The 3-letter command, matched before the parser splits the buffer
+    RequestType command = identify_command_request(req->buffer);
 
     // If command is UNKNOWN, send ERR response
     if(command == UNKNOWN){
@@ -41,14 +49,10 @@ void handle_udp_request(Request* req) {
         return;
     }
 
-    // Get next arguments: UID and password
-    char uid[UID_LENGTH + 1];
-    char password[PASSWORD_LENGTH + 1];
-    if(get_next_arg(&cursor, uid) == ERROR ||
-       get_next_arg(&cursor, password) == ERROR ||
-       is_end_of_message(&cursor) == FALSE ||
-       !verify_uid_format(uid) ||
-       !verify_password_format(password)) {
+    // UID and password or session token, as slices of the request buffer
+    char* uid;
+    char* password;
+    if(parse_udp_request(req, &uid, &password) == INVALID) {
         char response[16]; 
         const char* cmd_resp = get_command_response_code(command);
         snprintf(response, sizeof(response), "%s ERR\n", cmd_resp);
@@ -56,11 +60,14 @@ void handle_udp_request(Request* req) {
         return;
     }
 
-    char log[BUFFER_SIZE];
-    snprintf(log, sizeof(log),
-     "Handling %s (%s) command, from UID: %s",
-     command_to_str(command), command_buff, uid);
-    server_log(log, &req->client_addr);
+    // Formatting the line costs more than parsing, skip it when nothing is logged
+    if (set.verbose) {
+        char log[BUFFER_SIZE];
+        snprintf(log, sizeof(log),
+         "Handling %s (%.3s) command, from UID: %s",
+         command_to_str(command), req->buffer, uid);
+        server_log(log, &req->client_addr);
+    }
 
     switch (command) {
         case LOGIN:
@@ -78,6 +85,9 @@ void handle_udp_request(Request* req) {
         case MYRESERVATIONS:
             myreservations_handler(req, uid, password);
             break;
+        case SESSION:
+            session_handler(req, uid, password);
+            break;
         default:
             send_udp_response("ERR\n", req);
             break;
@@ -102,6 +112,9 @@ void handle_tcp_request(Request* req) {
         case LIST:
             list_events_handler(req);
             break;
+        case LIST_DELTA:
+            list_changes_handler(req);
+            break;
         case SHOW:
             show_event_handler(req);
             break;
@@ -111,15 +124,26 @@ void handle_tcp_request(Request* req) {
         case CHANGEPASS:
             change_password_handler(req);
             break;
+        case KEEPALIVE:
+            keep_alive_handler(req);
+            break;
+        case MYEVENTS:
+        case MYRESERVATIONS:
+            user_list_handler(req, command);
+            break;
         default:
-            tcp_write(req->client_socket, "ERR\n", strlen("ERR\n"));
+            send_tcp_response("ERR\n", req);
             break;
     }
 }
 
 // ------------ UDP Requests ---------------
 void login_handler(Request* req, char* UID, char* password) {
-    sscanf(req->buffer, "LIN %s %s", UID, password);
+    // A session token only stands in for the password after logging in
+    if (!verify_password_format(password)) {
+        send_udp_response("RLI ERR\n", req);
+        return;
+    }
 
     if (!user_exists(UID)) {
         if (create_new_user(UID, password) == ERROR) {
@@ -161,7 +185,7 @@ void logout_handler(Request* req, char* UID, char* password) {
         return;
     }
 
-    int status = verify_correct_password(UID, password);
+    int status = verify_credentials(UID, password);
 
     // Error verifying password
     if (status == ERROR) {
@@ -188,7 +212,7 @@ void unregister_handler(Request* req, char* UID, char* password) {
         send_udp_response("RUR NOK\n", req);
         return;
     }
-    int status = verify_correct_password(UID, password);
+    int status = verify_credentials(UID, password);
     if(status == ERROR) {
         send_udp_response("RUR ERR\n", req);
         return;
@@ -206,114 +230,126 @@ void unregister_handler(Request* req, char* UID, char* password) {
     send_udp_response("RUR OK\n", req);
 }
 
-void myevents_handler(Request* req, char* UID, char* password) {
+// LIN keeps the reply the protocol fixes ("RLI OK\n", nothing after it), so
+// clients that know nothing of sessions still parse it; the token comes from SES
+void session_handler(Request* req, char* UID, char* password) {
     if(!user_exists(UID)) {
-        send_udp_response("RME ERR\n", req);
+        send_udp_response("RSS ERR\n", req);
         return;
     }
     if(!is_logged_in(UID)) {
-        send_udp_response("RME NLG\n", req);
+        send_udp_response("RSS NLG\n", req);
+        return;
+    }
+    // Only the password opens a session
+    if(!verify_password_format(password)) {
+        send_udp_response("RSS ERR\n", req);
         return;
     }
     int status = verify_correct_password(UID, password);
     if(status == ERROR) {
-        send_udp_response("RME ERR\n", req);
+        send_udp_response("RSS ERR\n", req);
         return;
     }
-
     if(status == INVALID) {
-        send_udp_response("RME WRP\n", req);
+        send_udp_response("RSS WRP\n", req);
         return;
     }
 
-    if(has_events(UID) == FALSE) {
-        send_udp_response("RME NOK\n", req);
+    char token[SESSION_TOKEN_LENGTH + 1];
+    if(open_session(UID, token) == ERROR) {
+        send_udp_response("RSS ERR\n", req);
         return;
     }
+    char response[32];
+    snprintf(response, sizeof(response), "RSS OK %s\n", token);
+    send_udp_response(response, req);
+}
 
-
-    char response[999 * 6 + 10]; // Max 999 events, each with "EID state " (6 chars) + null terminator
-    if(format_list_of_user_events(UID, response, sizeof(response)) == ERROR) {
-        send_udp_response("RME ERR\n", req);
+// A list reply that would not fit one unfragmented datagram is replaced by
+// "<code> TCP", telling the client to ask again over TCP
+static void send_list_response(const char* response, const char* code, Request* req) {
+    if (!req->is_tcp && strlen(response) > UDP_REPLY_LIMIT) {
+        char redirect[16];
+        snprintf(redirect, sizeof(redirect), "%s TCP\n", code);
+        send_udp_response(redirect, req);
         return;
     }
-    send_udp_response(response, req);
-}   
-
-
-int format_list_of_user_events(char* UID, char* message, size_t message_size) {
-    char path[32];
-    snprintf(path, sizeof(path), "USERS/%s/CREATED", UID);
+    send_response(response, req);
+}
 
-    struct dirent **namelist;
-    int n = scandir(path, &namelist, NULL, alphasort);
-    if (n < 0) {
-        perror("scandir");
-        return ERROR;
+void myevents_handler(Request* req, char* UID, char* password) {
+    if(!user_exists(UID)) {
+        send_response("RME ERR\n", req);
+        return;
+    }
+    if(!is_logged_in(UID)) {
+        send_response("RME NLG\n", req);
+        return;
+    }
+    int status = verify_credentials(UID, password);
+    if(status == ERROR) {
+        send_response("RME ERR\n", req);
+        return;
     }
 
-    snprintf(message, message_size, "RME OK");
-
-    for (int i = 0; i < n; i++) {
-        struct dirent *entry = namelist[i];
-        // Skip non-event files
-        if (verify_event_file(entry->d_name) == INVALID) {
-            free(entry);
-            continue;
-        }
-
-        char event_EID[4];
-        strncpy(event_EID, entry->d_name, 3);
-        event_EID[3] = '\0';
-
-        int state;
-        if (is_event_closed(event_EID)) state = CLOSED;
-        else if (is_event_past(event_EID)) state = PAST;
-        else if (is_event_sold_out(event_EID)) state = SOLD_OUT;
-        else state = ACCEPTING;
+    if(status == INVALID) {
+        send_response("RME WRP\n", req);
+        return;
+    }
 
-        char temp[16];
-        snprintf(temp, sizeof(temp), " %s %c", event_EID, state);
-        strncat(message, temp, message_size - strlen(message) - 1);
+    int count = count_user_events(UID);
+    if(count == 0) {
+        send_response("RME NOK\n", req);
+        return;
+    }
 
-        free(entry); // free each dirent allocated by scandir
+    // "RME OK", one entry per owned event, "\n" and the terminator
+    size_t response_size = 6 + (size_t)count * MY_EVENTS_ENTRY_LENGTH + 2;
+    char* response = malloc(response_size);
+    if(response == NULL ||
+       format_list_of_user_events(UID, response, response_size) == ERROR) {
+        free(response);
+        send_response("RME ERR\n", req);
+        return;
     }
-    free(namelist); // free the array itself
-    strncat(message, "\n", message_size - strlen(message) - 1);
-    return SUCCESS;
-}
+    send_list_response(response, "RME", req);
+    free(response);
+}   
+
 
 void myreservations_handler(Request* req, char* UID, char* password) {
     if(!user_exists(UID)) {
-        send_udp_response("RMR ERR\n", req);
+        send_response("RMR ERR\n", req);
         return;
     }
     if(!is_logged_in(UID)) {
-        send_udp_response("RMR NLG\n", req);
+        send_response("RMR NLG\n", req);
         return;
     }
-    int status = verify_correct_password(UID, password);
+    int status = verify_credentials(UID, password);
     if(status == ERROR) {
-        send_udp_response("RMR ERR\n", req);
+        send_response("RMR ERR\n", req);
         return;
     }
     if(status == INVALID) {
-        send_udp_response("RMR WRP\n", req);
+        send_response("RMR WRP\n", req);
         return;
     }
     if(has_reservations(UID) == INVALID) {
-        send_udp_response("RMR NOK\n", req);
+        send_response("RMR NOK\n", req);
         return;
     }
 
-    char response[4096];
+    // "RMR OK", the ring's entries, "\n" and the terminator
+    char response[6 + RECENT_RESERVATIONS * MY_RESERVATIONS_ENTRY_LENGTH + 2];
     int err = format_list_of_user_reservations(UID, response, sizeof(response));
     if (err <= 0) {
-        send_udp_response("RMR ERR\n", req);
+        send_response("RMR ERR\n", req);
         return;
     }
 
-    send_udp_response(response, req);
+    send_list_response(response, "RMR", req);
 } 
 
 
@@ -322,28 +358,48 @@ void myreservations_handler(Request* req, char* UID, char* password) {
 
 
 // ------------- TCP -------------  
-// Reads a field from TCP socket or sends error response (CMD ERR\n) if  there was an error.
-static int read_field_or_error(int fd, char* dst, size_t len, char* code) {
+// Reads a field from the buffered request or sends error response (CMD ERR\n) if there was an error.
+static int read_field_or_error(Request* req, char* dst, size_t len, char* code) {
     char response[16] = {0};
-    if (tcp_read_field(fd, dst, len) == ERROR) {
+    if (tcp_read_field(&req->conn->in, dst, len) == ERROR) {
         snprintf(response, sizeof(response), "%s ERR\n", code);
-        tcp_write(fd, response, strlen(response));
+        send_tcp_response(response, req);
         return ERROR;
     }
     return SUCCESS;
 }
 
-// Helper function to consume remaining file content from socket
-static void consume_file(int fd, size_t file_size) {
-    char buffer[4096];
-    size_t total_read = 0;
-    while (total_read < file_size) {
-        size_t to_read = (file_size - total_read) < sizeof(buffer) ? 
-                       (file_size - total_read) : sizeof(buffer);
-        ssize_t n = read(fd, buffer, to_read);
-        if (n <= 0) break;
-        total_read += n;
+void user_list_handler(Request* req, RequestType command) {
+    char UID[UID_LENGTH + 1];
+    char password[SESSION_TOKEN_LENGTH + 1];
+    char code[COMMAND_LENGTH + 1];
+    snprintf(code, sizeof(code), "%s", get_command_response_code(command));
+
+    // PROTOCOL: LME|LMR <uid> <password>, the UDP request resent after a TCP reply
+    if (read_field_or_error(req, UID, UID_LENGTH, code) != SUCCESS) return;
+    if (read_field_or_error(req, password, SESSION_TOKEN_LENGTH, code) != SUCCESS) return;
+
+    char log[BUFFER_SIZE];
+    snprintf(log, sizeof(log), "Handling %s over TCP, from UID: %s", command_to_str(command), UID);
+    server_log(log, &req->client_addr);
+
+    if (!verify_uid_format(UID) || !verify_credential_format(password)) {
+        char response[16];
+        snprintf(response, sizeof(response), "%s ERR\n", code);
+        send_tcp_response(response, req);
+        return;
     }
+
+    if (command == MYEVENTS) myevents_handler(req, UID, password);
+    else myreservations_handler(req, UID, password);
+}
+
+void keep_alive_handler(Request* req) {
+    server_log("Handling keep-alive (KAL)", &req->client_addr);
+
+    // Replies go out in request order, so pipelined requests need no tagging
+    req->conn->keep_alive = TRUE;
+    send_tcp_response("RKA OK\n", req);
 }
 
 void change_password_handler(Request* req) {
@@ -352,11 +408,11 @@ void change_password_handler(Request* req) {
     char new_password[PASSWORD_LENGTH + 1];
     int status;
 
-    status = read_field_or_error(req->client_socket, UID, UID_LENGTH, "RCP");
+    status = read_field_or_error(req, UID, UID_LENGTH, "RCP");
     if (status != SUCCESS) return;
-    status = read_field_or_error(req->client_socket, old_password, PASSWORD_LENGTH, "RCP");
+    status = read_field_or_error(req, old_password, PASSWORD_LENGTH, "RCP");
     if (status != SUCCESS) return;
-    status = read_field_or_error(req->client_socket, new_password, PASSWORD_LENGTH, "RCP");
+    status = read_field_or_error(req, new_password, PASSWORD_LENGTH, "RCP");
     if (status != SUCCESS) return;
 
     char log[BUFFER_SIZE];
@@ -366,34 +422,34 @@ void change_password_handler(Request* req) {
     server_log(log, &req->client_addr);
     
     if(!user_exists(UID)) {
-        tcp_write(req->client_socket, "RCP NID\n", strlen("RCP NID\n"));
+        send_tcp_response("RCP NID\n", req);
         return;
     }
     if(!is_logged_in(UID)) {
-        tcp_write(req->client_socket, "RCP NLG\n", strlen("RCP NLG\n"));
+        send_tcp_response("RCP NLG\n", req);
         return;
     }
     status = verify_correct_password(UID, old_password);
     if(status == ERROR) {
-        tcp_write(req->client_socket, "RCP ERR\n", strlen("RCP ERR\n"));
+        send_tcp_response("RCP ERR\n", req);
         return;
     }
     if(status == INVALID) {
-        tcp_write(req->client_socket, "RCP NOK\n", strlen("RCP NOK\n"));
+        send_tcp_response("RCP NOK\n", req);
         return;
     }
 
     // Proceed to change password
     if(write_password(UID, new_password) == ERROR) {
-        tcp_write(req->client_socket, "RCP ERR\n", strlen("RCP ERR\n"));
+        send_tcp_response("RCP ERR\n", req);
         return;
     }
-    tcp_write(req->client_socket, "RCP OK\n", strlen("RCP OK\n"));
+    send_tcp_response("RCP OK\n", req);
 }
 
 void create_event_handler(Request* req) {
     char UID[UID_LENGTH + 1];
-    char password[PASSWORD_LENGTH + 1];
+    char password[SESSION_TOKEN_LENGTH + 1];
     char event_name[MAX_EVENT_NAME + 1];
     char event_date[EVENT_DATE_LENGTH + 1];
     char seat_count[SEAT_COUNT_LENGTH + 1]; // max 999, so 3 digits + null
@@ -401,51 +457,45 @@ void create_event_handler(Request* req) {
 
     char file_name[FILE_NAME_LENGTH + 1];
     char file_size_str[FILE_SIZE_LENGTH + 1]; // max 8 digits for file size (10MB = 10000000)
-    size_t file_size;
-    char* file_content = NULL;
 
     char protocol[4] = "RCE";
 
-    int fd = req->client_socket;
-
     // PROTOCOL: CRE <uid> <password> <event_name> <event_date> <seat_count> 
     // <file_name> <file_size> <file_content>
     int field_status;
-    field_status = read_field_or_error(fd, UID, UID_LENGTH, protocol);
+    field_status = read_field_or_error(req, UID, UID_LENGTH, protocol);
     if (field_status == ERROR) return;
 
-    field_status = read_field_or_error(fd, password, PASSWORD_LENGTH, protocol);
+    field_status = read_field_or_error(req, password, SESSION_TOKEN_LENGTH, protocol);
     if (field_status == ERROR) return;
 
-    field_status = read_field_or_error(fd, event_name, MAX_EVENT_NAME, protocol);
+    field_status = read_field_or_error(req, event_name, MAX_EVENT_NAME, protocol);
     if (field_status == ERROR) return;
 
     // Read event_date (16 chars: DD-MM-YYYY HH:MM)
     // Date has a space in it, so we need to read date and time separately
     char date_part[11]; // DD-MM-YYYY
     char time_part[6];  // HH:MM
-    field_status = read_field_or_error(fd, date_part, 10, protocol);
+    field_status = read_field_or_error(req, date_part, 10, protocol);
     if (field_status == ERROR) return;
 
-    field_status = read_field_or_error(fd, time_part, 5, protocol);
+    field_status = read_field_or_error(req, time_part, 5, protocol);
     if (field_status == ERROR) return;
 
     snprintf(event_date, EVENT_DATE_LENGTH + 1, "%s %s", date_part, time_part);
 
     // Read seat_count (max 3 digits)
-    field_status = read_field_or_error(fd, seat_count, 3, protocol);
+    field_status = read_field_or_error(req, seat_count, 3, protocol);
     if (field_status == ERROR) return;
 
-    field_status = read_field_or_error(fd, file_name, FILE_NAME_LENGTH, protocol);
+    field_status = read_field_or_error(req, file_name, FILE_NAME_LENGTH, protocol);
     if (field_status == ERROR) return;
 
-    field_status = read_field_or_error(fd, file_size_str, FILE_SIZE_LENGTH, protocol);
+    field_status = read_field_or_error(req, file_size_str, FILE_SIZE_LENGTH, protocol);
     if (field_status == ERROR) return;
 
     if (!verify_file_size(file_size_str)) {
-        tcp_write(fd, "RCE ERR\n", 8);
-        file_size = (size_t)atol(file_size_str);
-        consume_file(fd, file_size);
+        send_tcp_response("RCE ERR\n", req);
         return;
     }
 
@@ -456,116 +506,86 @@ void create_event_handler(Request* req) {
     
     // Validate all fields
     if (!verify_uid_format(UID) ||
-        !verify_password_format(password) ||
+        !verify_credential_format(password) ||
         !verify_event_name_format(event_name) ||
         !verify_event_date_format(event_date) ||
         !verify_seat_count(seat_count) ||
         !verify_file_name_format(file_name)) {
-        tcp_write(fd, "RCE ERR\n", 8);
-        file_size = (size_t)atol(file_size_str);
-        consume_file(fd, file_size);
+        send_tcp_response("RCE ERR\n", req);
         return;
     }
     if(!user_exists(UID)) {
-        tcp_write(fd, "RCE NOK\n", 8);
-        file_size = (size_t)atol(file_size_str);
-        consume_file(fd, file_size);
+        send_tcp_response("RCE NOK\n", req);
         return;
     }
     if (!is_logged_in(UID)) {
-        tcp_write(fd, "RCE NLG\n", 8);
-        file_size = (size_t)atol(file_size_str);
-        consume_file(fd, file_size);
+        send_tcp_response("RCE NLG\n", req);
         return;
     }
 
-    if (!verify_correct_password(UID, password)) {
-        tcp_write(fd, "RCE WRP\n", 8);
-        file_size = (size_t)atol(file_size_str);
-        consume_file(fd, file_size);
+    if (verify_credentials(UID, password) != VALID) {
+        send_tcp_response("RCE WRP\n", req);
         return;
     }
   
 
-    // Allocate buffer for file content
-    file_size = (size_t)atol(file_size_str);
-    file_content = (char*)malloc(file_size + 1);
-    if (file_content == NULL) {
-        tcp_write(fd, "RCE NOK\n", 8);
+    // The event loop streamed the file to a temp file before dispatching the request
+    if (req->conn->upload.fd < 0) {
+        send_tcp_response("RCE ERR\n", req);
         return;
     }
 
-    // Read file content (exactly file_size bytes)
-    size_t total_read = 0;
-    while (total_read < file_size) {
-        ssize_t n = read(fd, file_content + total_read, file_size - total_read);
-        if (n <= 0) {
-            free(file_content);
-            tcp_write(fd, "RCE ERR\n", 8);
-            return;
-        }
-        total_read += n;
-    }
-    file_content[file_size] = '\0';
-
-
     if (find_available_eid(EID) == ERROR) {
-        tcp_write(fd, "RCE NOK\n", 8);
+        send_tcp_response("RCE NOK\n", req);
         return;
     }
 
     if (create_eid_dir(atoi(EID)) == ERROR) {
-        tcp_write(fd, "RCE NOK\n", 8);
-        return;
-    }
-
-    if (write_event_start_file(EID, UID, event_name, file_name, seat_count,
-                               event_date) == ERROR) {
-        tcp_write(fd, "RCE NOK\n", 8);
+        release_eid(atoi(EID));
+        send_tcp_response("RCE NOK\n", req);
         return;
     }
 
-    if (write_event_information_file(EID, UID, event_name, file_name, seat_count,
-                               event_date) == ERROR) {
-        tcp_write(fd, "RCE NOK\n", 8);
+    // Replay recreates everything but the description, which must be durable
+    // before the record that announces the event. The record goes last: an
+    // event the client is told was not created must not come back on replay.
+    if (write_description_file(EID, file_name, &req->conn->upload) == ERROR ||
+        write_event_start_file(EID, UID, event_name, file_name, seat_count,
+                               event_date) == ERROR ||
+        write_event_information_file(EID, UID, event_name, file_name, seat_count,
+                                     event_date) == ERROR ||
+        update_reservations_file(EID, 0) == ERROR) {
+        discard_event_files(EID, UID);
+        send_tcp_response("RCE NOK\n", req);
         return;
     }
+    wal_log_create(EID, UID, event_name, file_name, seat_count, event_date);
 
-    if (update_reservations_file(EID, 0) == ERROR) {
-        tcp_write(fd, "RCE NOK\n", 8);
-        return;
-    }
+    event_table_add(EID, UID, event_name, file_name, atoi(seat_count), event_date);
+    add_created_event(UID, EID);
 
-    if (write_description_file(EID, file_name, file_size, file_content) == ERROR) {
-        tcp_write(fd, "RCE NOK\n", 8);
-        return;
-    }
-    
-    free(file_content);
 
     // Send success response with EID
     char response[16];
     snprintf(response, sizeof(response), "RCE OK %s\n", EID);
-    tcp_write(fd, response, strlen(response));
+    send_tcp_response(response, req);
 }
 
 void close_event_handler(Request* req) {
     char UID[UID_LENGTH + 1];
-    char password[PASSWORD_LENGTH + 1];
+    char password[SESSION_TOKEN_LENGTH + 1];
     char EID[EID_LENGTH + 1];
 
-    int fd = req->client_socket;
-
     char protocol[4] = "RCL";
 
     // PROTOCOL: CLS <uid> <password> <eid>
-    int status = read_field_or_error(fd, UID, UID_LENGTH, protocol);
+    int status = read_field_or_error(req, UID, UID_LENGTH, protocol);
     if (status == ERROR || status == EOM) return;
 
-    status = read_field_or_error(fd, password, PASSWORD_LENGTH, protocol);
+    status = read_field_or_error(req, password, SESSION_TOKEN_LENGTH, protocol);
     if (status == ERROR || status == EOM) return;
 
-    status = read_field_or_error(fd, EID, MAX_EVENT_NAME, protocol);
+    status = read_field_or_error(req, EID, MAX_EVENT_NAME, protocol);
     if (status == ERROR) return;
 
     char log[BUFFER_SIZE];
@@ -575,111 +595,139 @@ void close_event_handler(Request* req) {
 
     // Validate all fields
     if (!verify_uid_format(UID) ||
-        !verify_password_format(password) ||
+        !verify_credential_format(password) ||
         !verify_eid_format(EID)) {
-        tcp_write(fd, "RCE ERR\n", 8);
+        send_tcp_response("RCE ERR\n", req);
         return;
     }
 
     if (!is_logged_in(UID)) {
-        tcp_write(fd, "RCL NLG\n", 8);
+        send_tcp_response("RCL NLG\n", req);
         return;
     }
 
-    if (!verify_correct_password(UID, password) || !user_exists(UID)) {
-        tcp_write(fd, "RCL NOK\n", 8);
+    if (!user_exists(UID) || verify_credentials(UID, password) != VALID) {
+        send_tcp_response("RCL NOK\n", req);
         return;
     }
 
     if (!event_exists(EID)) {
-        tcp_write(fd, "RCL NOE\n", 8);
+        send_tcp_response("RCL NOE\n", req);
         return;
     }
 
     if (!is_event_creator(UID, EID)) {
-        tcp_write(fd, "RCL EOW\n", 8);
+        send_tcp_response("RCL EOW\n", req);
         return;
     }
 
     if (is_event_sold_out(EID)) {
-        tcp_write(fd, "RCL SLD\n", 8);
+        send_tcp_response("RCL SLD\n", req);
         return;
     }
 
     if (is_event_closed(EID)) {
-        tcp_write(fd, "RCL CLO\n", 8);
+        send_tcp_response("RCL CLO\n", req);
         return;
     }
 
     if (is_event_past(EID)) {
-        tcp_write(fd, "RCL PST\n", 8);
+        send_tcp_response("RCL PST\n", req);
         return;
     }
 
-    if (write_event_end_file(EID) == ERROR) {
-        tcp_write(fd, "RCL ERR\n", 8);
-        return;
+    // A reservation or the clock may still change the state before the close
+    char state;
+    switch (close_event(EID, &state)) {
+        case SUCCESS:
+            send_tcp_response("RCL OK\n", req);
+            break;
+        case INVALID:
+            send_tcp_response(state == SOLD_OUT ? "RCL SLD\n" :
+                              state == CLOSED ? "RCL CLO\n" : "RCL PST\n", req);
+            break;
+        default:
+            send_tcp_response("RCL ERR\n", req);
+            break;
     }
-
-    tcp_write(fd, "RCL OK\n", 7); 
 }
 
 void list_events_handler(Request* req) {
-    int fd = req->client_socket;
     
     char log[BUFFER_SIZE];
     snprintf(log, sizeof(log),
      "Handling list event (LST)");
     server_log(log, &req->client_addr);
 
-    if (is_dir_empty("EVENTS")) {
-        tcp_write(fd, "RLS NOK\n", 7);   
+    if (event_table_count() == 0) {
+        send_tcp_response("RLS NOK\n", req);   
         return;
     }
-    
-    // Send initial OK response
-    tcp_write(fd, "RLS OK ", 7);
+
+    // PROTOCOLO: RLS OK [<EID name state event_date> ]*, pre-rendered and
+    // shared by every LST until an event changes
+    SharedBuffer* reply = event_list_reply();
+    if (reply == NULL) {
+        send_tcp_response("RLS ERR\n", req);
+        return;
+    }
+    send_tcp_shared(req, reply);
+    shared_buffer_release(reply);
+}
+
+void list_changes_handler(Request* req) {
+    char version_str[LIST_VERSION_LENGTH + 1];
+
+    // PROTOCOL: LSD <version>
+    if (read_field_or_error(req, version_str, LIST_VERSION_LENGTH, "RLD") != SUCCESS) return;
+
+    char log[BUFFER_SIZE];
+    snprintf(log, sizeof(log), "Handling list changes (LSD) since version %s", version_str);
+    server_log(log, &req->client_addr);
+
+    if (version_str[0] == '\0' || !is_number(version_str)) {
+        send_tcp_response("RLD ERR\n", req);
+        return;
+    }
+    uint64_t since = strtoull(version_str, NULL, 10);
+
+    if (event_table_count() == 0) {
+        send_tcp_response("RLD NOK\n", req);
+        return;
+    }
+
+    // Changes made while the table is scanned may be sent now and again
+    // next time, but none up to the returned version can be missed
+    expire_event_deadlines();
+    uint64_t version = event_table_version();
+    char header[BUFFER_SIZE];
+    snprintf(header, sizeof(header), "RLD OK %llu", (unsigned long long)version);
+    send_tcp_response(header, req);
 
     char event_EID[EID_LENGTH + 1];
     char event_name[MAX_EVENT_NAME + 1];
     char event_date[EVENT_DATE_LENGTH + 1];
-    int state = ' ';
-
-    // Loop from 001 to 999
-    for (int eid = 1; eid <= 999; eid++) {
+    for (int eid = 1; eid <= MAX_EVENTS; eid++) {
         snprintf(event_EID, EID_LENGTH + 1, "%03d", eid);
-        
-        // Check if event exists
-        if (!event_exists(event_EID)) continue;
-
-        // Read event details
+        if (!event_changed_since(event_EID, since)) continue;
         if (get_list_event_info(event_EID, event_name, event_date) == ERROR) continue;
 
-        // Determine event state
-        if (is_event_closed(event_EID)) state = CLOSED;
-        if (is_event_past(event_EID)) state = PAST;
-        else if (is_event_sold_out(event_EID)) state = SOLD_OUT;
-        else state = ACCEPTING;
-
-        // Append event details to response
-        // PROTOCOLO: <EID name state event_date>
+        // PROTOCOLO: <EID name state event_date>, same entries as RLS
         char event_entry[256];
-        snprintf(event_entry, sizeof(event_entry), "%s %s %c %s ",
-                 event_EID, event_name, state, event_date);
-
-        tcp_write(fd, event_entry, strlen(event_entry));
+        snprintf(event_entry, sizeof(event_entry), " %s %s %c %s",
+                 event_EID, event_name, get_event_state(event_EID), event_date);
+        send_tcp_response(event_entry, req);
     }
 
-    tcp_write(fd, "\n", 1);
+    send_tcp_response("\n", req);
 }
 
 void show_event_handler(Request* req) {
     char EID[EID_LENGTH + 1];
 
-    int fd = req->client_socket;
     char protocol[4] = "RSE";
 
-    int status = read_field_or_error(fd, EID, EID_LENGTH, protocol);
+    int status = read_field_or_error(req, EID, EID_LENGTH, protocol);
     if (status == ERROR) return;
 
     char log[BUFFER_SIZE];
@@ -689,12 +737,12 @@ void show_event_handler(Request* req) {
 
     // Validate EID
     if (!verify_eid_format(EID)) {
-        tcp_write(fd, "RSE NOK\n", 8);
+        send_tcp_response("RSE NOK\n", req);
         return;
     }
 
     if (!event_exists(EID)) {
-        tcp_write(fd, "RSE NOK\n", 8);
+        send_tcp_response("RSE NOK\n", req);
         return;
     }
 
@@ -702,14 +750,14 @@ void show_event_handler(Request* req) {
     char file_name[FILE_NAME_LENGTH + 1];
     long file_size;
     if (format_event_details(EID, response, sizeof(response), file_name, &file_size) == ERROR) {
-        tcp_write(fd, "RSE NOK\n", 8);
+        send_tcp_response("RSE NOK\n", req);
         return;
     }
 
     char description_path[128];
     snprintf(description_path, sizeof(description_path), "EVENTS/%s/DESCRIPTION/%s", EID, file_name);
-    tcp_write(fd, response, strlen(response));
-    tcp_send_file(fd, description_path);
+    send_tcp_response(response, req);
+    send_tcp_file(description_path, req);
 }
 
 int format_event_details(char* EID, char* message, size_t message_size, char* file_name, long* file_size) {
@@ -751,19 +799,17 @@ int format_event_details(char* EID, char* message, size_t message_size, char* fi
 
 void reserve_seats_handler(Request* req) {
     char UID[UID_LENGTH + 1];
-    char password[PASSWORD_LENGTH + 1];
+    char password[SESSION_TOKEN_LENGTH + 1];
     char EID[EID_LENGTH + 1];
     char seat_count[SEAT_COUNT_LENGTH + 1]; // max 3 digits
 
-    int fd = req->client_socket;
-
     char protocol[4] = "RRI";
 
     // PROTOCOL: RES <uid> <password> <eid> <num_seats>
-    if(read_field_or_error(fd, UID, UID_LENGTH, protocol) != SUCCESS ||
-       read_field_or_error(fd, password, PASSWORD_LENGTH, protocol) != SUCCESS ||
-       read_field_or_error(fd, EID, EID_LENGTH, protocol) != SUCCESS ||
-       read_field_or_error(fd, seat_count, SEAT_COUNT_LENGTH, protocol) != SUCCESS) return;
+    if(read_field_or_error(req, UID, UID_LENGTH, protocol) != SUCCESS ||
+       read_field_or_error(req, password, SESSION_TOKEN_LENGTH, protocol) != SUCCESS ||
+       read_field_or_error(req, EID, EID_LENGTH, protocol) != SUCCESS ||
+       read_field_or_error(req, seat_count, SEAT_COUNT_LENGTH, protocol) != SUCCESS) return;
     
 
     char log[BUFFER_SIZE];
@@ -774,68 +820,57 @@ void reserve_seats_handler(Request* req) {
 
     // Validate all fields
     if (!verify_uid_format(UID) ||
-        !verify_password_format(password) ||
+        !verify_credential_format(password) ||
         !verify_eid_format(EID) ||
         !verify_reserved_seats(seat_count, "999")) {
-        tcp_write(fd, "RRI ERR\n", 8);
+        send_tcp_response("RRI ERR\n", req);
         return;
     }
 
     if (!is_logged_in(UID)) {
-        tcp_write(fd, "RRI NLG\n", 8);
+        send_tcp_response("RRI NLG\n", req);
         return;
     }
 
-    if (!verify_correct_password(UID, password) || !user_exists(UID)) {
-        tcp_write(fd, "RRI WRP\n", 8);
+    if (!user_exists(UID) || verify_credentials(UID, password) != VALID) {
+        send_tcp_response("RRI WRP\n", req);
         return;
     }
 
     if (!event_exists(EID)) {
-        tcp_write(fd, "RRI NOK\n", 8);
+        send_tcp_response("RRI NOK\n", req);
         return;
     }
 
     if (is_event_closed(EID)) {
-        tcp_write(fd, "RRI CLS\n", 8);
+        send_tcp_response("RRI CLS\n", req);
         return;
     }
 
     if (is_event_sold_out(EID)) {
-        tcp_write(fd, "RRI SLD\n", 8);
+        send_tcp_response("RRI SLD\n", req);
         return;
     }
 
     if (is_event_past(EID)) {
-        tcp_write(fd, "RRI PST\n", 8);
+        send_tcp_response("RRI PST\n", req);
         return;
     }
-    int available_seats = get_available_seats(EID);
-    if(available_seats == ERROR) {
-        tcp_write(fd, "RRI ERR\n", 8);
+    // Decide and apply atomically, other reservations may run concurrently
+    int available_seats;
+    int status = reserve_event_seats(UID, EID, atoi(seat_count), &available_seats);
+    if (status == ERROR) {
+        send_tcp_response("RRI ERR\n", req);
         return;
     }
-
-    int requested_seats = atoi(seat_count);
-    if (requested_seats > available_seats) {
+    if (status == INVALID) {
         char response[BUFFER_SIZE];
         snprintf(response, sizeof(response), "RRI REJ %d\n", available_seats);
-        tcp_write(fd, response, strlen(response));
-        return;
-    }
-
-    if (update_reservations_file(EID, requested_seats) == ERROR) {
-        tcp_write(fd, "RRI ERR\n", 8);
-        return;
-    }
-
-    // Create reservation record files
-    if (make_reservation(UID, EID, requested_seats) == ERROR) {
-        tcp_write(fd, "RRI ERR\n", 8);
+        send_tcp_response(response, req);
         return;
     }
 
-    tcp_write(fd, "RRI ACC\n", 8);
+    send_tcp_response("RRI ACC\n", req);
 }
 
     
\ No newline at end of file
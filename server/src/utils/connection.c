@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include "../include/globals.h"
 #include "../../include/utils.h"
 #include "../../common/verifications.h"
@@ -6,8 +7,14 @@ void parse_arguments(int argc, char *argv[]) {
     int opt;
     set.port = DEFAULT_PORT;
     set.verbose = 0;
+    set.n_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (set.n_workers < 1) set.n_workers = 1;
+    if (set.n_workers > MAX_WORKERS) set.n_workers = MAX_WORKERS;
+    set.queue_size = DEFAULT_QUEUE_SIZE;
+    set.n_loops = 1;
+    set.use_uring = 0;
 
-    while ((opt = getopt(argc, argv, "-p:-v")) != -1) {
+    while ((opt = getopt(argc, argv, "-p:-vt:q:w:u")) != -1) {
         switch (opt) {
             case 'p':
                 if(!is_valid_port(optarg)) {
@@ -20,6 +27,30 @@ void parse_arguments(int argc, char *argv[]) {
                 set.verbose = 1;
                 printf("Verbose mode enabled\n");
                 break;
+            case 't':
+                if (!is_number(optarg) || atoi(optarg) > MAX_WORKERS) {
+                    fprintf(stderr, "Error: Invalid number of worker threads (0-%d)\n", MAX_WORKERS);
+                    exit(EXIT_FAILURE);
+                }
+                set.n_workers = atoi(optarg);
+                break;
+            case 'q':
+                if (!is_number(optarg) || atoi(optarg) < 1 || atoi(optarg) > MAX_QUEUE_SIZE) {
+                    fprintf(stderr, "Error: Invalid queue depth (1-%d)\n", MAX_QUEUE_SIZE);
+                    exit(EXIT_FAILURE);
+                }
+                set.queue_size = atoi(optarg);
+                break;
+            case 'w':
+                if (!is_number(optarg) || atoi(optarg) < 1 || atoi(optarg) > MAX_LOOPS) {
+                    fprintf(stderr, "Error: Invalid number of event loops (1-%d)\n", MAX_LOOPS);
+                    exit(EXIT_FAILURE);
+                }
+                set.n_loops = atoi(optarg);
+                break;
+            case 'u':
+                set.use_uring = 1;
+                break;
             default:
                 usage(argv[0]);
                 exit(EXIT_FAILURE);
@@ -36,6 +67,17 @@ int socket_setup(int flag){
         return ERROR;
     }
 
+    // The server closes client sockets first, so allow rebinding over TIME_WAIT
+    int reuse = 1;
+    setsockopt(sck, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    // Every event loop binds its own socket, the kernel spreads clients over them
+    if (set.n_loops > 1 &&
+        setsockopt(sck, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+        perror("SO_REUSEPORT failed");
+        close(sck);
+        return ERROR;
+    }
+
     memset(&hints, 0, sizeof(hints));
     hints.ai_family = AF_INET; // IPv4
     hints.ai_socktype = flag; // type of socket
@@ -67,18 +109,24 @@ int udp_setup(){
     return 0;
 }
 
+int tcp_listen_setup(){
+    int sck = socket_setup(SOCK_STREAM);
+    if (sck == ERROR) return ERROR;
+
+    if (listen(sck, MAX_TCP_CLIENTS) != 0) {
+        perror("Listen failed");
+        close(sck);
+        return ERROR;
+    }
+    return sck;
+}
+
 int tcp_setup(){
-    set.tcp_socket = socket_setup(SOCK_STREAM);
+    set.tcp_socket = tcp_listen_setup();
     if(set.tcp_socket == ERROR){
         fprintf(stderr, "Failed to set up TCP socket\n");
         exit(EXIT_FAILURE);
     }
-
-    if (listen(set.tcp_socket, MAX_TCP_CLIENTS) != 0) {
-        perror("Listen failed");
-        close(set.tcp_socket);
-        return ERROR;
-    }
     return SUCCESS;
 }
 
@@ -89,8 +137,23 @@ void server_setup(){
         exit(EXIT_FAILURE);
     }
 
-    set.timeout = (struct timeval){.tv_sec = 10, .tv_usec = 0};
-    FD_ZERO(&set.read_fds);
-    FD_SET(set.udp_socket, &set.read_fds);
-    FD_SET(set.tcp_socket, &set.read_fds);
+    remove_stale_uploads();
+    if (wal_setup() == ERROR) {
+        close(set.udp_socket);
+        close(set.tcp_socket);
+        exit(EXIT_FAILURE);
+    }
+    load_event_table();
+    load_eid_bitmap();
+    if (user_table_setup() == ERROR) {
+        close(set.udp_socket);
+        close(set.tcp_socket);
+        exit(EXIT_FAILURE);
+    }
+
+    if (event_loop_setup() == ERROR || thread_pool_setup() == ERROR) {
+        close(set.udp_socket);
+        close(set.tcp_socket);
+        exit(EXIT_FAILURE);
+    }
 }
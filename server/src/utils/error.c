@@ -18,4 +18,8 @@ void usage(const char *prog_name) {
     fprintf(stderr, "Usage: %s [-n server_ip] [-p server_port]\n", prog_name);
     fprintf(stderr, "  -p server_port  Specify the server port number\n");
     fprintf(stderr, "  -v              Enable verbose mode\n");
+    fprintf(stderr, "  -t workers      Number of worker threads (default: one per core, 0 = inline)\n");
+    fprintf(stderr, "  -q depth        Request queue depth (default: %d)\n", DEFAULT_QUEUE_SIZE);
+    fprintf(stderr, "  -w loops        Number of event loops on SO_REUSEPORT sockets (default: 1)\n");
+    fprintf(stderr, "  -u              Use the io_uring engine instead of epoll\n");
 }
\ No newline at end of file
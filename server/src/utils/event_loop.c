@@ -0,0 +1,718 @@
+#define _GNU_SOURCE
+#include "../../include/utils.h"
+#include "../../include/globals.h"
+#include "../../common/verifications.h"
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+
+#define CONN_EVENTS (EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET)
+
+// Epoll and ring user data for the listening sockets (and wake_fd) is the
+// address of the loop's field, client sockets carry their Connection*
+static EventLoop loops[MAX_LOOPS];
+
+// Slow-client pressure, reported with every timeout in verbose mode
+static _Atomic unsigned long timeouts_total;
+static _Atomic unsigned long closes_total;
+
+static const uint64_t timeout_ms[] = {
+    [TIMEOUT_HEADER] = HEADER_TIMEOUT_MS,
+    [TIMEOUT_BODY] = BODY_TIMEOUT_MS,
+    [TIMEOUT_WRITE] = WRITE_TIMEOUT_MS,
+    [TIMEOUT_IDLE] = IDLE_TIMEOUT_MS,
+};
+static const char* timeout_names[] = {
+    [TIMEOUT_HEADER] = "header",
+    [TIMEOUT_BODY] = "body",
+    [TIMEOUT_WRITE] = "write",
+    [TIMEOUT_IDLE] = "idle",
+};
+
+static Connection* connection_new(EventLoop* loop, int fd, struct sockaddr_in* client_addr,
+                                  socklen_t addr_len) {
+    Connection* conn = calloc(1, sizeof(Connection));
+    if (conn == NULL) return NULL;
+    conn->fd = fd;
+    conn->loop = loop;
+    conn->client_addr = *client_addr;
+    conn->addr_len = addr_len;
+    conn->state = CONN_READING;
+    conn->upload.fd = -1;
+    conn->upload.use_splice = TRUE;
+    conn->upload.pipe_fds[0] = conn->upload.pipe_fds[1] = -1;
+    if (read_buffer_init(&conn->in, fd, CONN_READ_CHUNK) == ERROR) {
+        free(conn);
+        return NULL;
+    }
+    return conn;
+}
+
+static void connection_free(Connection* conn) {
+    close(conn->fd);
+    free_tcp_output(conn);
+    upload_discard(&conn->upload);
+    read_buffer_free(&conn->in);
+    free(conn->bounce);
+    free(conn);
+}
+
+static void connection_close(Connection* conn) {
+    EventLoop* loop = conn->loop;
+    timer_cancel(&loop->timers, &conn->timer);
+    atomic_fetch_add(&closes_total, 1);
+    if (loop->ring.fd < 0) {
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+        connection_free(conn);
+        return;
+    }
+
+    // The kernel may still be filling or sending the connection's buffers,
+    // they are freed with the last completion
+    if (conn->ring_op != RING_IDLE) {
+        shutdown(conn->fd, SHUT_RDWR);
+        ring_cancel(&loop->ring, conn);
+        conn->state = CONN_CLOSED;
+        return;
+    }
+    connection_free(conn);
+}
+
+// Replaces the connection's deadline, O(1) in the loop's timer wheel
+static void connection_deadline(Connection* conn, TimeoutKind kind) {
+    conn->timeout = kind;
+    if (kind == TIMEOUT_NONE) timer_cancel(&conn->loop->timers, &conn->timer);
+    else timer_arm(&conn->loop->timers, &conn->timer, timeout_ms[kind]);
+}
+
+static void connection_timeout(TimerNode* timer) {
+    Connection* conn = (Connection*)((char*)timer - offsetof(Connection, timer));
+    unsigned long timeouts = atomic_fetch_add(&timeouts_total, 1) + 1;
+
+    char log[BUFFER_SIZE];
+    snprintf(log, sizeof(log), "TCP %s timeout, closing (%lu timeouts, %lu closes)",
+             timeout_names[conn->timeout], timeouts, atomic_load(&closes_total) + 1);
+    server_log(log, &conn->client_addr);
+    connection_close(conn);
+}
+
+// Picks the deadline of a connection that is still receiving its request
+static void reading_deadline(Connection* conn, size_t upload_left) {
+    size_t length = read_buffer_length(&conn->in);
+
+    if (conn->upload.fd >= 0) {
+        // The body deadline restarts whenever file data arrives
+        if (conn->timeout != TIMEOUT_BODY || conn->upload.left != upload_left)
+            connection_deadline(conn, TIMEOUT_BODY);
+    } else if (conn->timeout == TIMEOUT_NONE) {
+        // Back from a keep-alive reply
+        connection_deadline(conn, length > 0 ? TIMEOUT_HEADER : TIMEOUT_IDLE);
+    } else if (conn->timeout == TIMEOUT_IDLE && length > 0) {
+        // The header deadline runs from the first byte and is never extended
+        connection_deadline(conn, TIMEOUT_HEADER);
+    }
+}
+
+// Parses a CRE header: CRE UID password name date time attendance Fname Fsize.
+// Returns TRUE with the header length and file size once the header is complete,
+// FALSE while it is still arriving and ERROR if it is malformed.
+static int parse_create_header(const char* data, size_t length,
+                               size_t* header_len, size_t* file_size) {
+    const int header_spaces = 9;
+    int spaces = 0;
+    size_t size_start = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        char c = data[i];
+        if (c == EOM && spaces < header_spaces) return ERROR;
+        if (c != ' ') continue;
+        spaces++;
+        if (spaces == header_spaces - 1) size_start = i + 1;
+        if (spaces == header_spaces) {
+            char size_str[FILE_SIZE_LENGTH + 1];
+            size_t size_len = i - size_start;
+            if (size_len == 0 || size_len > FILE_SIZE_LENGTH) return ERROR;
+            memcpy(size_str, data + size_start, size_len);
+            size_str[size_len] = '\0';
+            if (!verify_file_size(size_str)) return ERROR;
+            *header_len = i + 1;
+            *file_size = (size_t)atol(size_str);
+            return TRUE;
+        }
+    }
+    return length > MAX_REQUEST_HEADER ? ERROR : FALSE;
+}
+
+void upload_discard(Upload* upload) {
+    if (upload->fd >= 0) close(upload->fd);
+    if (upload->path[0] != '\0') unlink(upload->path);
+    if (upload->pipe_fds[0] >= 0) {
+        close(upload->pipe_fds[0]);
+        close(upload->pipe_fds[1]);
+    }
+    upload->fd = -1;
+    upload->path[0] = '\0';
+    upload->pipe_fds[0] = upload->pipe_fds[1] = -1;
+}
+
+// Once a CRE header is buffered, moves the file data out of the input buffer
+// into a temp file so the rest of the upload never has to be held in memory
+static int upload_begin(Connection* conn) {
+    Upload* upload = &conn->upload;
+    char* data = read_buffer_peek(&conn->in);
+    size_t length = read_buffer_length(&conn->in);
+    size_t header_len, file_size;
+
+    if (upload->fd >= 0 || length < COMMAND_LENGTH) return SUCCESS;
+    if (memcmp(data, "CRE", COMMAND_LENGTH) != 0) return SUCCESS;
+    if (parse_create_header(data, length, &header_len, &file_size) != TRUE) return SUCCESS;
+
+    if (mkdir("EVENTS", 0700) == -1 && errno != EEXIST) return ERROR;
+    snprintf(upload->path, sizeof(upload->path), UPLOAD_TEMPLATE);
+    upload->fd = mkstemp(upload->path);
+    if (upload->fd < 0) {
+        upload->path[0] = '\0';
+        return ERROR;
+    }
+    upload->header_len = header_len;
+
+    // File bytes that arrived together with the header
+    size_t buffered = length - header_len;
+    if (buffered > file_size) buffered = file_size;
+    if (buffered > 0 && tcp_write(upload->fd, data + header_len, buffered) == ERROR) return ERROR;
+    read_buffer_drop(&conn->in, header_len, buffered);
+    upload->left = file_size - buffered;
+    return SUCCESS;
+}
+
+// Moves the next part of the upload from the socket into the temp file.
+// Returns bytes stored, 0 on peer close, -1 on error (errno is kept).
+static ssize_t upload_receive(Connection* conn) {
+    Upload* upload = &conn->upload;
+    size_t wanted = upload->left < CONN_SPLICE_CHUNK ? upload->left : CONN_SPLICE_CHUNK;
+
+    if (upload->use_splice && upload->pipe_fds[0] < 0 && pipe(upload->pipe_fds) < 0)
+        upload->use_splice = FALSE;
+
+    if (upload->use_splice) {
+        ssize_t n = splice(conn->fd, NULL, upload->pipe_fds[1], NULL, wanted,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n < 0 && errno == EINVAL) {
+            upload->use_splice = FALSE;
+        } else {
+            if (n <= 0) return n;
+            // The pipe must be emptied before the next socket splice
+            for (ssize_t moved = 0; moved < n; ) {
+                ssize_t m = splice(upload->pipe_fds[0], NULL, upload->fd, NULL, n - moved,
+                                   SPLICE_F_MOVE);
+                if (m <= 0) {
+                    if (m == 0) errno = EIO;
+                    return -1;
+                }
+                moved += m;
+            }
+            upload->left -= n;
+            return n;
+        }
+    }
+
+    char buffer[CONN_OUT_CHUNK];
+    if (wanted > sizeof(buffer)) wanted = sizeof(buffer);
+    ssize_t n = read(conn->fd, buffer, wanted);
+    if (n <= 0) return n;
+    if (tcp_write(upload->fd, buffer, n) == ERROR) {
+        errno = EIO;
+        return -1;
+    }
+    upload->left -= n;
+    return n;
+}
+
+// Reads everything the kernel has for this client, streaming CRE file data to disk.
+// Returns SUCCESS if the socket would block, EOM on peer close, ERROR on failure.
+static int connection_fill(Connection* conn) {
+    while (1) {
+        ssize_t n;
+        if (conn->upload.fd >= 0 && conn->upload.left > 0) {
+            n = upload_receive(conn);
+        } else {
+            n = read_buffer_fill(&conn->in);
+            if (n > 0 && upload_begin(conn) == ERROR) return ERROR;
+        }
+
+        if (n > 0) continue;
+        if (n == 0) return EOM;
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return SUCCESS;
+        return ERROR;
+    }
+}
+
+static int request_ready(Connection* conn) {
+    const char* data = read_buffer_peek(&conn->in);
+    size_t length = read_buffer_length(&conn->in);
+    if (length < COMMAND_LENGTH) return FALSE;
+
+    // A CRE is complete once its file is on disk and the closing newline arrived.
+    // Malformed headers are reported as complete so the handler answers ERR.
+    if (memcmp(data, "CRE", COMMAND_LENGTH) == 0) {
+        if (conn->upload.fd >= 0)
+            return conn->upload.left == 0 && length > conn->upload.header_len;
+        size_t header_len, file_size;
+        return parse_create_header(data, length, &header_len, &file_size) == ERROR;
+    }
+
+    if (memchr(data, EOM, length) != NULL) return TRUE;
+    return length > MAX_REQUEST_HEADER;
+}
+
+// Length of the complete request at the front of the buffer, 0 if its end is unknown
+static size_t request_length(Connection* conn) {
+    const char* data = read_buffer_peek(&conn->in);
+    size_t length = read_buffer_length(&conn->in);
+
+    // CRE file data is already out of the buffer, only its closing newline is left
+    if (conn->upload.fd >= 0) return conn->upload.header_len + 1;
+    if (memcmp(data, "CRE", COMMAND_LENGTH) == 0) return 0;
+
+    const char* end = memchr(data, EOM, length);
+    return end != NULL ? (size_t)(end - data) + 1 : 0;
+}
+
+void serve_tcp_request(Request* req) {
+    Connection* conn = req->conn;
+
+    // Read only the 3-letter command using the helper that handles delimiters
+    if (tcp_read_field(&conn->in, req->buffer, COMMAND_LENGTH) == ERROR) {
+        server_log("TCP Read failed or connection closed", &conn->client_addr);
+        send_tcp_response("ERR\n", req);
+        return;
+    }
+    handle_tcp_request(req);
+}
+
+void connection_resume(Connection* conn) {
+    EventLoop* loop = conn->loop;
+
+    // Only the loop thread changes the state of a connection it watches: a
+    // worker switching it to writing could race an event the loop already
+    // holds for it. Queue the connection and wake the loop instead.
+    pthread_mutex_lock(&loop->resume_lock);
+    conn->next_resumed = loop->resumed;
+    loop->resumed = conn;
+    pthread_mutex_unlock(&loop->resume_lock);
+    uint64_t one = 1;
+    if (write(loop->wake_fd, &one, sizeof(one)) < 0)
+        server_log("Event loop wake-up failed", &conn->client_addr);
+}
+
+static void ring_receive(Connection* conn);
+static void connection_event(Connection* conn, uint32_t events);
+
+// Acts on the request bytes received so far (status as from connection_fill):
+// hands a complete request to a worker, otherwise waits for more
+static void connection_read(Connection* conn, int status, size_t upload_left) {
+    if (status == ERROR) {
+        connection_close(conn);
+        return;
+    }
+    if (status == EOM) conn->peer_closed = TRUE;
+
+    if (!request_ready(conn)) {
+        if (conn->peer_closed) {
+            connection_close(conn);
+            return;
+        }
+        reading_deadline(conn, upload_left);
+        if (conn->loop->ring.fd >= 0) ring_receive(conn);
+        return;
+    }
+
+    // Remember where the next pipelined request starts; without a known
+    // end of this one the connection cannot be reused
+    size_t request_len = request_length(conn);
+    if (request_len == 0) conn->keep_alive = FALSE;
+    else conn->pending = read_buffer_length(&conn->in) - request_len;
+
+    // Handlers may take as long as they need
+    connection_deadline(conn, TIMEOUT_NONE);
+    conn->state = CONN_PROCESSING;
+    Request req = {.client_socket = conn->fd, .client_addr = conn->client_addr,
+                   .addr_len = conn->addr_len, .is_tcp = 1, .conn = conn};
+    dispatch_request(&req);
+}
+
+// Acts on the progress of the reply (flushed as from flush_tcp_output)
+static void connection_flushed(Connection* conn, int flushed) {
+    if (flushed == FALSE) {
+        // Each step made progress, give the rest a new deadline
+        connection_deadline(conn, TIMEOUT_WRITE);
+        return;
+    }
+
+    // One request per connection unless the client sent KAL: close once the
+    // whole reply is out, or if the handler read into the next request
+    size_t length = read_buffer_length(&conn->in);
+    if (flushed == ERROR || !conn->keep_alive || length < conn->pending) {
+        connection_close(conn);
+        return;
+    }
+
+    // Forget the answered request, the next one may be buffered already
+    read_buffer_take(&conn->in, length - conn->pending);
+    upload_discard(&conn->upload);
+    connection_deadline(conn, TIMEOUT_NONE);
+    conn->state = CONN_READING;
+    if (conn->loop->ring.fd >= 0) connection_read(conn, SUCCESS, conn->upload.left);
+    else connection_event(conn, EPOLLIN);
+}
+
+// Epoll engine: reads or writes until the socket blocks
+static void connection_event(Connection* conn, uint32_t events) {
+    ConnectionState state = conn->state;
+
+    // A worker owns the connection until it hands it back
+    if (state == CONN_PROCESSING) return;
+
+    if (state == CONN_READING) {
+        size_t upload_left = conn->upload.left;
+        connection_read(conn, connection_fill(conn), upload_left);
+        return;
+    }
+
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        connection_close(conn);
+        return;
+    }
+    connection_flushed(conn, flush_tcp_output(conn));
+}
+
+// io_uring engine: queues the next receive of a connection reading its request,
+// CRE file data lands in the bounce buffer on its way to the upload file
+static void ring_receive(Connection* conn) {
+    Ring* ring = &conn->loop->ring;
+    Upload* upload = &conn->upload;
+
+    if (upload->fd >= 0 && upload->left > 0) {
+        if (conn->bounce == NULL && (conn->bounce = malloc(CONN_SPLICE_CHUNK)) == NULL) {
+            connection_close(conn);
+            return;
+        }
+        size_t wanted = upload->left < CONN_SPLICE_CHUNK ? upload->left : CONN_SPLICE_CHUNK;
+        ring_recv(ring, conn->fd, conn->bounce, wanted, conn);
+        conn->ring_op = RING_RECV_FILE;
+        return;
+    }
+
+    size_t space;
+    char* free_space = read_buffer_space(&conn->in, &space);
+    if (free_space == NULL) {
+        connection_close(conn);
+        return;
+    }
+    ring_recv(ring, conn->fd, free_space, space, conn);
+    conn->ring_op = RING_RECV;
+}
+
+// Queues the write of the received CRE file data still in the bounce buffer
+static void ring_upload_write(Connection* conn) {
+    ring_write(&conn->loop->ring, conn->upload.fd, conn->bounce + conn->bounce_done,
+               conn->bounce_len - conn->bounce_done, -1, conn);
+    conn->ring_op = RING_WRITE_FILE;
+}
+
+// Completion of a receive, or of the write of received file data
+static void ring_received(Connection* conn, RingOp op, int res) {
+    size_t upload_left = conn->upload.left;
+    if (res < 0 || (res == 0 && op == RING_WRITE_FILE)) {
+        connection_close(conn);
+        return;
+    }
+    if (res == 0) {
+        connection_read(conn, EOM, upload_left);
+        return;
+    }
+
+    if (op == RING_RECV_FILE) {
+        conn->bounce_len = res;
+        conn->bounce_done = 0;
+        ring_upload_write(conn);
+    } else if (op == RING_WRITE_FILE) {
+        conn->bounce_done += res;
+        if (conn->bounce_done < conn->bounce_len) {
+            ring_upload_write(conn);
+            return;
+        }
+        conn->upload.left -= conn->bounce_len;
+        connection_read(conn, SUCCESS, upload_left);
+    } else {
+        read_buffer_commit(&conn->in, res);
+        connection_read(conn, upload_begin(conn) == ERROR ? ERROR : SUCCESS, upload_left);
+    }
+}
+
+// Completion of the one operation a connection had in flight. A closed
+// connection is freed now that the kernel is done with its buffers.
+static void ring_completed(Connection* conn, int res) {
+    RingOp op = conn->ring_op;
+    conn->ring_op = RING_IDLE;
+    if (conn->state == CONN_CLOSED) {
+        connection_free(conn);
+        return;
+    }
+
+    // Interrupted before anything moved, queue the same step again
+    if (res == -EAGAIN || res == -EINTR) {
+        if (conn->state == CONN_READING && op != RING_WRITE_FILE) ring_receive(conn);
+        else if (conn->state == CONN_READING) ring_upload_write(conn);
+        else connection_flushed(conn, submit_tcp_output(conn));
+        return;
+    }
+
+    if (op == RING_SEND || op == RING_READ_FILE) {
+        if (complete_tcp_output(conn, op, res) == ERROR) connection_close(conn);
+        else connection_flushed(conn, submit_tcp_output(conn));
+    } else {
+        ring_received(conn, op, res);
+    }
+}
+
+// Starts serving a freshly accepted, non-blocking client socket
+static void connection_open(EventLoop* loop, int client_socket, struct sockaddr_in* client_addr,
+                            socklen_t addr_len) {
+    Connection* conn = connection_new(loop, client_socket, client_addr, addr_len);
+    if (conn == NULL) {
+        server_log("TCP Connection setup failed", client_addr);
+        close(client_socket);
+        return;
+    }
+    connection_deadline(conn, TIMEOUT_HEADER);
+
+    // The ring receives straight into the connection, nothing to watch
+    if (loop->ring.fd >= 0) {
+        ring_receive(conn);
+        return;
+    }
+
+    struct epoll_event ev = {.events = CONN_EVENTS, .data.ptr = conn};
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, client_socket, &ev) < 0) {
+        server_log("TCP Connection registration failed", client_addr);
+        timer_cancel(&loop->timers, &conn->timer);
+        read_buffer_free(&conn->in);
+        free(conn);
+        close(client_socket);
+        return;
+    }
+
+    // The request may already be waiting in the socket
+    connection_event(conn, EPOLLIN);
+}
+
+static void accept_connections(EventLoop* loop) {
+    while (1) {
+        struct sockaddr_in client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+
+        // Accept the incoming TCP connection, creating a new socket for this client
+        int client_socket = accept(loop->tcp_socket, (struct sockaddr *)&client_addr, &addr_len);
+        if (client_socket < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) server_log("TCP Accept failed", NULL);
+            return;
+        }
+
+        if (set_nonblocking(client_socket) == ERROR) {
+            server_log("TCP Connection setup failed", &client_addr);
+            close(client_socket);
+            continue;
+        }
+        connection_open(loop, client_socket, &client_addr, addr_len);
+    }
+}
+
+// Multishot accept completion: res is the new client socket, already non-blocking
+static void ring_accepted(EventLoop* loop, int res, unsigned flags) {
+    if (res >= 0) {
+        // The peer address is only needed for the verbose log
+        struct sockaddr_in client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+        memset(&client_addr, 0, sizeof(client_addr));
+        if (set.verbose) getpeername(res, (struct sockaddr*)&client_addr, &addr_len);
+        connection_open(loop, res, &client_addr, addr_len);
+    } else if (res == -EINVAL) {
+        // The request itself is refused, queueing it again would spin forever
+        server_log("TCP Accept rejected by io_uring, no longer accepting", NULL);
+        return;
+    } else {
+        server_log("TCP Accept failed", NULL);
+    }
+    if (!(flags & IORING_CQE_F_MORE)) ring_accept(&loop->ring, loop->tcp_socket, &loop->tcp_socket);
+}
+
+// Picks up the connections workers handed back and flushes their replies.
+// Edge-triggered readiness that fired while a worker held a connection is
+// not lost: flushing writes until the socket blocks, and a keep-alive
+// connection reads until it blocks before waiting for the next edge.
+static void loop_resumed(EventLoop* loop) {
+    uint64_t count;
+    if (read(loop->wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        server_log("Event loop wake-up failed", NULL);
+
+    pthread_mutex_lock(&loop->resume_lock);
+    Connection* conn = loop->resumed;
+    loop->resumed = NULL;
+    pthread_mutex_unlock(&loop->resume_lock);
+
+    while (conn != NULL) {
+        Connection* next = conn->next_resumed;
+        conn->state = CONN_WRITING;
+        if (loop->ring.fd >= 0) connection_flushed(conn, submit_tcp_output(conn));
+        else connection_event(conn, EPOLLOUT);
+        conn = next;
+    }
+}
+
+// Sets up the ring and the listening requests. Returns ERROR when io_uring
+// is unavailable so the caller can fall back to epoll.
+static int ring_loop_setup(EventLoop* loop) {
+    if (ring_setup(&loop->ring, RING_ENTRIES) == ERROR) return ERROR;
+
+    ring_accept(&loop->ring, loop->tcp_socket, &loop->tcp_socket);
+    ring_poll(&loop->ring, loop->udp_socket, EPOLLIN | EPOLLET, &loop->udp_socket);
+    ring_poll(&loop->ring, loop->wake_fd, EPOLLIN | EPOLLET, &loop->wake_fd);
+    return SUCCESS;
+}
+
+static int loop_setup(EventLoop* loop, int udp_socket, int tcp_socket) {
+    loop->udp_socket = udp_socket;
+    loop->tcp_socket = tcp_socket;
+    loop->epoll_fd = -1;
+    loop->ring.fd = -1;
+    loop->wake_fd = -1;
+    timer_wheel_init(&loop->timers);
+
+    if (set_nonblocking(udp_socket) == ERROR || set_nonblocking(tcp_socket) == ERROR) {
+        perror("fcntl failed");
+        return ERROR;
+    }
+
+    // Workers hand connections back through the resumed list and this eventfd
+    loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->wake_fd < 0) {
+        perror("eventfd failed");
+        return ERROR;
+    }
+    pthread_mutex_init(&loop->resume_lock, NULL);
+    loop->resumed = NULL;
+
+    if (set.use_uring) {
+        if (ring_loop_setup(loop) == SUCCESS) return SUCCESS;
+        perror("io_uring unavailable, falling back to epoll");
+    }
+
+    loop->epoll_fd = epoll_create1(0);
+    if (loop->epoll_fd < 0) {
+        perror("epoll_create1 failed");
+        return ERROR;
+    }
+
+    struct epoll_event udp_ev = {.events = EPOLLIN | EPOLLET, .data.ptr = &loop->udp_socket};
+    struct epoll_event tcp_ev = {.events = EPOLLIN | EPOLLET, .data.ptr = &loop->tcp_socket};
+    struct epoll_event wake_ev = {.events = EPOLLIN | EPOLLET, .data.ptr = &loop->wake_fd};
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, udp_socket, &udp_ev) < 0 ||
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, tcp_socket, &tcp_ev) < 0 ||
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &wake_ev) < 0) {
+        perror("epoll_ctl failed");
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+int event_loop_setup() {
+    if (loop_setup(&loops[0], set.udp_socket, set.tcp_socket) == ERROR) return ERROR;
+
+    // Extra loops bind their own sockets to the same port (SO_REUSEPORT)
+    for (int i = 1; i < set.n_loops; i++) {
+        int udp_socket = socket_setup(SOCK_DGRAM);
+        int tcp_socket = tcp_listen_setup();
+        if (udp_socket == ERROR || tcp_socket == ERROR) {
+            fprintf(stderr, "Failed to set up sockets for event loop %d\n", i);
+            return ERROR;
+        }
+        if (loop_setup(&loops[i], udp_socket, tcp_socket) == ERROR) return ERROR;
+    }
+    return SUCCESS;
+}
+
+// io_uring engine: every SQE queued while handling one batch of completions
+// is submitted by the io_uring_enter() that waits for the next batch
+static void ring_loop_main(EventLoop* loop) {
+    while (1) {
+        if (ring_wait(&loop->ring, timer_wheel_timeout(&loop->timers)) == ERROR)
+            server_log("io_uring wait error", NULL);
+
+        void* tag;
+        int res;
+        unsigned flags;
+        while (ring_reap(&loop->ring, &tag, &res, &flags)) {
+            if (tag == NULL) continue;     // poll removals
+            if (tag == &loop->tcp_socket) {
+                ring_accepted(loop, res, flags);
+            } else if (tag == &loop->udp_socket || tag == &loop->wake_fd) {
+                int* fd = tag;
+                if (fd == &loop->udp_socket) udp_connection(loop->udp_socket);
+                else loop_resumed(loop);
+                if (!(flags & IORING_CQE_F_MORE))
+                    ring_poll(&loop->ring, *fd, EPOLLIN | EPOLLET, fd);
+            } else {
+                ring_completed((Connection*)tag, res);
+            }
+        }
+        timer_wheel_advance(&loop->timers, connection_timeout);
+    }
+}
+
+static void* loop_main(void* arg) {
+    EventLoop* loop = arg;
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+
+    if (loop->ring.fd >= 0) {
+        ring_loop_main(loop);
+        return NULL;
+    }
+
+    while (1) {
+        // Wake up every tick while deadlines are pending
+        int n = epoll_wait(loop->epoll_fd, events, MAX_EPOLL_EVENTS,
+                           timer_wheel_timeout(&loop->timers));
+        if (n < 0) {
+            if (errno != EINTR) server_log("Epoll wait error", NULL);
+            n = 0;
+        }
+
+        // Resumed connections are picked up after the batch: flushing one may
+        // close and free it while a later entry of the batch still points to it
+        int woken = FALSE;
+        for (int i = 0; i < n; i++) {
+            void* tag = events[i].data.ptr;
+            if (tag == &loop->udp_socket) udp_connection(loop->udp_socket);
+            else if (tag == &loop->tcp_socket) accept_connections(loop);
+            else if (tag == &loop->wake_fd) woken = TRUE;
+            else connection_event((Connection*)tag, events[i].events);
+        }
+        if (woken) loop_resumed(loop);
+        timer_wheel_advance(&loop->timers, connection_timeout);
+    }
+    return NULL;
+}
+
+void event_loop_run() {
+    for (int i = 1; i < set.n_loops; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, loop_main, &loops[i]) != 0) {
+            perror("Failed to create event loop thread");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(thread);
+    }
+    loop_main(&loops[0]);
+}
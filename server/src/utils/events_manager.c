@@ -1,162 +1,466 @@
 #include "../../include/globals.h"
 #include "../../include/utils.h"
+#include "../../common/verifications.h"
 #include <time.h>
 
-
-int event_exists(char* EID){
-    char EID_dirname[20];
-    sprintf(EID_dirname, "EVENTS/%s", EID);
-    return dir_exists(EID_dirname);
+// In-memory copy of every event, indexed by EID and kept in sync with the
+// START_/RES_/END_ files, so lookups never touch the disk
+static EventRecord events[MAX_EVENTS + 1];
+static _Atomic int event_count;
+
+// One lock per EID: reservations and the close of an event are serialized,
+// different events never contend
+static pthread_mutex_t event_locks[MAX_EVENTS + 1];
+
+// Bumped by every change to an event, LSD replies with the events changed
+// since the version the client last saw. Bumps and snapshots take the lock,
+// so no version up to a snapshot can still be on its way to its record.
+static uint64_t state_version;
+// Bumped only by changes LST shows (creation, closing, sold out, past), so
+// plain reservations leave the cached RLS reply valid
+static uint64_t listing_version;
+static uint64_t shard_versions[LIST_SHARDS];   // last listing change in each EID range
+static pthread_mutex_t version_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// RLS reply shared by every LST until the next change. Only the EID ranges
+// that changed are rendered again when it is rebuilt.
+static ListShard list_shards[LIST_SHARDS];
+static SharedBuffer* list_reply;
+static uint64_t list_reply_version;
+static pthread_mutex_t list_reply_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Min-heap of the dates of events that are not PAST yet. The first request
+// that observes the clock beyond the earliest date flips those events to PAST.
+#define NO_DEADLINE ((time_t)INT64_MAX)
+static EventDeadline deadlines[MAX_EVENTS];
+static int deadline_count;
+static pthread_mutex_t deadline_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic time_t next_deadline = NO_DEADLINE;   // checked without the lock
+
+// Returns the record of an existing event, NULL if the EID is unused or invalid
+static EventRecord* find_event(const char* EID) {
+    if (EID == NULL || strlen(EID) != EID_LENGTH) return NULL;
+    int eid = atoi(EID);
+    if (eid < 1 || eid > MAX_EVENTS || !events[eid].exists) return NULL;
+    return &events[eid];
 }
 
-int is_event_closed(char* EID){
-    char state_path[30];
-    sprintf(state_path, "EVENTS/%s/END_%s.txt", EID, EID);
-    return file_exists(state_path) ? TRUE : FALSE;
+// Converts "DD-MM-YYYY HH:MM" to local time, -1 if malformed
+static time_t event_date_to_time(const char* event_date) {
+    int day, month, year, hour, minute;
+    if (sscanf(event_date, "%d-%d-%d %d:%d", &day, &month, &year, &hour, &minute) != 5)
+        return -1;
+
+    struct tm event_tm = {0};
+    event_tm.tm_year = year - 1900;  // years since 1900
+    event_tm.tm_mon = month - 1;     // months are 0-11
+    event_tm.tm_mday = day;
+    event_tm.tm_hour = hour;
+    event_tm.tm_min = minute;
+    event_tm.tm_sec = 0;
+    event_tm.tm_isdst = -1;           // auto-detect DST
+    return mktime(&event_tm);
 }
 
-int verify_event_dir(char* event_dir_name){
-    // Check length is exactly 3
-    if (strlen(event_dir_name) != 3) return INVALID;
+// Stamps a record with a new state version, after its change is applied;
+// listed is TRUE when the change shows in LST
+static void event_touch(EventRecord* record, int listed) {
+    int shard = (int)(record - events) / LIST_SHARD_EVENTS;
+    pthread_mutex_lock(&version_lock);
+    record->version = ++state_version;
+    if (listed) shard_versions[shard] = ++listing_version;
+    pthread_mutex_unlock(&version_lock);
+}
 
-    // Check all 3 characters are digits
-    for (int i = 0; i < 3; i++) {
-        if (!isdigit((unsigned char)event_dir_name[i]))
-            return INVALID;
+static void deadline_push(int eid, time_t deadline) {
+    pthread_mutex_lock(&deadline_lock);
+    if (deadline_count < MAX_EVENTS) {
+        int i = deadline_count++;
+        while (i > 0 && deadlines[(i - 1) / 2].deadline > deadline) {
+            deadlines[i] = deadlines[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        deadlines[i] = (EventDeadline){.deadline = deadline, .eid = eid};
+        atomic_store(&next_deadline, deadlines[0].deadline);
     }
-    
-    // Check range 001-999
-    int eid = atoi(event_dir_name);
-    if (eid < 1 || eid > 999) return INVALID;
-    
-    return VALID;
+    pthread_mutex_unlock(&deadline_lock);
 }
 
-int is_event_creator(char* UID, char* EID){
-    char event_info_fname[30];
-    sprintf(event_info_fname, "EVENTS/%s/START_%s.txt", EID, EID);
+// Removes the earliest deadline, called with deadline_lock held
+static EventDeadline deadline_pop() {
+    EventDeadline top = deadlines[0];
+    EventDeadline last = deadlines[--deadline_count];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= deadline_count) break;
+        if (child + 1 < deadline_count && deadlines[child + 1].deadline < deadlines[child].deadline)
+            child++;
+        if (last.deadline <= deadlines[child].deadline) break;
+        deadlines[i] = deadlines[child];
+        i = child;
+    }
+    if (deadline_count > 0) deadlines[i] = last;
+    return top;
+}
 
-    FILE* fp = fopen(event_info_fname, "r");
-    if (fp == NULL) {
-        return FALSE;
+// Sets the state of a loaded or created event and schedules its PAST transition
+static void event_state_init(int eid, EventRecord* record, int closed) {
+    if (closed) {
+        record->state = CLOSED;
+    } else if (record->start_time != -1 && record->start_time < time(NULL)) {
+        record->state = PAST;
+    } else {
+        record->state = record->reserved_seats >= record->total_seats ? SOLD_OUT : ACCEPTING;
+        if (record->start_time != -1) deadline_push(eid, record->start_time);
     }
+}
+
+static void fill_event_record(EventRecord* record, const char* UID, const char* event_name,
+                              const char* file_name, int total_seats, const char* event_date) {
+    snprintf(record->uid, sizeof(record->uid), "%s", UID);
+    snprintf(record->name, sizeof(record->name), "%s", event_name);
+    snprintf(record->file_name, sizeof(record->file_name), "%s", file_name);
+    snprintf(record->date, sizeof(record->date), "%s", event_date);
+    record->total_seats = total_seats;
+    record->start_time = event_date_to_time(event_date);
+}
 
-    char file_UID[UID_LENGTH + 1];
-    if (fscanf(fp, "%6s", file_UID) != 1) {
+// Reads one event's files into its record, leaves it empty if they are unusable
+static void load_event_record(int eid) {
+    char path[64];
+    char UID[UID_LENGTH + 1], event_name[MAX_EVENT_NAME + 1];
+    char file_name[FILE_NAME_LENGTH + 1], seats[SEAT_COUNT_LENGTH + 1];
+    char date_str[11], time_str[6];
+
+    // Format: UID event_name filename seat_count date time
+    snprintf(path, sizeof(path), "EVENTS/%03d/START_%03d.txt", eid, eid);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) return;
+    int fields = fscanf(fp, "%6s %10s %24s %3s %10s %5s", UID, event_name, file_name,
+                        seats, date_str, time_str);
+    fclose(fp);
+    if (fields != 6) return;
+
+    EventRecord* record = &events[eid];
+    char event_date[EVENT_DATE_LENGTH + 1];
+    snprintf(event_date, sizeof(event_date), "%s %s", date_str, time_str);
+    fill_event_record(record, UID, event_name, file_name, atoi(seats), event_date);
+
+    snprintf(path, sizeof(path), "EVENTS/%03d/RES_%03d.txt", eid, eid);
+    fp = fopen(path, "r");
+    if (fp != NULL) {
+        int reserved;
+        if (fscanf(fp, "%d", &reserved) == 1) record->reserved_seats = reserved;
         fclose(fp);
-        return FALSE;
     }
-    fclose(fp);
 
-    if (strcmp(UID, file_UID) == 0) {
-        return TRUE;
-    }
-    return FALSE;
+    snprintf(path, sizeof(path), "EVENTS/%03d/END_%03d.txt", eid, eid);
+    event_state_init(eid, record, file_exists(path));
+    record->exists = TRUE;
+    event_touch(record, TRUE);
+    event_count++;
 }
 
-int is_event_sold_out(char* EID){
-    char event_info_fname[30];
-    char reservations_fname[30];
-    sprintf(event_info_fname, "EVENTS/%s/START_%s.txt", EID, EID);
-    sprintf(reservations_fname, "EVENTS/%s/RES_%s.txt", EID, EID);
-
-    FILE* fp = fopen(event_info_fname, "r");
-    if (fp == NULL) {
-        return FALSE;
+int load_event_table() {
+    memset(events, 0, sizeof(events));
+    event_count = 0;
+    deadline_count = 0;
+    atomic_store(&next_deadline, NO_DEADLINE);
+    for (int eid = 0; eid <= MAX_EVENTS; eid++) pthread_mutex_init(&event_locks[eid], NULL);
+
+    DIR* dir = opendir("EVENTS");
+    if (dir == NULL) return SUCCESS;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (verify_event_dir(entry->d_name) == VALID) load_event_record(atoi(entry->d_name));
     }
+    closedir(dir);
+    return SUCCESS;
+}
 
-    char seat_count_str[SEAT_COUNT_LENGTH + 1];
-    if (fscanf(fp, "%*s %*s %*s %3s", seat_count_str) != 1) {
-        fclose(fp);
-        return FALSE;
+int event_table_add(char* EID, char* UID, char* event_name, char* file_name,
+                    int total_seats, char* event_date) {
+    int eid = atoi(EID);
+    if (eid < 1 || eid > MAX_EVENTS) return ERROR;
+
+    EventRecord* record = &events[eid];
+    memset(record, 0, sizeof(*record));
+    fill_event_record(record, UID, event_name, file_name, total_seats, event_date);
+    event_state_init(eid, record, FALSE);
+    // Published before the version bump, so the LST rebuild it triggers lists it
+    record->exists = TRUE;
+    event_touch(record, TRUE);
+    event_count++;
+    return SUCCESS;
+}
+
+int close_event(char* EID, char* state) {
+    EventRecord* record = find_event(EID);
+    if (record == NULL) return ERROR;
+
+    // Checked again under the event's lock, a reservation may have sold it out
+    // since the handler looked
+    pthread_mutex_t* lock = &event_locks[atoi(EID)];
+    pthread_mutex_lock(lock);
+    expire_event_deadlines();
+    *state = record->state;
+    if (*state != ACCEPTING) {
+        pthread_mutex_unlock(lock);
+        return INVALID;
     }
-    fclose(fp);
 
-    int seat_count = atoi(seat_count_str);
-    int reserved_seats = 0;
+    char datetime[EVENT_DATE_LENGHT_W_SECONDS + 1];
+    current_datetime(datetime, sizeof(datetime));
 
-    fp = fopen(reservations_fname, "r");
-    if (fp == NULL) return FALSE;
-    if(fscanf(fp, "%d", &reserved_seats) != 1) {
-        fclose(fp);
-        return FALSE;
+    // Logged once the END_ file is written, a close that failed is never replayed
+    if (write_event_end_file(EID, datetime) == ERROR) {
+        remove_event_end_file(EID);
+        pthread_mutex_unlock(lock);
+        return ERROR;
     }
-    fclose(fp);
 
-    if (reserved_seats >= seat_count) {
-        return TRUE;
+    // The event may have turned PAST meanwhile, it is not closed then.
+    // Its deadline stays in the heap and is skipped when it expires.
+    char accepting = ACCEPTING;
+    if (!atomic_compare_exchange_strong(&record->state, &accepting, CLOSED)) {
+        remove_event_end_file(EID);
+        *state = accepting;
+        pthread_mutex_unlock(lock);
+        return INVALID;
     }
-    return FALSE;
+    wal_log_close(EID, datetime);
+    event_touch(record, TRUE);
+    pthread_mutex_unlock(lock);
+    return SUCCESS;
 }
 
+void expire_event_deadlines() {
+    time_t now = time(NULL);
+    if (now <= atomic_load(&next_deadline)) return;
+
+    pthread_mutex_lock(&deadline_lock);
+    while (deadline_count > 0 && deadlines[0].deadline < now) {
+        EventDeadline expired = deadline_pop();
+        EventRecord* record = &events[expired.eid];
+        if (!record->exists || record->start_time != expired.deadline) continue;
+
+        // Closed events stay CLOSED, a racing reservation may flip ACCEPTING to SOLD_OUT
+        char state = atomic_load(&record->state);
+        while (state != CLOSED && state != PAST) {
+            if (atomic_compare_exchange_weak(&record->state, &state, PAST)) {
+                event_touch(record, TRUE);
+                break;
+            }
+        }
+    }
+    atomic_store(&next_deadline, deadline_count > 0 ? deadlines[0].deadline : NO_DEADLINE);
+    pthread_mutex_unlock(&deadline_lock);
+}
 
-int is_event_past(char* EID){
-    char event_info_fname[30];
-    sprintf(event_info_fname, "EVENTS/%s/START_%s.txt", EID, EID);
+int reserve_event_seats(char* UID, char* EID, int num_seats, int* available) {
+    EventRecord* record = find_event(EID);
+    if (record == NULL) return ERROR;
 
-    FILE* fp = fopen(event_info_fname, "r");
-    if (fp == NULL) return FALSE;
-    
+    // Check, log and apply under the event's lock so concurrent reservations
+    // can neither oversell nor write the RES_ totals out of order
+    pthread_mutex_t* lock = &event_locks[atoi(EID)];
+    pthread_mutex_lock(lock);
 
-    char date_str[11];  // DD-MM-YYYY
-    char time_str[6];   // HH:MM
-    // Format: UID event_name filename seat_count date time
-    if (fscanf(fp, "%*s %*s %*s %*s %10s %5s", date_str, time_str) != 2) {
-        fclose(fp);
-        return FALSE;
+    int reserved = record->reserved_seats;
+    *available = record->total_seats - reserved;
+    if (num_seats > *available) {
+        pthread_mutex_unlock(lock);
+        return INVALID;
     }
-    fclose(fp);
 
-    // Parse date: DD-MM-YYYY HH:MM
-    int day, month, year, hour, minute;
-    if (sscanf(date_str, "%d-%d-%d", &day, &month, &year) != 3 ||
-        sscanf(time_str, "%d:%d", &hour, &minute) != 2) {
-        return FALSE;
+    // Every file that can fail is written before the reservation is logged
+    // and counted, a failure undoes what was written and reserves nothing
+    char datetime[EVENT_DATE_LENGHT_W_SECONDS + 1];
+    current_datetime(datetime, sizeof(datetime));
+    // The new total is unique to this reservation and names its record files
+    int total = reserved + num_seats;
+    if (write_reservation(UID, EID, num_seats, total, datetime) == ERROR) {
+        pthread_mutex_unlock(lock);
+        return ERROR;
+    }
+    if (update_reservations_file(EID, total) == ERROR) {
+        remove_reservation(UID, EID, total, datetime);
+        update_reservations_file(EID, reserved);
+        pthread_mutex_unlock(lock);
+        return ERROR;
     }
 
-    // Get current time
-    time_t now = time(NULL);
+    wal_log_reserve(EID, UID, num_seats, total, datetime);
+    record->reserved_seats = total;
+    int sold_out = FALSE;
+    if (record->reserved_seats >= record->total_seats) {
+        char accepting = ACCEPTING;
+        sold_out = atomic_compare_exchange_strong(&record->state, &accepting, SOLD_OUT);
+    }
+    event_touch(record, sold_out);
+    pthread_mutex_unlock(lock);
 
-    // Create a struct tm for the event time
-    struct tm event_tm = {0};
-    event_tm.tm_year = year - 1900;  // years since 1900
-    event_tm.tm_mon = month - 1;     // months are 0-11
-    event_tm.tm_mday = day;
-    event_tm.tm_hour = hour;
-    event_tm.tm_min = minute;
-    event_tm.tm_sec = 0;
-    event_tm.tm_isdst = -1;           // auto-detect DST
+    // The reservation is made: the RMR ring is rebuilt from the logged record
+    // by replay, so failing to persist it is not the client's error
+    if (add_recent_reservation(UID, EID, num_seats, datetime) == ERROR)
+        server_log("Recent reservations file update failed", NULL);
+    return SUCCESS;
+}
+
+int event_table_count() {
+    return event_count;
+}
 
-    time_t event_time = mktime(&event_tm);
-    if (event_time == -1) return FALSE;
+int event_exists(char* EID){
+    return find_event(EID) != NULL;
+}
 
-    return (event_time < now) ? TRUE : FALSE;
+int is_event_closed(char* EID){
+    EventRecord* record = find_event(EID);
+    return record && record->state == CLOSED ? TRUE : FALSE;
 }
 
+int is_event_creator(char* UID, char* EID){
+    EventRecord* record = find_event(EID);
+    return record && strcmp(UID, record->uid) == 0 ? TRUE : FALSE;
+}
 
-int get_list_event_info(char* EID, char* event_name, char* event_date) {
-    
-    char start_file_path[30];
-    sprintf(start_file_path, "EVENTS/%s/START_%s.txt", EID, EID);
-    if(!file_exists(start_file_path)) return ERROR;
+int is_event_sold_out(char* EID){
+    EventRecord* record = find_event(EID);
+    return record && record->reserved_seats >= record->total_seats ? TRUE : FALSE;
+}
 
-    FILE* fp = fopen(start_file_path, "r");
-    if (fp == NULL) return ERROR;
+int is_event_past(char* EID){
+    expire_event_deadlines();
+    EventRecord* record = find_event(EID);
+    return record && record->state == PAST ? TRUE : FALSE;
+}
 
-    char date_str[11];  // DD-MM-YYYY
-    char time_str[6];   // HH:MM
-    // Format: UID event_name filename seat_count date time
-    if (fscanf(fp, "%*s %10s %*s %*s %10s %5s", event_name, date_str, time_str) != 3) {
-        fclose(fp);
-        return ERROR;
+int get_event_state(char* EID) {
+    EventRecord* record = find_event(EID);
+    return record ? record->state : ACCEPTING;
+}
+
+uint64_t event_table_version() {
+    pthread_mutex_lock(&version_lock);
+    uint64_t version = state_version;
+    pthread_mutex_unlock(&version_lock);
+    return version;
+}
+
+int event_changed_since(char* EID, uint64_t version) {
+    EventRecord* record = find_event(EID);
+    return record && record->version > version ? TRUE : FALSE;
+}
+
+// Renders the RLS entries of one EID range: "EID name state date " each
+static void render_list_shard(int shard) {
+    ListShard* out = &list_shards[shard];
+    int first = shard * LIST_SHARD_EVENTS;
+    out->len = 0;
+
+    for (int eid = first; eid < first + LIST_SHARD_EVENTS && eid <= MAX_EVENTS; eid++) {
+        EventRecord* record = &events[eid];
+        if (!record->exists) continue;
+        int n = snprintf(out->text + out->len, sizeof(out->text) - out->len, "%03d %s %c %s ",
+                         eid, record->name, (char)record->state, record->date);
+        if (n > 0 && (size_t)n < sizeof(out->text) - out->len) out->len += n;
+    }
+}
+
+SharedBuffer* event_list_reply() {
+    expire_event_deadlines();
+
+    uint64_t shard_snapshot[LIST_SHARDS];
+    pthread_mutex_lock(&version_lock);
+    uint64_t version = listing_version;
+    memcpy(shard_snapshot, shard_versions, sizeof(shard_snapshot));
+    pthread_mutex_unlock(&version_lock);
+
+    pthread_mutex_lock(&list_reply_lock);
+    if (list_reply == NULL || list_reply_version != version) {
+        // A range that changes while it is rendered keeps an older version
+        // and is rendered again by the next rebuild
+        const char* header = "RLS OK ";
+        size_t len = strlen(header) + 1;
+        for (int shard = 0; shard < LIST_SHARDS; shard++) {
+            if (list_shards[shard].version != shard_snapshot[shard]) {
+                list_shards[shard].version = shard_snapshot[shard];
+                render_list_shard(shard);
+            }
+            len += list_shards[shard].len;
+        }
+
+        SharedBuffer* reply = shared_buffer_new(len);
+        if (reply == NULL) {
+            pthread_mutex_unlock(&list_reply_lock);
+            return NULL;
+        }
+        memcpy(reply->data, header, strlen(header));
+        reply->len = strlen(header);
+        for (int shard = 0; shard < LIST_SHARDS; shard++) {
+            memcpy(reply->data + reply->len, list_shards[shard].text, list_shards[shard].len);
+            reply->len += list_shards[shard].len;
+        }
+        reply->data[reply->len++] = '\n';
+
+        if (list_reply != NULL) shared_buffer_release(list_reply);
+        list_reply = reply;
+        list_reply_version = version;
     }
 
-    fclose(fp);
-    // Combine date and time into event_date
-    snprintf(event_date, EVENT_DATE_LENGTH + 1, "%s %s", date_str, time_str);
+    SharedBuffer* reply = list_reply;
+    shared_buffer_retain(reply);
+    pthread_mutex_unlock(&list_reply_lock);
+    return reply;
+}
+
+int get_list_event_info(char* EID, char* event_name, char* event_date) {
+    EventRecord* record = find_event(EID);
+    if (record == NULL) return ERROR;
+    snprintf(event_name, MAX_EVENT_NAME + 1, "%s", record->name);
+    snprintf(event_date, EVENT_DATE_LENGTH + 1, "%s", record->date);
     return SUCCESS;
 }
 
+int read_event_full_details(char* EID, char* UID, char* event_name,
+                            char* event_date, char* total_seats,
+                            char* reserved_seats, char* file_name){
+    EventRecord* record = find_event(EID);
+    if (record == NULL) return ERROR;
+    snprintf(UID, UID_LENGTH + 1, "%s", record->uid);
+    snprintf(event_name, MAX_EVENT_NAME + 1, "%s", record->name);
+    snprintf(event_date, EVENT_DATE_LENGTH + 1, "%s", record->date);
+    snprintf(total_seats, SEAT_COUNT_LENGTH + 1, "%d", record->total_seats);
+    snprintf(reserved_seats, SEAT_COUNT_LENGTH + 1, "%d", record->reserved_seats);
+    snprintf(file_name, FILE_NAME_LENGTH + 1, "%s", record->file_name);
+    return SUCCESS;
+}
+
+int get_available_seats(char* EID) {
+    EventRecord* record = find_event(EID);
+    if (record == NULL) return ERROR;
+    return record->total_seats - record->reserved_seats;
+}
+
+int verify_event_dir(char* event_dir_name){
+    // Check length is exactly 3
+    if (strlen(event_dir_name) != 3) return INVALID;
+
+    // Check all 3 characters are digits
+    for (int i = 0; i < 3; i++) {
+        if (!has_class(event_dir_name[i], CLASS_DIGIT))
+            return INVALID;
+    }
+    
+    // Check range 001-999
+    int eid = atoi(event_dir_name);
+    if (eid < 1 || eid > 999) return INVALID;
+    
+    return VALID;
+}
 
 int create_eid_dir (int EID){
     char EID_dirname[15];
@@ -190,83 +494,3 @@ int create_eid_dir (int EID){
     }
     return SUCCESS;
 }
-
-
-int read_event_full_details(char* EID, char* UID, char* event_name,
-                            char* event_date, char* total_seats,
-                            char* reserved_seats, char* file_name){
-                                
-    char start_file_path[30];
-    char res_file_path[30];
-    sprintf(start_file_path, "EVENTS/%s/START_%s.txt", EID, EID);
-    sprintf(res_file_path, "EVENTS/%s/RES_%s.txt", EID, EID);
-    if(!file_exists(start_file_path)) return ERROR;
-    FILE* fp = fopen(start_file_path, "r");
-    if (fp == NULL) return ERROR;
-    char date_str[11];  // DD-MM-YYYY
-    char time_str[6];   // HH:MM
-    // Format: UID event_name filename seat_count date time
-    if (fscanf(fp, "%6s %10s %24s %3s %10s %5s", UID, event_name, file_name,
-               total_seats, date_str, time_str) != 6) {
-        fclose(fp);
-        return ERROR;
-    }
-
-    fclose(fp);
-    // Combine date and time into event_date
-    snprintf(event_date, EVENT_DATE_LENGTH + 1, "%s %s", date_str, time_str);
-
-    // Read reserved seats
-    *reserved_seats = 0;
-    fp = fopen(res_file_path, "r");
-    if (fp == NULL) return ERROR; 
-    
-    if(fscanf(fp, "%s", reserved_seats) != 1) {
-        fclose(fp);
-        return ERROR;
-    }
-    
-    fclose(fp);
-    return SUCCESS;
-}
-
-
-int get_available_seats(char* EID) {
-    char event_info_fname[30];
-    char reservations_fname[30];
-    sprintf(event_info_fname, "EVENTS/%s/START_%s.txt", EID, EID);
-    sprintf(reservations_fname, "EVENTS/%s/RES_%s.txt", EID, EID);
-
-    FILE* fp = fopen(event_info_fname, "r");
-    if (fp == NULL) {
-        return ERROR;
-    }
-
-    char seat_count_str[SEAT_COUNT_LENGTH + 1];
-    if (fscanf(fp, "%*s %*s %*s %3s", seat_count_str) != 1) {
-        fclose(fp);
-        return ERROR;
-    }
-    fclose(fp);
-
-    int seat_count = atoi(seat_count_str);
-    int reserved_seats = 0;
-
-    fp = fopen(reservations_fname, "r");
-    if (fp == NULL) return ERROR;
-    if(fscanf(fp, "%d", &reserved_seats) != 1) {
-        fclose(fp);
-        return -1;
-    }
-    fclose(fp);
-
-    return seat_count - reserved_seats;
-}
-
-int make_reservation(char* UID, char* EID, int requested_seats){
-    int status = write_reservation(UID, EID, requested_seats);
-    if (status != SUCCESS) return ERROR;
-    return SUCCESS;
-    status = update_reservations_file(EID, requested_seats);
-    if (status != SUCCESS) return ERROR;
-}
\ No newline at end of file
@@ -98,44 +98,49 @@ int remove_directory(const char *path) {
 }
 
 
-int find_available_eid(char* eid_str) {
-    if (eid_str == NULL) return ERROR;
+// One bit per EID, set while the EID is free; bit 0 (EID 000) is never free
+static _Atomic uint64_t free_eids[EID_BITMAP_WORDS];
 
-    DIR* dir = opendir("EVENTS");
-    if (dir == NULL) {
-        // EVENTS directory doesn't exist, so EID 001 is available
-        snprintf(eid_str, 4, "001");
-        return SUCCESS;
-    }
+int load_eid_bitmap() {
+    // Mark 001-999 free, then take every EID that already has a directory
+    for (int i = 0; i < EID_BITMAP_WORDS; i++) atomic_store(&free_eids[i], 0);
+    for (int eid = 1; eid <= MAX_EVENTS; eid++)
+        atomic_fetch_or(&free_eids[eid / 64], (uint64_t)1 << (eid % 64));
 
-    // Create a set to track which EIDs are taken
-    int taken[1000] = {0};  // Index 0-999, 0=not taken, 1=taken
+    DIR* dir = opendir("EVENTS");
+    if (dir == NULL) return SUCCESS;
 
     struct dirent* entry;
     while ((entry = readdir(dir)) != NULL) {
-        // Skip . and ..
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
-
         // Check if entry is a directory and is a valid 3-digit number
+        if (strlen(entry->d_name) != 3 || !is_number(entry->d_name)) continue;
         char full_path[512];
         snprintf(full_path, sizeof(full_path), "EVENTS/%s", entry->d_name);
         struct stat st;
         if (stat(full_path, &st) == 0 && S_ISDIR(st.st_mode)) {
-            if (strlen(entry->d_name) == 3 && is_number(entry->d_name)) {
-                int eid = atoi(entry->d_name);
-                if (eid >= 1 && eid <= 999) {
-                    taken[eid] = 1;
-                }
-            }
+            int eid = atoi(entry->d_name);
+            if (eid >= 1 && eid <= MAX_EVENTS)
+                atomic_fetch_and(&free_eids[eid / 64], ~((uint64_t)1 << (eid % 64)));
         }
     }
     closedir(dir);
+    return SUCCESS;
+}
+
+int find_available_eid(char* eid_str) {
+    if (eid_str == NULL) return ERROR;
 
-    // Find the first available EID
-    for (int i = 1; i <= 999; i++) {
-        if (taken[i] == 0) {
-            snprintf(eid_str, 4, "%03d", i);
-            return SUCCESS;
+    for (int i = 0; i < EID_BITMAP_WORDS; i++) {
+        uint64_t word = atomic_load(&free_eids[i]);
+        while (word != 0) {
+            // Claim the lowest free EID, a racing creator makes the CAS retry
+            int bit = __builtin_ctzll(word);
+            int eid = i * 64 + bit;
+            if (eid < 1 || eid > MAX_EVENTS) return ERROR;
+            if (atomic_compare_exchange_weak(&free_eids[i], &word, word & ~((uint64_t)1 << bit))) {
+                snprintf(eid_str, 4, "%03d", eid);
+                return SUCCESS;
+            }
         }
     }
 
@@ -143,6 +148,11 @@ int find_available_eid(char* eid_str) {
     return ERROR;
 }
 
+void release_eid(int eid) {
+    if (eid < 1 || eid > MAX_EVENTS) return;
+    atomic_fetch_or(&free_eids[eid / 64], (uint64_t)1 << (eid % 64));
+}
+
 int write_event_start_file(const char* eid, const char* uid, const char* event_name,
                            const char* desc_fname, const char* event_attend,
                            const char* event_date) {
@@ -170,8 +180,16 @@ int write_event_start_file(const char* eid, const char* uid, const char* event_n
 }
 
 
-int write_event_end_file(const char* eid) {
-    if (eid == NULL) return ERROR;
+void current_datetime(char* datetime, size_t size) {
+    time_t now = time(NULL);
+    struct tm tm_info;
+    localtime_r(&now, &tm_info);
+    strftime(datetime, size, "%d-%m-%Y %H:%M:%S", &tm_info);
+}
+
+
+int write_event_end_file(const char* eid, const char* datetime) {
+    if (eid == NULL || datetime == NULL) return ERROR;
 
     // Create file path: EVENTS/{EID}/END_{EID}.txt
     char file_path[256];
@@ -182,11 +200,7 @@ int write_event_end_file(const char* eid) {
         return ERROR;
     }
 
-    time_t now = time(NULL);
-    struct tm* timeinfo = localtime(&now);
-    int ret = fprintf(fp, "%02d-%02d-%04d %02d:%02d:%02d\n", 
-        timeinfo->tm_mday, timeinfo->tm_mon + 1, timeinfo->tm_year + 1900,
-        timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
+    int ret = fprintf(fp, "%s\n", datetime);
     
     fclose(fp);
 
@@ -222,6 +236,23 @@ int write_event_information_file(const char* eid, const char* uid, const char* e
 }
 
 
+void discard_event_files(const char* eid, const char* uid) {
+    char path[256];
+    snprintf(path, sizeof(path), "USERS/%s/CREATED/%s.txt", uid, eid);
+    unlink(path);
+    snprintf(path, sizeof(path), "EVENTS/%s", eid);
+    remove_directory(path);
+    release_eid(atoi(eid));
+}
+
+
+void remove_event_end_file(const char* eid) {
+    char file_path[256];
+    snprintf(file_path, sizeof(file_path), "EVENTS/%s/END_%s.txt", eid, eid);
+    unlink(file_path);
+}
+
+
 int update_reservations_file(const char* eid, int reserved_seats) {
     if (eid == NULL) return ERROR;
 
@@ -229,35 +260,30 @@ int update_reservations_file(const char* eid, int reserved_seats) {
     char file_path[256];
     snprintf(file_path, sizeof(file_path), "EVENTS/%s/RES_%s.txt", eid, eid);
 
-    int current_reservations = 0;
-
-    // Try to read existing reservations
-    FILE* fp = fopen(file_path, "r");
-    if (fp != NULL) {
-        if (fscanf(fp, "%d", &current_reservations) != 1) {
-            current_reservations = 0;
-        }
-        fclose(fp);
-    }
-
-    // Update with new reservation count
-    int new_reservations = current_reservations + reserved_seats;
-
-    // Write updated count
-    fp = fopen(file_path, "w");
+    // Write the absolute count, the in-memory event table holds the running total
+    FILE* fp = fopen(file_path, "w");
     if (fp == NULL) {
         return ERROR;
     }
 
-    int ret = fprintf(fp, "%d\n", new_reservations);
+    int ret = fprintf(fp, "%d\n", reserved_seats);
     fclose(fp);
 
     return (ret > 0) ? SUCCESS : ERROR;
 }
 
 
-int write_description_file(const char* eid, const char* file_name, size_t file_size, const char* file_content) {
-    if (eid == NULL || file_name == NULL || file_content == NULL) {
+// Makes the entries of a directory durable, new files and renames included
+static int sync_dir(const char* path) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return ERROR;
+    int ret = fsync(fd);
+    close(fd);
+    return ret == 0 ? SUCCESS : ERROR;
+}
+
+int write_description_file(const char* eid, const char* file_name, Upload* upload) {
+    if (eid == NULL || file_name == NULL || upload == NULL || upload->path[0] == '\0') {
         return ERROR;
     }
 
@@ -274,33 +300,54 @@ int write_description_file(const char* eid, const char* file_name, size_t file_s
     char file_path[512];
     snprintf(file_path, sizeof(file_path), "EVENTS/%s/DESCRIPTION/%s", eid, file_name);
 
-    // Write the file content
-    FILE* fp = fopen(file_path, "wb");
-    if (fp == NULL) {
+    // The WAL does not carry file data: the description must be on disk,
+    // under its final name, before the CRE record can be logged
+    if (fsync(upload->fd) != 0) return ERROR;
+
+    // The upload is complete, move it into place in one step
+    if (rename(upload->path, file_path) != 0) {
         return ERROR;
     }
+    upload->path[0] = '\0';
 
-    size_t written = fwrite(file_content, 1, file_size, fp);
-    fclose(fp);
-
-    return (written == file_size) ? SUCCESS : ERROR;
+    // The rename and the event's new directories live in their parents
+    char eid_path[256];
+    snprintf(eid_path, sizeof(eid_path), "EVENTS/%s", eid);
+    if (sync_dir(dir_path) == ERROR || sync_dir(eid_path) == ERROR || sync_dir("EVENTS") == ERROR)
+        return ERROR;
+    return SUCCESS;
 }
 
 
-int write_reservation(char* UID, char* EID, int num_seats) {
-    if (!UID || !EID || num_seats <= 0) return ERROR;
+int remove_stale_uploads() {
+    DIR* dir = opendir("EVENTS");
+    if (dir == NULL) return SUCCESS;
 
-    // Get current time for timestamp
-    time_t now = time(NULL);
-    struct tm* tm_info = localtime(&now);
+    // Temp files left behind by uploads interrupted by a crash
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, UPLOAD_PREFIX, strlen(UPLOAD_PREFIX)) != 0) continue;
+        char path[512];
+        snprintf(path, sizeof(path), "EVENTS/%s", entry->d_name);
+        unlink(path);
+    }
+    closedir(dir);
+    return SUCCESS;
+}
+
+
+// Record file name: {EID}-{DD-MM-YYYY HH:MM:SS}-{UID}-{sequence}.txt. The
+// date alone is shared by every reservation made on the event in one second.
+static void reservation_file_name(char* filename, size_t size, const char* UID,
+                                  const char* EID, int sequence, const char* datetime) {
+    snprintf(filename, size, "%s-%s-%s-%03d.txt", EID, datetime, UID, sequence);
+}
 
-    // Format datetime: DD-MM-YYYY HH:MM:SS
-    char datetime[20];
-    strftime(datetime, sizeof(datetime), "%d-%m-%Y %H:%M:%S", tm_info);
+int write_reservation(char* UID, char* EID, int num_seats, int sequence, const char* datetime) {
+    if (!UID || !EID || !datetime || num_seats <= 0) return ERROR;
 
-    // Build filename: {EID}-{DD-MM-YYYY HH:MM:SS}.txt
     char filename[64];
-    snprintf(filename, sizeof(filename), "%s-%s.txt", EID, datetime);
+    reservation_file_name(filename, sizeof(filename), UID, EID, sequence, datetime);
 
     // Build file content: UID res_num res_datetime
     char content[128];
@@ -343,4 +390,13 @@ int write_reservation(char* UID, char* EID, int num_seats) {
     fclose(fp);
 
     return SUCCESS;
-}
\ No newline at end of file
+}
+
+void remove_reservation(const char* UID, const char* EID, int sequence, const char* datetime) {
+    char filename[64], path[128];
+    reservation_file_name(filename, sizeof(filename), UID, EID, sequence, datetime);
+    snprintf(path, sizeof(path), "EVENTS/%s/RESERVATIONS/%s", EID, filename);
+    unlink(path);
+    snprintf(path, sizeof(path), "USERS/%s/RESERVED/%s", UID, filename);
+    unlink(path);
+}
@@ -1,71 +1,467 @@
+#define _GNU_SOURCE
 #include "../../include/utils.h"
 #include "../../include/globals.h"
+#include <sys/sendfile.h>
+#include <poll.h>
 
-int select_handler() {
-    int max_fd = set.udp_socket > set.tcp_socket ? set.udp_socket : set.tcp_socket;
-    set.temp_fds = set.read_fds;
+int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return ERROR;
+    if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) return ERROR;
+    return SUCCESS;
+}
 
-    if (select(max_fd + 1, &set.temp_fds, NULL, NULL, &set.timeout) < 0) {
-        server_log("Select error", NULL);
-        return ERROR;
+void send_udp_response(const char* message, Request *req) {
+    size_t length = strlen(message);
+    char* reply = realloc(req->reply, req->reply_len + length);
+    if (reply == NULL) return;
+    memcpy(reply + req->reply_len, message, length);
+    req->reply = reply;
+    req->reply_len += length;
+}
+
+// Replies handled by this thread and not sent yet
+static _Thread_local UdpReply pending_replies[UDP_BATCH_SIZE];
+static _Thread_local int pending_count;
+static _Thread_local uint64_t pending_since;    // when the oldest one was queued, in µs
+
+static uint64_t monotonic_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// Sends one run of replies that share a socket. sendmmsg() stops early at
+// the first datagram it cannot send and only fails when that is the first
+// one, resume from there.
+static void send_reply_run(int socket, struct mmsghdr* msgs, UdpReply* replies, int count) {
+    int sent = 0;
+    while (sent < count) {
+        int n = sendmmsg(socket, msgs + sent, count - sent, 0);
+        if (n >= 0) {
+            sent += n;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            // The socket is non-blocking, wait for room in the send buffer
+            struct pollfd pfd = {.fd = socket, .events = POLLOUT};
+            if (poll(&pfd, 1, UDP_SEND_WAIT_MS) == 0) {
+                server_log("UDP Send buffer stayed full, replies dropped", NULL);
+                break;
+            }
+        } else {
+            // An error for one client (e.g. EHOSTUNREACH), skip its reply only
+            server_log("UDP Send failed", &replies[sent].client_addr);
+            sent++;
+        }
     }
+}
+
+void send_udp_replies() {
+    struct mmsghdr msgs[UDP_BATCH_SIZE];
+    struct iovec iovs[UDP_BATCH_SIZE];
+
+    for (int i = 0; i < pending_count; i++) {
+        UdpReply* reply = &pending_replies[i];
+        iovs[i].iov_base = reply->data;
+        iovs[i].iov_len = reply->len;
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_name = &reply->client_addr;
+        msgs[i].msg_hdr.msg_namelen = reply->addr_len;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // Each reply leaves through the socket its request came in on: with -w a
+    // worker's batch mixes the loops' SO_REUSEPORT sockets
+    for (int start = 0; start < pending_count; ) {
+        int end = start + 1;
+        while (end < pending_count && pending_replies[end].socket == pending_replies[start].socket)
+            end++;
+        send_reply_run(pending_replies[start].socket, msgs + start, pending_replies + start,
+                       end - start);
+        start = end;
+    }
+
+    for (int i = 0; i < pending_count; i++) free(pending_replies[i].data);
+    pending_count = 0;
+}
+
+void flush_udp_response(Request* req) {
+    if (req->reply == NULL) return;
+
+    // Hand the reply to the thread's batch, it leaves with the next sendmmsg()
+    if (pending_count == 0) pending_since = monotonic_us();
+    UdpReply* reply = &pending_replies[pending_count++];
+    reply->socket = req->client_socket;
+    reply->client_addr = req->client_addr;
+    reply->addr_len = req->addr_len;
+    reply->data = req->reply;
+    reply->len = req->reply_len;
+    req->reply = NULL;
+    req->reply_len = 0;
+
+    if (pending_count == UDP_BATCH_SIZE) send_udp_replies();
+}
+
+void send_due_udp_replies() {
+    if (pending_count > 0 && monotonic_us() - pending_since >= UDP_REPLY_DELAY_US)
+        send_udp_replies();
+}
+
+void udp_connection(int udp_socket) {
+    Request batch[UDP_BATCH_SIZE];
+    struct mmsghdr msgs[UDP_BATCH_SIZE];
+    struct iovec iovs[UDP_BATCH_SIZE];
+
+    // Edge-triggered: drain every datagram queued on the socket,
+    // up to UDP_BATCH_SIZE per recvmmsg() call
+    while (1) {
+        for (int i = 0; i < UDP_BATCH_SIZE; i++) {
+            // Datagrams land straight in the request buffers
+            memset(&batch[i], 0, sizeof(batch[i]));
+            iovs[i].iov_base = batch[i].buffer;
+            iovs[i].iov_len = sizeof(batch[i].buffer) - 1;
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_name = &batch[i].client_addr;
+            msgs[i].msg_hdr.msg_namelen = sizeof(batch[i].client_addr);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int received = recvmmsg(udp_socket, msgs, UDP_BATCH_SIZE, 0, NULL);
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) server_log("UDP Receive failed", NULL);
+            break;
+        }
+
+        for (int i = 0; i < received; i++) {
+            // Skip empty datagrams
+            if (msgs[i].msg_len == 0) continue;
+            batch[i].buffer[msgs[i].msg_len] = '\0';
+            batch[i].client_socket = udp_socket;
+            batch[i].addr_len = msgs[i].msg_hdr.msg_namelen;
+            dispatch_request(&batch[i]);
+        }
+
+        // Replies of requests handled inline leave together
+        send_udp_replies();
+        if (received < UDP_BATCH_SIZE) break;
+    }
+}
+
+
+// ------------ TCP replies ---------------
+
+static OutChunk* new_chunk(size_t cap) {
+    OutChunk* chunk = malloc(sizeof(OutChunk) + cap);
+    if (chunk == NULL) return NULL;
+    chunk->next = NULL;
+    chunk->file_fd = -1;
+    chunk->offset = 0;
+    chunk->len = 0;
+    chunk->sent = 0;
+    chunk->shared = NULL;
+    chunk->cap = cap;
+    chunk->mode = SEND_SENDFILE;
+    chunk->pipe_fds[0] = chunk->pipe_fds[1] = -1;
+    chunk->piped = 0;
+    return chunk;
+}
+
+static void free_chunk(OutChunk* chunk) {
+    if (chunk->shared) shared_buffer_release(chunk->shared);
+    if (chunk->file_fd >= 0) close(chunk->file_fd);
+    if (chunk->pipe_fds[0] >= 0) {
+        close(chunk->pipe_fds[0]);
+        close(chunk->pipe_fds[1]);
+    }
+    free(chunk);
+}
+
+static void enqueue_chunk(Connection* conn, OutChunk* chunk) {
+    if (conn->out_tail) conn->out_tail->next = chunk;
+    else conn->out_head = chunk;
+    conn->out_tail = chunk;
+}
+
+int send_tcp_data(Request* req, const char* data, size_t length) {
+    Connection* conn = req->conn;
+    OutChunk* tail = conn->out_tail;
+
+    // Coalesce small writes into the last memory chunk
+    if (tail && tail->file_fd < 0 && tail->shared == NULL && tail->cap - tail->len >= length) {
+        memcpy(tail->data + tail->len, data, length);
+        tail->len += length;
+        return SUCCESS;
+    }
+
+    OutChunk* chunk = new_chunk(length > CONN_OUT_CHUNK ? length : CONN_OUT_CHUNK);
+    if (chunk == NULL) return ERROR;
+    memcpy(chunk->data, data, length);
+    chunk->len = length;
+    enqueue_chunk(conn, chunk);
     return SUCCESS;
 }
 
-void send_udp_response(const char* message, Request *req) {
-    sendto(set.udp_socket, message, strlen(message), 0,\
-            (struct sockaddr *)&req->client_addr, req->addr_len);
-}
-
-void udp_connection() {
-    char buffer[BUFFER_SIZE];
-    struct sockaddr_in client_addr;
-    socklen_t addr_len = sizeof(client_addr);
-
-    // Copys the data from the UDP socket into buffer
-    ssize_t received_bytes = recvfrom(set.udp_socket, buffer, sizeof(buffer) - 1, 0,
-                            (struct sockaddr *)&client_addr, &addr_len);
-    
-    if (received_bytes < 0) {
-        server_log("UDP Receive failed", NULL);
-        return;
-    }
-    // if the buffer is not empty
-    if (received_bytes > 0) {
-        // add \0 to be used as a string
-        buffer[received_bytes] = '\0';
-
-        // create a new request to be used by handle_request
-        Request req = {.client_addr = client_addr, .addr_len = addr_len, .is_tcp = 0};
-        strncpy(req.buffer, buffer, sizeof(req.buffer));
-        handle_udp_request(&req);
-    } 
-}    
-
-
-void tcp_connection() {
-    char request_type[4];   
-    struct sockaddr_in client_addr;
-    socklen_t addr_len = sizeof(client_addr);
-
-    // Accept the incoming TCP connection, creating a new socket for this client
-    int client_socket = accept(set.tcp_socket, (struct sockaddr *)&client_addr, &addr_len);
-
-    if (client_socket < 0) {
-        server_log("TCP Accept failed", NULL);
-        return;
-    }
-
-    // Read only the 3-letter command using the helper that handles delimiters
-    ssize_t cmd_len = tcp_read_field(client_socket, request_type, 3);
-    if (cmd_len <= 0) {
-        server_log("TCP Read failed or connection closed", NULL);
-        close(client_socket);
-        return;
-    }
-
-    // Create a new request to be used by handle_request
-    Request req = {.client_socket = client_socket, .client_addr = client_addr, .addr_len = addr_len, .is_tcp = 1};
-    strncpy(req.buffer, request_type, sizeof(req.buffer));
-    handle_tcp_request(&req);
-}
\ No newline at end of file
+int send_tcp_response(const char* message, Request* req) {
+    return send_tcp_data(req, message, strlen(message));
+}
+
+void send_response(const char* message, Request* req) {
+    if (req->is_tcp) send_tcp_response(message, req);
+    else send_udp_response(message, req);
+}
+
+SharedBuffer* shared_buffer_new(size_t cap) {
+    SharedBuffer* buffer = malloc(sizeof(SharedBuffer) + cap);
+    if (buffer == NULL) return NULL;
+    buffer->refs = 1;
+    buffer->len = 0;
+    return buffer;
+}
+
+void shared_buffer_retain(SharedBuffer* buffer) {
+    atomic_fetch_add(&buffer->refs, 1);
+}
+
+void shared_buffer_release(SharedBuffer* buffer) {
+    if (atomic_fetch_sub(&buffer->refs, 1) == 1) free(buffer);
+}
+
+int send_tcp_shared(Request* req, SharedBuffer* buffer) {
+    OutChunk* chunk = new_chunk(0);
+    if (chunk == NULL) return ERROR;
+    shared_buffer_retain(buffer);
+    chunk->shared = buffer;
+    chunk->len = buffer->len;
+    enqueue_chunk(req->conn, chunk);
+    return SUCCESS;
+}
+
+int send_tcp_file(const char* file_name, Request* req) {
+    int file_fd = open(file_name, O_RDONLY);
+    if (file_fd < 0) {
+        server_log("Failed to open file", &req->client_addr);
+        return ERROR;
+    }
+    struct stat st;
+    if (fstat(file_fd, &st) != 0) {
+        close(file_fd);
+        return ERROR;
+    }
+
+    OutChunk* chunk = new_chunk(0);
+    if (chunk == NULL) {
+        close(file_fd);
+        return ERROR;
+    }
+    chunk->file_fd = file_fd;
+    chunk->len = (size_t)st.st_size;
+    enqueue_chunk(req->conn, chunk);
+
+    // Indicate end of file transfer
+    return send_tcp_response("\n", req);
+}
+
+void free_tcp_output(Connection* conn) {
+    OutChunk* chunk = conn->out_head;
+    while (chunk) {
+        OutChunk* next = chunk->next;
+        free_chunk(chunk);
+        chunk = next;
+    }
+    conn->out_head = conn->out_tail = NULL;
+}
+
+// Moves file bytes through a pipe without copying them into userspace
+static ssize_t splice_file_chunk(Connection* conn, OutChunk* chunk) {
+    if (chunk->pipe_fds[0] < 0 && pipe(chunk->pipe_fds) < 0) return -1;
+
+    if (chunk->piped == 0) {
+        size_t to_pipe = chunk->len < CONN_SPLICE_CHUNK ? chunk->len : CONN_SPLICE_CHUNK;
+        ssize_t n = splice(chunk->file_fd, &chunk->offset, chunk->pipe_fds[1], NULL,
+                           to_pipe, SPLICE_F_MOVE);
+        if (n <= 0) {
+            if (n == 0) errno = EIO;
+            return -1;
+        }
+        chunk->piped = n;
+    }
+
+    ssize_t sent = splice(chunk->pipe_fds[0], NULL, conn->fd, NULL, chunk->piped,
+                          SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (sent > 0) {
+        chunk->piped -= sent;
+        chunk->len -= sent;
+    }
+    return sent;
+}
+
+// Streams the next part of a file chunk through userspace
+static ssize_t copy_file_chunk(Connection* conn, OutChunk* chunk) {
+    char buffer[CONN_OUT_CHUNK];
+    size_t to_read = chunk->len < sizeof(buffer) ? chunk->len : sizeof(buffer);
+    ssize_t n = pread(chunk->file_fd, buffer, to_read, chunk->offset);
+    if (n <= 0) {
+        if (n == 0) errno = EIO;
+        return -1;
+    }
+    ssize_t written = write(conn->fd, buffer, n);
+    if (written > 0) {
+        chunk->offset += written;
+        chunk->len -= written;
+    }
+    return written;
+}
+
+// Sends the next part of a file chunk, returns bytes sent or -1.
+// Filesystems that refuse sendfile() drop to splice(), then to plain copies.
+static ssize_t flush_file_chunk(Connection* conn, OutChunk* chunk) {
+    while (1) {
+        ssize_t n;
+        if (chunk->mode == SEND_SENDFILE) {
+            n = sendfile(conn->fd, chunk->file_fd, &chunk->offset, chunk->len);
+            if (n > 0) chunk->len -= n;
+            else if (n == 0) errno = EIO;
+        } else if (chunk->mode == SEND_SPLICE) {
+            n = splice_file_chunk(conn, chunk);
+        } else {
+            return copy_file_chunk(conn, chunk);
+        }
+
+        if (n > 0) return n;
+        if (n == 0) return -1;
+        // Bytes already in the pipe must leave through it
+        if ((errno == EINVAL || errno == ENOSYS) && chunk->piped == 0) {
+            chunk->mode++;
+            continue;
+        }
+        return -1;
+    }
+}
+
+int flush_tcp_output(Connection* conn) {
+    while (conn->out_head) {
+        OutChunk* chunk = conn->out_head;
+        ssize_t n;
+
+        if (chunk->file_fd >= 0) {
+            if (chunk->len == 0) n = 0;
+            else n = flush_file_chunk(conn, chunk);
+        } else {
+            const char* data = chunk->shared ? chunk->shared->data : chunk->data;
+            n = chunk->len > chunk->sent ?
+                write(conn->fd, data + chunk->sent, chunk->len - chunk->sent) : 0;
+            if (n > 0) chunk->sent += n;
+        }
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return FALSE;
+            return ERROR;
+        }
+
+        int done = chunk->file_fd >= 0 ? chunk->len == 0 : chunk->sent == chunk->len;
+        if (done) {
+            conn->out_head = chunk->next;
+            if (conn->out_head == NULL) conn->out_tail = NULL;
+            free_chunk(chunk);
+        }
+    }
+    return TRUE;
+}
+
+
+int submit_tcp_output(Connection* conn) {
+    Ring* ring = &conn->loop->ring;
+
+    // Release what was fully sent
+    while (conn->out_head) {
+        OutChunk* chunk = conn->out_head;
+        int done = chunk->file_fd >= 0 ? chunk->len == 0 && conn->bounce_done == conn->bounce_len
+                                       : chunk->sent == chunk->len;
+        if (!done) break;
+        conn->out_head = chunk->next;
+        if (conn->out_head == NULL) conn->out_tail = NULL;
+        free_chunk(chunk);
+    }
+    if (conn->out_head == NULL) return TRUE;
+
+    // Gather the reply into one send. The first file chunk is read into the
+    // bounce buffer before anything is sent, so a SED header, its file and
+    // the closing newline leave together.
+    int count = 0;
+    int bounce_used = FALSE;
+    for (OutChunk* chunk = conn->out_head; chunk != NULL && count < RING_IOVECS;
+         chunk = chunk->next) {
+        if (chunk->file_fd < 0) {
+            const char* data = chunk->shared ? chunk->shared->data : chunk->data;
+            if (chunk->sent < chunk->len)
+                conn->ring_iov[count++] = (struct iovec){(char*)data + chunk->sent,
+                                                         chunk->len - chunk->sent};
+            continue;
+        }
+
+        // The bounce buffer holds one file's bytes at a time
+        if (bounce_used) break;
+        bounce_used = TRUE;
+        size_t loaded = conn->bounce_len - conn->bounce_done;
+        if (loaded == 0 && chunk->len > 0) {
+            if (conn->bounce == NULL && (conn->bounce = malloc(CONN_SPLICE_CHUNK)) == NULL)
+                return ERROR;
+            size_t to_read = chunk->len < CONN_SPLICE_CHUNK ? chunk->len : CONN_SPLICE_CHUNK;
+            ring_read(ring, chunk->file_fd, conn->bounce, to_read, chunk->offset, conn);
+            conn->ring_op = RING_READ_FILE;
+            return FALSE;
+        }
+        if (loaded > 0) conn->ring_iov[count++] = (struct iovec){conn->bounce + conn->bounce_done,
+                                                                 loaded};
+        if (chunk->len > loaded) break;
+    }
+
+    if (count == 1) {
+        ring_send(ring, conn->fd, conn->ring_iov[0].iov_base, conn->ring_iov[0].iov_len, conn);
+    } else {
+        memset(&conn->ring_msg, 0, sizeof(conn->ring_msg));
+        conn->ring_msg.msg_iov = conn->ring_iov;
+        conn->ring_msg.msg_iovlen = count;
+        ring_sendmsg(ring, conn->fd, &conn->ring_msg, conn);
+    }
+    conn->ring_op = RING_SEND;
+    return FALSE;
+}
+
+int complete_tcp_output(Connection* conn, RingOp op, int res) {
+    // A file that ends early would leave the reply short
+    if (res <= 0 || conn->out_head == NULL) return ERROR;
+
+    if (op == RING_READ_FILE) {
+        // The bytes belong to the first file chunk, memory chunks may precede it
+        OutChunk* chunk = conn->out_head;
+        while (chunk->file_fd < 0) chunk = chunk->next;
+        chunk->offset += res;
+        conn->bounce_len = res;
+        conn->bounce_done = 0;
+        return SUCCESS;
+    }
+
+    // Spread the bytes sent over the chunks, in the order they were gathered
+    size_t left = (size_t)res;
+    for (OutChunk* chunk = conn->out_head; chunk != NULL && left > 0; chunk = chunk->next) {
+        size_t n;
+        if (chunk->file_fd >= 0) {
+            n = conn->bounce_len - conn->bounce_done;
+            if (n > left) n = left;
+            conn->bounce_done += n;
+            chunk->len -= n;
+        } else {
+            n = chunk->len - chunk->sent;
+            if (n > left) n = left;
+            chunk->sent += n;
+        }
+        left -= n;
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,235 @@
+#include "../../include/utils.h"
+#include "../../include/globals.h"
+#include "../../common/verifications.h"
+
+static TaskQueue queue;
+
+// Every handler holds the state lock shared, only a WAL checkpoint and the
+// growth of the user table hold it alone
+static pthread_rwlock_t state_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+// Requests of one user run one at a time, each UID maps to one lock; events
+// are guarded by their own locks in events_manager.c
+static pthread_mutex_t user_locks[USER_LOCKS];
+
+static int task_queue_init(TaskQueue* q, size_t capacity) {
+    q->slots = calloc(capacity, sizeof(Request));
+    if (q->slots == NULL) return ERROR;
+    q->capacity = capacity;
+    q->head = 0;
+    q->count = 0;
+    if (pthread_mutex_init(&q->lock, NULL) != 0 ||
+        pthread_cond_init(&q->not_empty, NULL) != 0 ||
+        pthread_cond_init(&q->not_full, NULL) != 0) {
+        free(q->slots);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+// Blocks while the queue is full, pushing back on the event loop
+static void task_queue_push(TaskQueue* q, Request* req) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->capacity)
+        pthread_cond_wait(&q->not_full, &q->lock);
+
+    q->slots[(q->head + q->count) % q->capacity] = *req;
+    q->count++;
+
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static int task_queue_try_pop(TaskQueue* q, Request* req) {
+    pthread_mutex_lock(&q->lock);
+    if (q->count == 0) {
+        pthread_mutex_unlock(&q->lock);
+        return FALSE;
+    }
+
+    *req = q->slots[q->head];
+    q->head = (q->head + 1) % q->capacity;
+    q->count--;
+
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return TRUE;
+}
+
+static void task_queue_pop(TaskQueue* q, Request* req) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0)
+        pthread_cond_wait(&q->not_empty, &q->lock);
+
+    *req = q->slots[q->head];
+    q->head = (q->head + 1) % q->capacity;
+    q->count--;
+
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Requests that change state, and so need a working write-ahead log
+static int is_mutating_request(RequestType command) {
+    switch (command) {
+        case LIST:
+        case LIST_DELTA:
+        case SHOW:
+        case MYEVENTS:
+        case MYRESERVATIONS:
+        case KEEPALIVE:
+            return FALSE;
+        default:
+            return TRUE;
+    }
+}
+
+// Requests whose UID follows the command, as in "CMD UID ..."
+static int is_user_request(RequestType command) {
+    switch (command) {
+        case LOGIN:
+        case CHANGEPASS:
+        case UNREGISTER:
+        case LOGOUT:
+        case CREATE:
+        case CLOSE:
+        case MYEVENTS:
+        case RESERVE:
+        case MYRESERVATIONS:
+        case SESSION:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+// Lock of the user a request acts for, NULL if its UID is malformed
+static pthread_mutex_t* request_user_lock(const char* buffer, size_t length) {
+    if (length < COMMAND_LENGTH + 1 + UID_LENGTH) return NULL;
+    int key = 0;
+    for (int i = 0; i < UID_LENGTH; i++) {
+        char c = buffer[COMMAND_LENGTH + 1 + i];
+        if (!has_class(c, CLASS_DIGIT)) return NULL;
+        key = key * 10 + (c - '0');
+    }
+    return &user_locks[key % USER_LOCKS];
+}
+
+// Replaces whatever reply was prepared with ERR. A TCP connection is closed
+// afterwards, its request may not have been read to the end.
+static void refuse_request(Request* req) {
+    if (req->is_tcp) {
+        free_tcp_output(req->conn);
+        req->conn->keep_alive = FALSE;
+        send_tcp_response("ERR\n", req);
+    } else {
+        free(req->reply);
+        req->reply = NULL;
+        req->reply_len = 0;
+        send_udp_response("ERR\n", req);
+    }
+}
+
+// Hands the reply on, replaced with ERR when the changes it reports could not
+// be made durable. Called by the WAL flusher for parked requests.
+static void finish_task(Request* req, int durable) {
+    if (!durable) refuse_request(req);
+
+    // Hand the connection back to the event loop to flush the reply
+    if (req->is_tcp) connection_resume(req->conn);
+    else flush_udp_response(req);
+}
+
+void handle_task(Request* req) {
+    // Both UDP and buffered TCP requests start with the 3-letter command
+    char* command_buff = req->is_tcp ? read_buffer_peek(&req->conn->in) : req->buffer;
+    size_t length = req->is_tcp ? read_buffer_length(&req->conn->in) : strlen(req->buffer);
+    RequestType command = identify_command_request(command_buff);
+
+    // Changes that could not be made durable are not made at all
+    if (is_mutating_request(command) && !wal_writable()) {
+        refuse_request(req);
+        finish_task(req, TRUE);
+        return;
+    }
+
+    pthread_rwlock_rdlock(&state_lock);
+
+    // A registration may need a bigger user table, growing it moves every
+    // entry, so it is done with the state lock held alone
+    if (command == LOGIN && user_table_needs_growth()) {
+        pthread_rwlock_unlock(&state_lock);
+        pthread_rwlock_wrlock(&state_lock);
+        if (user_table_needs_growth()) user_table_grow();
+        pthread_rwlock_unlock(&state_lock);
+        pthread_rwlock_rdlock(&state_lock);
+    }
+
+    pthread_mutex_t* user_lock = is_user_request(command) ?
+                                 request_user_lock(command_buff, length) : NULL;
+    if (user_lock) pthread_mutex_lock(user_lock);
+
+    if (req->is_tcp) serve_tcp_request(req);
+    else handle_udp_request(req);
+
+    if (user_lock) pthread_mutex_unlock(user_lock);
+    pthread_rwlock_unlock(&state_lock);
+
+    // Group commit: the reply is parked until the flusher has synced the
+    // changes it reports, so neither the event loop nor a worker waits for
+    // the disk and other mutations join the same sync
+    uint64_t lsn = wal_take_thread_lsn();
+    if (lsn != 0) wal_park(lsn, req, finish_task);
+    else finish_task(req, TRUE);
+}
+
+int state_lock_exclusive(int wait) {
+    if (wait) return pthread_rwlock_wrlock(&state_lock) == 0;
+    return pthread_rwlock_trywrlock(&state_lock) == 0;
+}
+
+void state_unlock() {
+    pthread_rwlock_unlock(&state_lock);
+}
+
+static void* worker_main(void* arg) {
+    (void)arg;
+    Request req;
+    while (1) {
+        if (!task_queue_try_pop(&queue, &req)) {
+            // Queue ran dry: send the batched UDP replies before sleeping
+            send_udp_replies();
+            task_queue_pop(&queue, &req);
+        }
+        handle_task(&req);
+
+        // Under sustained load the queue never runs dry, bound the wait
+        send_due_udp_replies();
+    }
+    return NULL;
+}
+
+int thread_pool_setup() {
+    for (int i = 0; i < USER_LOCKS; i++) pthread_mutex_init(&user_locks[i], NULL);
+    if (set.n_workers == 0) return SUCCESS;
+
+    if (task_queue_init(&queue, set.queue_size) == ERROR) {
+        fprintf(stderr, "Failed to allocate request queue\n");
+        return ERROR;
+    }
+
+    for (int i = 0; i < set.n_workers; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker_main, NULL) != 0) {
+            perror("Failed to create worker thread");
+            return ERROR;
+        }
+        pthread_detach(thread);
+    }
+    return SUCCESS;
+}
+
+void dispatch_request(Request* req) {
+    if (set.n_workers == 0) handle_task(req);
+    else task_queue_push(&queue, req);
+}
@@ -0,0 +1,97 @@
+#include "../../include/utils.h"
+#include "../../include/globals.h"
+
+static void list_init(TimerNode* head) {
+    head->prev = head->next = head;
+}
+
+static void list_append(TimerNode* head, TimerNode* node) {
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+static void list_unlink(TimerNode* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = NULL;
+}
+
+// Files a timer in the slot matching its distance from the current tick
+static void wheel_place(TimerWheel* wheel, TimerNode* node) {
+    const uint64_t mask = TIMER_WHEEL_SLOTS - 1;
+    const uint64_t span = (uint64_t)TIMER_WHEEL_SLOTS << TIMER_WHEEL_BITS;
+    if (node->expires < wheel->now) node->expires = wheel->now;
+    if (node->expires - wheel->now > span - 1) node->expires = wheel->now + span - 1;
+
+    if (node->expires - wheel->now < TIMER_WHEEL_SLOTS)
+        list_append(&wheel->slots[0][node->expires & mask], node);
+    else
+        list_append(&wheel->slots[1][(node->expires >> TIMER_WHEEL_BITS) & mask], node);
+}
+
+uint64_t timer_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000) / TIMER_TICK_MS;
+}
+
+void timer_wheel_init(TimerWheel* wheel) {
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+            list_init(&wheel->slots[level][slot]);
+    wheel->now = timer_now();
+    wheel->armed = 0;
+}
+
+void timer_arm(TimerWheel* wheel, TimerNode* node, uint64_t timeout_ms) {
+    if (node->next != NULL) timer_cancel(wheel, node);
+    node->expires = timer_now() + (timeout_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    wheel_place(wheel, node);
+    wheel->armed++;
+}
+
+void timer_cancel(TimerWheel* wheel, TimerNode* node) {
+    if (node->next == NULL) return;
+    list_unlink(node);
+    wheel->armed--;
+}
+
+void timer_wheel_advance(TimerWheel* wheel, void (*fire)(TimerNode*)) {
+    const uint64_t mask = TIMER_WHEEL_SLOTS - 1;
+    uint64_t now = timer_now();
+
+    // Nothing to fire, skip the ticks
+    if (wheel->armed == 0) {
+        wheel->now = now;
+        return;
+    }
+
+    while (wheel->now < now) {
+        wheel->now++;
+
+        // A new turn of level 0: spread the matching level 1 slot over it
+        if ((wheel->now & mask) == 0) {
+            TimerNode* head = &wheel->slots[1][(wheel->now >> TIMER_WHEEL_BITS) & mask];
+            while (head->next != head) {
+                TimerNode* node = head->next;
+                list_unlink(node);
+                wheel_place(wheel, node);
+            }
+        }
+
+        // Unlinked before firing, the callback may free the node
+        TimerNode* head = &wheel->slots[0][wheel->now & mask];
+        while (head->next != head) {
+            TimerNode* node = head->next;
+            list_unlink(node);
+            wheel->armed--;
+            fire(node);
+        }
+    }
+}
+
+int timer_wheel_timeout(const TimerWheel* wheel) {
+    return wheel->armed > 0 ? TIMER_TICK_MS : -1;
+}
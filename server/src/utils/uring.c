@@ -0,0 +1,218 @@
+#define _GNU_SOURCE
+#include "../../include/utils.h"
+#include "../../include/globals.h"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// Raw io_uring: the loop queues SQEs while it handles completions and hands
+// the whole batch to the kernel in the same io_uring_enter() that waits for
+// the next completions. Only the owning loop thread touches its ring.
+
+static void* ring_map(int fd, size_t size, off_t offset) {
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+static void ring_close(Ring* ring) {
+    if (ring->sq_map != NULL) munmap(ring->sq_map, ring->sq_map_size);
+    if (ring->cq_map != NULL) munmap(ring->cq_map, ring->cq_map_size);
+    if (ring->sqes != NULL) munmap(ring->sqes, ring->sq_entries * sizeof(struct io_uring_sqe));
+    close(ring->fd);
+    ring->fd = -1;
+}
+
+static int ring_open(Ring* ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) return ERROR;
+
+    // Waiting with a timeout needs IORING_ENTER_EXT_ARG (Linux 5.11)
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        ring_close(ring);
+        errno = ENOSYS;
+        return ERROR;
+    }
+
+    ring->sq_entries = params.sq_entries;
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sq_map = ring_map(ring->fd, ring->sq_map_size, IORING_OFF_SQ_RING);
+    ring->cq_map = ring_map(ring->fd, ring->cq_map_size, IORING_OFF_CQ_RING);
+    ring->sqes = ring_map(ring->fd, params.sq_entries * sizeof(struct io_uring_sqe),
+                          IORING_OFF_SQES);
+    if (ring->sq_map == NULL || ring->cq_map == NULL || ring->sqes == NULL) {
+        ring_close(ring);
+        return ERROR;
+    }
+
+    char* sq = ring->sq_map;
+    char* cq = ring->cq_map;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return SUCCESS;
+}
+
+static int ring_enter(Ring* ring, unsigned wait, int timeout_ms) {
+    unsigned to_submit = *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    struct __kernel_timespec ts = {.tv_sec = timeout_ms / 1000,
+                                   .tv_nsec = (long long)(timeout_ms % 1000) * 1000000};
+    struct io_uring_getevents_arg arg = {.ts = timeout_ms >= 0 ? (uint64_t)(uintptr_t)&ts : 0};
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0;
+
+    long ret = syscall(__NR_io_uring_enter, ring->fd, to_submit, wait, flags,
+                       wait ? &arg : NULL, wait ? sizeof(arg) : 0);
+    if (ret < 0 && errno != ETIME && errno != EINTR) return ERROR;
+    return SUCCESS;
+}
+
+// Next free SQE, zeroed; a full submission queue is pushed to the kernel first
+static struct io_uring_sqe* ring_sqe(Ring* ring) {
+    unsigned tail = *ring->sq_tail;
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) == ring->sq_entries)
+        ring_enter(ring, 0, -1);
+
+    unsigned index = tail & ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+void ring_poll(Ring* ring, int fd, uint32_t events, void* tag) {
+    struct io_uring_sqe* sqe = ring_sqe(ring);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = (uint64_t)(uintptr_t)tag;
+}
+
+void ring_cancel(Ring* ring, void* tag) {
+    struct io_uring_sqe* sqe = ring_sqe(ring);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)tag;
+    sqe->user_data = 0;
+}
+
+// Socket transfers wait for readiness inside the kernel before they are
+// tried, so a non-blocking socket that is not ready is never failed with
+// -EAGAIN and the loop never retries in a spin
+static void ring_transfer(Ring* ring, uint8_t opcode, int fd, const void* buf, size_t len,
+                          void* tag) {
+    struct io_uring_sqe* sqe = ring_sqe(ring);
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)len;
+    sqe->ioprio = IORING_RECVSEND_POLL_FIRST;
+    sqe->user_data = (uint64_t)(uintptr_t)tag;
+}
+
+void ring_recv(Ring* ring, int fd, void* buf, size_t len, void* tag) {
+    ring_transfer(ring, IORING_OP_RECV, fd, buf, len, tag);
+}
+
+void ring_send(Ring* ring, int fd, const void* buf, size_t len, void* tag) {
+    ring_transfer(ring, IORING_OP_SEND, fd, buf, len, tag);
+}
+
+void ring_sendmsg(Ring* ring, int fd, const struct msghdr* msg, void* tag) {
+    ring_transfer(ring, IORING_OP_SENDMSG, fd, msg, 1, tag);
+}
+
+// File reads and writes at an offset, -1 for the file position
+static void ring_file_io(Ring* ring, uint8_t opcode, int fd, const void* buf, size_t len,
+                         off_t offset, void* tag) {
+    struct io_uring_sqe* sqe = ring_sqe(ring);
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)len;
+    sqe->off = (uint64_t)offset;
+    sqe->user_data = (uint64_t)(uintptr_t)tag;
+}
+
+void ring_read(Ring* ring, int fd, void* buf, size_t len, off_t offset, void* tag) {
+    ring_file_io(ring, IORING_OP_READ, fd, buf, len, offset, tag);
+}
+
+void ring_write(Ring* ring, int fd, const void* buf, size_t len, off_t offset, void* tag) {
+    ring_file_io(ring, IORING_OP_WRITE, fd, buf, len, offset, tag);
+}
+
+void ring_accept(Ring* ring, int fd, void* tag) {
+    struct io_uring_sqe* sqe = ring_sqe(ring);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = SOCK_NONBLOCK;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = (uint64_t)(uintptr_t)tag;
+}
+
+int ring_wait(Ring* ring, int timeout_ms) {
+    return ring_enter(ring, 1, timeout_ms);
+}
+
+int ring_reap(Ring* ring, void** tag, int* res, unsigned* flags) {
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) return FALSE;
+
+    struct io_uring_cqe* cqe = &ring->cqes[head & ring->cq_mask];
+    *tag = (void*)(uintptr_t)cqe->user_data;
+    *res = cqe->res;
+    *flags = cqe->flags;
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return TRUE;
+}
+
+// Multishot accept (Linux 5.19) and multishot poll (5.13) have no feature
+// bit, so both are tried on a scratch ring against an idle listening socket.
+// Older kernels reject them on submission with -EINVAL; newer ones leave
+// them pending until the scratch ring is closed.
+static int ring_probe() {
+    Ring probe;
+    if (ring_open(&probe, 4) == ERROR) return ERROR;
+
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0 || bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(sock, 1) < 0) {
+        if (sock >= 0) close(sock);
+        ring_close(&probe);
+        return ERROR;
+    }
+
+    ring_accept(&probe, sock, &probe);
+    ring_poll(&probe, sock, EPOLLIN | EPOLLET, &probe);
+    int status = ring_enter(&probe, 0, -1);
+
+    void* tag;
+    int res;
+    unsigned flags;
+    while (ring_reap(&probe, &tag, &res, &flags)) {
+        if (res == -EINVAL) status = ERROR;
+    }
+
+    ring_close(&probe);
+    close(sock);
+    if (status == ERROR) errno = EOPNOTSUPP;
+    return status;
+}
+
+int ring_setup(Ring* ring, unsigned entries) {
+    if (ring_probe() == ERROR) {
+        ring->fd = -1;
+        return ERROR;
+    }
+    return ring_open(ring, entries);
+}
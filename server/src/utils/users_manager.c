@@ -1,7 +1,274 @@
 #include "../../include/globals.h"
 #include "../../include/utils.h"
 #include "../../common/parser.h"
+#include "../../common/verifications.h"
+#include <sys/random.h>
+
+
+// Registered users keyed by numeric UID, with open addressing and linear
+// probing. An entry is only touched by requests holding its user's lock and
+// the table only grows under the exclusive state lock (see handle_task); the
+// disk copy is written by a persister thread from a queue of file operations.
+static UserEntry* users;
+static size_t users_cap;
+static _Atomic size_t users_used;     // live entries plus tombstones
+static pthread_mutex_t insert_lock = PTHREAD_MUTEX_INITIALIZER;   // claims free slots
+
+// File operations waiting for the persister, applied in order
+static PersistOp* persist_head;
+static PersistOp* persist_tail;
+static int persist_busy;
+static pthread_mutex_t persist_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t persist_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t persist_idle = PTHREAD_COND_INITIALIZER;
+
+// Reservation rings are changed by concurrent RIDs, each UID maps to one lock
+static pthread_mutex_t recent_locks[RECENT_LOCKS];
+
+// Returns the numeric key of a 6-digit UID, ERROR if malformed
+static int uid_key(const char* UID) {
+    int key = 0;
+    for (int i = 0; i < UID_LENGTH; i++) {
+        if (!has_class(UID[i], CLASS_DIGIT)) return ERROR;
+        key = key * 10 + (UID[i] - '0');
+    }
+    return UID[UID_LENGTH] == '\0' ? key : ERROR;
+}
+
+static size_t uid_slot(int key) {
+    // Fibonacci hashing spreads consecutive UIDs across the table
+    return ((uint32_t)key * 2654435769u) & (users_cap - 1);
+}
+
+static UserEntry* user_lookup(const char* UID) {
+    int key = uid_key(UID);
+    if (key == ERROR || users_cap == 0) return NULL;
+
+    for (size_t i = uid_slot(key); ; i = (i + 1) & (users_cap - 1)) {
+        if (users[i].uid == key) return &users[i];
+        if (users[i].uid == USER_SLOT_EMPTY) return NULL;
+    }
+}
+
+int user_table_needs_growth() {
+    // Growing at half load leaves room for the registrations already past this check
+    return (atomic_load(&users_used) + 1) * 2 > users_cap;
+}
+
+int user_table_grow() {
+    size_t old_cap = users_cap;
+    UserEntry* old = users;
+
+    users_cap = old_cap ? old_cap * 2 : USER_TABLE_SIZE;
+    users = malloc(users_cap * sizeof(UserEntry));
+    if (users == NULL) {
+        users = old;
+        users_cap = old_cap;
+        return ERROR;
+    }
+    for (size_t i = 0; i < users_cap; i++) users[i].uid = USER_SLOT_EMPTY;
+
+    // Reinsert live entries, dropping tombstones
+    users_used = 0;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i].uid < 0) continue;
+        size_t j = uid_slot(old[i].uid);
+        while (users[j].uid != USER_SLOT_EMPTY) j = (j + 1) & (users_cap - 1);
+        users[j] = old[i];
+        users_used++;
+    }
+    free(old);
+    return SUCCESS;
+}
+
+static UserEntry* user_insert(const char* UID, const char* password, int logged_in) {
+    int key = uid_key(UID);
+    if (key == ERROR) return NULL;
+
+    UserEntry* entry = user_lookup(UID);
+    if (entry != NULL) {
+        snprintf(entry->password, sizeof(entry->password), "%s", password);
+        entry->logged_in = logged_in;
+        return entry;
+    }
+
+    // Registrations of different users claim slots one at a time, an empty
+    // slot is always left to end the probes
+    pthread_mutex_lock(&insert_lock);
+    if (atomic_load(&users_used) + 1 >= users_cap) {
+        pthread_mutex_unlock(&insert_lock);
+        return NULL;
+    }
+    size_t i = uid_slot(key);
+    while (users[i].uid >= 0) i = (i + 1) & (users_cap - 1);
+    if (users[i].uid == USER_SLOT_EMPTY) users_used++;
+    entry = &users[i];
+    entry->recent = NULL;
+    memset(entry->created, 0, sizeof(entry->created));
+    entry->created_count = 0;
+    entry->token[0] = '\0';
+    entry->session_expiry = 0;
+    snprintf(entry->password, sizeof(entry->password), "%s", password);
+    entry->logged_in = logged_in;
+    entry->uid = key;
+    pthread_mutex_unlock(&insert_lock);
+    return entry;
+}
+
+static void persist_push(PersistKind kind, const char* UID, const char* password) {
+    PersistOp* op = malloc(sizeof(PersistOp));
+    if (op == NULL) {
+        server_log("User persistence queue allocation failed", NULL);
+        return;
+    }
+    op->next = NULL;
+    op->kind = kind;
+    snprintf(op->uid, sizeof(op->uid), "%s", UID);
+    snprintf(op->password, sizeof(op->password), "%s", password ? password : "");
+
+    pthread_mutex_lock(&persist_lock);
+    if (persist_tail) persist_tail->next = op;
+    else persist_head = op;
+    persist_tail = op;
+    pthread_cond_signal(&persist_ready);
+    pthread_mutex_unlock(&persist_lock);
+}
+
+// Blocks until every queued file operation reached the disk
+static void persist_drain() {
+    pthread_mutex_lock(&persist_lock);
+    while (persist_head != NULL || persist_busy)
+        pthread_cond_wait(&persist_idle, &persist_lock);
+    pthread_mutex_unlock(&persist_lock);
+}
+
+void wait_user_files() {
+    persist_drain();
+}
+
+void write_user_file(PersistKind kind, const char* UID, const char* password) {
+    char path[40];
+    FILE* fp;
+
+    switch (kind) {
+        case PERSIST_LOGIN:
+            snprintf(path, sizeof(path), "USERS/%s/%slogin.txt", UID, UID);
+            fp = fopen(path, "w");
+            if (fp == NULL) break;
+            fprintf(fp, "Logged in\n");
+            fclose(fp);
+            break;
+        case PERSIST_LOGOUT:
+            snprintf(path, sizeof(path), "USERS/%s/%slogin.txt", UID, UID);
+            unlink(path);
+            break;
+        case PERSIST_PASSWORD:
+            snprintf(path, sizeof(path), "USERS/%s/%spassword.txt", UID, UID);
+            fp = fopen(path, "w");
+            if (fp == NULL) break;
+            fprintf(fp, "%s", password);
+            fclose(fp);
+            break;
+    }
+}
+
+static void* persister_main(void* arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&persist_lock);
+        while (persist_head == NULL) {
+            pthread_cond_broadcast(&persist_idle);
+            pthread_cond_wait(&persist_ready, &persist_lock);
+        }
+        PersistOp* op = persist_head;
+        persist_head = op->next;
+        if (persist_head == NULL) persist_tail = NULL;
+        persist_busy = TRUE;
+        pthread_mutex_unlock(&persist_lock);
+
+        write_user_file(op->kind, op->uid, op->password);
+        free(op);
+
+        pthread_mutex_lock(&persist_lock);
+        persist_busy = FALSE;
+        pthread_mutex_unlock(&persist_lock);
+    }
+    return NULL;
+}
 
+// Marks an event as created by the user, counted once
+static void created_set(UserEntry* entry, int eid) {
+    uint64_t bit = (uint64_t)1 << (eid % 64);
+    if (entry->created[eid / 64] & bit) return;
+    entry->created[eid / 64] |= bit;
+    entry->created_count++;
+}
+
+// Indexes the events listed in the user's CREATED directory, read once at startup
+static void created_load(UserEntry* entry, const char* UID) {
+    char path[32];
+    snprintf(path, sizeof(path), "USERS/%s/CREATED", UID);
+    DIR* dir = opendir(path);
+    if (dir == NULL) return;
+
+    struct dirent* file;
+    while ((file = readdir(dir)) != NULL) {
+        if (verify_event_file(file->d_name) == INVALID) continue;
+        int eid = atoi(file->d_name);
+        if (eid >= 1 && eid <= MAX_EVENTS) created_set(entry, eid);
+    }
+    closedir(dir);
+}
+
+// Reads the password file written by a previous run
+static int read_password_file(const char* UID, char* password) {
+    char password_filename[40];
+    snprintf(password_filename, sizeof(password_filename), "USERS/%s/%spassword.txt", UID, UID);
+    FILE* fp = fopen(password_filename, "r");
+    if (fp == NULL) return ERROR;
+
+    size_t n = fread(password, 1, PASSWORD_LENGTH, fp);
+    fclose(fp);
+    if (n != PASSWORD_LENGTH) return ERROR;
+    password[PASSWORD_LENGTH] = '\0';
+    return SUCCESS;
+}
+
+int user_table_setup() {
+    if (user_table_grow() == ERROR) return ERROR;
+    for (int i = 0; i < RECENT_LOCKS; i++) pthread_mutex_init(&recent_locks[i], NULL);
+
+    DIR* dir = opendir("USERS");
+    if (dir != NULL) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            char UID[UID_LENGTH + 1];
+            char password[PASSWORD_LENGTH + 1];
+            if (uid_key(entry->d_name) == ERROR) continue;
+            memcpy(UID, entry->d_name, sizeof(UID));
+            if (read_password_file(UID, password) == ERROR) continue;
+
+            char login_filename[40];
+            snprintf(login_filename, sizeof(login_filename), "USERS/%s/%slogin.txt", UID, UID);
+            if (user_table_needs_growth()) user_table_grow();
+            UserEntry* user = user_insert(UID, password, file_exists(login_filename));
+            if (user == NULL) {
+                closedir(dir);
+                return ERROR;
+            }
+            created_load(user, UID);
+        }
+        closedir(dir);
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, persister_main, NULL) != 0) {
+        perror("pthread_create failed");
+        return ERROR;
+    }
+    pthread_detach(thread);
+    return SUCCESS;
+}
 
 int verify_correct_password(char* UID, char* password){
     char stored_password[PASSWORD_LENGTH + 1];
@@ -12,9 +279,7 @@ int verify_correct_password(char* UID, char* password){
 
 
 int user_exists(char* UID){
-    char UID_dirname[20];
-    sprintf(UID_dirname, "USERS/%s", UID);
-    return dir_exists(UID_dirname);
+    return user_lookup(UID) != NULL;
 }
 
 
@@ -24,6 +289,9 @@ int create_user (char* UID){
     char reserved_dirname[64];
     int ret;
 
+    // Directory changes must not overtake queued writes for the same UID
+    persist_drain();
+
     sprintf(UID_dirname, "USERS/%s", UID);
     ret = mkdir(UID_dirname, 0700);
     if (ret == -1) return ERROR;
@@ -46,6 +314,16 @@ int create_user (char* UID){
 }
 
 int remove_user(char* UID){
+    UserEntry* entry = user_lookup(UID);
+    if (entry) {
+        entry->uid = USER_SLOT_DELETED;
+        free(entry->recent);
+        entry->recent = NULL;
+    }
+    wal_log_unregister(UID);
+
+    persist_drain();
+
     char UID_dirname[32];
     sprintf(UID_dirname, "USERS/%s", UID);
     return remove_directory(UID_dirname);
@@ -56,6 +334,9 @@ int create_new_user(char* UID, char* password){
 
     ret = create_user(UID);
     if (ret == ERROR) return ERROR;
+    wal_log_register(UID);
+
+    if (user_insert(UID, password, FALSE) == NULL) return ERROR;
 
     ret = write_password(UID, password);
     if (ret == ERROR) return ERROR;
@@ -67,58 +348,91 @@ int create_new_user(char* UID, char* password){
 }
 
 int is_logged_in(char* UID){
-    char login_filename[35];
-    sprintf(login_filename, "USERS/%s/%slogin.txt", UID, UID);
-    return file_exists(login_filename);
+    UserEntry* entry = user_lookup(UID);
+    return entry && entry->logged_in ? TRUE : FALSE;
 }
 
 int write_login(char* UID){
-    char login_filename[35];
-    FILE* fp;
-
-    sprintf(login_filename, "USERS/%s/%slogin.txt", UID, UID);
-    fp = fopen(login_filename, "w");
-    if (fp == NULL) return ERROR;
-    fprintf(fp, "Logged in\n");
-    fclose(fp);
+    UserEntry* entry = user_lookup(UID);
+    if (entry == NULL) return ERROR;
+    entry->logged_in = TRUE;
+    wal_log_login(UID);
+    persist_push(PERSIST_LOGIN, UID, NULL);
     return SUCCESS;
 }
 
 int erase_login(char* UID){
-    char login_filename[35];
-    sprintf(login_filename, "USERS/%s/%slogin.txt", UID, UID);
-    unlink(login_filename);
+    UserEntry* entry = user_lookup(UID);
+    if (entry) {
+        entry->logged_in = FALSE;
+        entry->token[0] = '\0';
+    }
+    wal_log_logout(UID);
+    persist_push(PERSIST_LOGOUT, UID, NULL);
     return SUCCESS;
 }
 
-int get_password(char* UID, char* password){
-    char password_filename[40];
-    FILE* fp;
+// Compares without an early exit, so the time taken does not leak how much of a
+// guessed token is right
+static int token_equals(const char* a, const char* b) {
+    unsigned char diff = 0;
+    for (int i = 0; i < SESSION_TOKEN_LENGTH; i++) diff |= a[i] ^ b[i];
+    return diff == 0;
+}
 
-    sprintf(password_filename, "USERS/%s/%spassword.txt", UID, UID);
-    fp = fopen(password_filename, "r");
-    if (fp == NULL) return ERROR;
+int open_session(char* UID, char* token){
+    UserEntry* entry = user_lookup(UID);
+    if (entry == NULL) return ERROR;
+
+    // Clients of the same user share the live token instead of revoking each other's
+    if (entry->token[0] == '\0' || atomic_load(&entry->session_expiry) <= time(NULL)) {
+        unsigned char random[SESSION_TOKEN_LENGTH / 2];
+        if (getrandom(random, sizeof(random), 0) != (ssize_t)sizeof(random)) return ERROR;
+        for (size_t i = 0; i < sizeof(random); i++)
+            snprintf(entry->token + 2 * i, 3, "%02x", random[i]);
+    }
+    atomic_store(&entry->session_expiry, time(NULL) + SESSION_TIMEOUT_SECONDS);
+    memcpy(token, entry->token, SESSION_TOKEN_LENGTH + 1);
+    return SUCCESS;
+}
 
+int verify_credentials(char* UID, char* credential){
+    UserEntry* entry = user_lookup(UID);
+    if (entry == NULL) return ERROR;
 
-    if (fread(password, 1, PASSWORD_LENGTH, fp) != PASSWORD_LENGTH) {
-        fclose(fp);
-        return ERROR;
+    int status;
+    if (strlen(credential) == SESSION_TOKEN_LENGTH) {
+        status = entry->token[0] != '\0' && token_equals(entry->token, credential) &&
+                 atomic_load(&entry->session_expiry) > time(NULL) ? VALID : INVALID;
+    } else {
+        status = strcmp(entry->password, credential) == 0 ? VALID : INVALID;
     }
-    password[PASSWORD_LENGTH] = '\0';
-    fclose(fp);
+
+    // Clients fall back to the password for a stale token, which keeps a live
+    // session alive too. An expired token stays dead, only SES issues a new one.
+    time_t now = time(NULL);
+    time_t expiry = atomic_load(&entry->session_expiry);
+    if (status == VALID && entry->token[0] != '\0' && expiry > now)
+        atomic_compare_exchange_strong(&entry->session_expiry, &expiry, now + SESSION_TIMEOUT_SECONDS);
+    return status;
+}
+
+int get_password(char* UID, char* password){
+    UserEntry* entry = user_lookup(UID);
+    if (entry == NULL) return ERROR;
+    memcpy(password, entry->password, PASSWORD_LENGTH + 1);
     return SUCCESS;
 }
 
 int write_password(char* UID, char* password){
-    char password_filename[40];
-    FILE* fp;
-
-    sprintf(password_filename, "USERS/%s/%spassword.txt", UID, UID);
-    fp = fopen(password_filename, "w");
-    
-    if (fp == NULL) return ERROR;
-    fprintf(fp, "%s", password);
-    fclose(fp);
+    UserEntry* entry = user_lookup(UID);
+    if (entry == NULL) return ERROR;
+    snprintf(entry->password, sizeof(entry->password), "%s", password);
+    // A token leaked along with the old password must not outlive it
+    entry->token[0] = '\0';
+    atomic_store(&entry->session_expiry, 0);
+    wal_log_password(UID, password);
+    persist_push(PERSIST_PASSWORD, UID, password);
     return SUCCESS;
 }
 
@@ -127,107 +441,273 @@ int verify_event_file(char* event_file_name){
 
     // Check first 3 characters are digits
     for (int i = 0; i < 3; i++) {
-        if (!isdigit((unsigned char)event_file_name[i]))
+        if (!has_class(event_file_name[i], CLASS_DIGIT))
             return INVALID;
     }
     return strcmp(event_file_name + 3, ".txt") == 0 ? VALID : INVALID;
 }
 
 int verify_reservation_file(char* reservation_file_name){
-    if (strlen(reservation_file_name) != 27) return INVALID;
+    // "EID-DD-MM-YYYY HH:MM:SS-UID-SEQ.txt"
+    if (strlen(reservation_file_name) != 38) return INVALID;
 
     // Check first 3 characters are digits
     for (int i = 0; i < 3; i++) {
-        if (!isdigit((unsigned char)reservation_file_name[i]))
+        if (!has_class(reservation_file_name[i], CLASS_DIGIT))
             return INVALID;
     }
     return VALID;
 }
 
+int add_created_event(char* UID, char* EID){
+    UserEntry* entry = user_lookup(UID);
+    int eid = atoi(EID);
+    if (entry == NULL || eid < 1 || eid > MAX_EVENTS) return ERROR;
+    created_set(entry, eid);
+    return SUCCESS;
+}
+
+int count_user_events(char* UID){
+    UserEntry* entry = user_lookup(UID);
+    return entry ? entry->created_count : 0;
+}
+
 int has_events(char* UID){
-    char path[32];
-    snprintf(path, sizeof(path), "USERS/%s/CREATED", UID);
-    return is_dir_empty(path) ? FALSE : TRUE;
+    return count_user_events(UID) > 0 ? TRUE : FALSE;
 }
 
+int format_list_of_user_events(char* UID, char* message, size_t message_size) {
+    UserEntry* entry = user_lookup(UID);
+    if (entry == NULL) return ERROR;
+
+    size_t len = snprintf(message, message_size, "RME OK");
+    expire_event_deadlines();
+
+    // Walking the bitmap lists the EIDs in ascending order
+    for (int i = 0; i < EID_BITMAP_WORDS; i++) {
+        for (uint64_t word = entry->created[i]; word != 0; word &= word - 1) {
+            unsigned eid = (unsigned)(i * 64 + __builtin_ctzll(word));
+            char EID[EID_LENGTH + 1];
+            snprintf(EID, sizeof(EID), "%03u", eid % 1000);
+            if (len + MY_EVENTS_ENTRY_LENGTH + 1 >= message_size) return ERROR;
+            len += snprintf(message + len, message_size - len, " %s %c", EID,
+                            get_event_state(EID));
+        }
+    }
+    if (len + 2 > message_size) return ERROR;
+    memcpy(message + len, "\n", 2);
+    return SUCCESS;
+}
 
-int has_reservations(char* UID){
-    char path[32];
-    snprintf(path, sizeof(path), "USERS/%s/RESERVED", UID);
-    return is_dir_empty(path) ? FALSE : TRUE;
+
+// "DD-MM-YYYY HH:MM:SS" rearranged as "YYYYMMDDHHMMSS", which sorts by date
+static void datetime_key(const char* datetime, char* key, size_t key_size) {
+    snprintf(key, key_size, "%.4s%.2s%.2s%.2s%.2s%.2s", datetime + 6, datetime + 3,
+             datetime, datetime + 11, datetime + 14, datetime + 17);
 }
 
-int format_list_of_user_reservations(char* UID, char* response, size_t response_size) {
-    char path[128];
-    int count = 0;
-    snprintf(path, sizeof(path), "USERS/%s/RESERVED", UID);
+static int compare_reservations(const void* a, const void* b) {
+    char key_a[16], key_b[16];
+    datetime_key(((const ReservationEntry*)a)->datetime, key_a, sizeof(key_a));
+    datetime_key(((const ReservationEntry*)b)->datetime, key_b, sizeof(key_b));
+    return strcmp(key_a, key_b);
+}
 
-    struct dirent **namelist;
-    int n = scandir(path, &namelist, NULL, alphasort);
-    if (n < 0) {
-        perror("scandir");  
-        return ERROR;
+static int recent_contains(ReservationRing* ring, const ReservationEntry* reservation) {
+    for (int i = 0; i < ring->count; i++) {
+        ReservationEntry* entry = &ring->entries[(ring->head + i) % RECENT_RESERVATIONS];
+        if (entry->seats == reservation->seats && strcmp(entry->eid, reservation->eid) == 0 &&
+            strcmp(entry->datetime, reservation->datetime) == 0) return TRUE;
     }
+    return FALSE;
+}
+
+// Appends a reservation, the oldest one is dropped once the ring is full
+static void recent_push(ReservationRing* ring, const ReservationEntry* reservation) {
+    int slot = (ring->head + ring->count) % RECENT_RESERVATIONS;
+    if (ring->count == RECENT_RESERVATIONS) ring->head = (ring->head + 1) % RECENT_RESERVATIONS;
+    else ring->count++;
+    ring->entries[slot] = *reservation;
+}
 
-    int start = (n > 50) ? n - 50 : 0;
+// Parses "EID seats DD-MM-YYYY HH:MM:SS", the line format of the ring file and
+// of the RESERVED/ files
+static int parse_reservation(char* line, ReservationEntry* reservation) {
+    char seats[SEAT_COUNT_LENGTH + 1], date[DAY_STR_SIZE + 1], time[TIME_LENGTH + 4];
+    char* cursor = line;
+    if (get_next_arg(&cursor, reservation->eid) == ERROR ||
+        get_next_arg(&cursor, seats) == ERROR ||
+        get_next_arg(&cursor, date) == ERROR ||
+        get_next_arg(&cursor, time) == ERROR) return ERROR;
+    if (!verify_eid_format(reservation->eid) || !verify_reserved_seats(seats, "999")) return ERROR;
+    reservation->seats = atoi(seats);
+    snprintf(reservation->datetime, sizeof(reservation->datetime), "%s %s", date, time);
+    return SUCCESS;
+}
 
-    snprintf(response, response_size, "RMR OK");
+static int recent_read_file(const char* UID, ReservationRing* ring) {
+    char path[48];
+    snprintf(path, sizeof(path), "USERS/%s/%sreservations.txt", UID, UID);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) return ERROR;
 
-    for (int i = start; i < n; i++) {
-        struct dirent *entry = namelist[i];
-        
-        /* Skip "." and ".." */
-        if (strcmp(entry->d_name, ".") == 0 ||
-            strcmp(entry->d_name, "..") == 0) {
-            free(entry);
-            continue;
-        }   
+    char line[128];
+    ReservationEntry reservation;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (parse_reservation(line, &reservation) == SUCCESS) recent_push(ring, &reservation);
+    }
+    fclose(fp);
+    return SUCCESS;
+}
 
-        char file_path[512];
+// Rebuilds the ring from RESERVED/ for users whose reservations predate the ring file
+static void recent_scan_directory(const char* UID, ReservationRing* ring) {
+    char path[48];
+    snprintf(path, sizeof(path), "USERS/%s/RESERVED", UID);
+    DIR* dir = opendir(path);
+    if (dir == NULL) return;
+
+    ReservationEntry* all = NULL;
+    size_t count = 0, cap = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        char file_path[320];
         snprintf(file_path, sizeof(file_path), "%s/%s", path, entry->d_name);
-        FILE *fp = fopen(file_path, "r");
-        if (!fp) {
-            free(entry);
-            continue;
+        FILE* fp = fopen(file_path, "r");
+        if (fp == NULL) continue;
+        char line[128];
+        int read = fgets(line, sizeof(line), fp) != NULL;
+        fclose(fp);
+
+        if (count == cap) {
+            size_t new_cap = cap ? cap * 2 : RECENT_RESERVATIONS;
+            ReservationEntry* grown = realloc(all, new_cap * sizeof(ReservationEntry));
+            if (grown == NULL) break;
+            all = grown;
+            cap = new_cap;
         }
+        if (read && parse_reservation(line, &all[count]) == SUCCESS) count++;
+    }
+    closedir(dir);
 
-        char eid[EID_LENGTH + 1] = {0};
-        char reserved_seats[SEAT_COUNT_LENGTH + 1] ={0};
-        char date[DAY_STR_SIZE + 1] = {0};    
-        char time[TIME_LENGTH + 4] = {0};
-        char file_content[128] = {0};
+    // File names start with the EID, so only the parsed dates give the real order
+    qsort(all, count, sizeof(ReservationEntry), compare_reservations);
+    size_t start = count > RECENT_RESERVATIONS ? count - RECENT_RESERVATIONS : 0;
+    for (size_t i = start; i < count; i++) recent_push(ring, &all[i]);
+    free(all);
+}
 
-        if (fgets(file_content, sizeof(file_content), fp) == NULL) {
-            fclose(fp);
-            free(entry);
-            continue;
-        }
-        char *cursor = file_content;
-        if(get_next_arg(&cursor, eid) == ERROR ||
-           get_next_arg(&cursor, reserved_seats) == ERROR ||
-           get_next_arg(&cursor, date) == ERROR ||
-           get_next_arg(&cursor, time) == ERROR) {
-            fclose(fp);
-            free(entry);
-            continue;
-        }
-        if(!verify_eid_format(eid) ||
-           !verify_reserved_seats(reserved_seats, "999")) {
-            fclose(fp);
-            free(entry);
-            continue;
-        }
+// Rewrites the ring file in one step, oldest reservation first
+static int recent_write_file(const char* UID, ReservationRing* ring) {
+    char path[48], tmp_path[48];
+    snprintf(path, sizeof(path), "USERS/%s/%sreservations.txt", UID, UID);
+    snprintf(tmp_path, sizeof(tmp_path), "USERS/%s/.%sreservations.tmp", UID, UID);
 
-        // Append reservation info to response
-        char temp[64];
-        snprintf(temp, sizeof(temp), " %s %s %s %s", eid, date, time, reserved_seats);
-        strncat(response, temp, response_size - strlen(response) - 1);
-        count++;
-        fclose(fp);
-        free(entry);
+    FILE* fp = fopen(tmp_path, "w");
+    if (fp == NULL) return ERROR;
+    for (int i = 0; i < ring->count; i++) {
+        ReservationEntry* entry = &ring->entries[(ring->head + i) % RECENT_RESERVATIONS];
+        fprintf(fp, "%s %d %s\n", entry->eid, entry->seats, entry->datetime);
+    }
+    if (fclose(fp) != 0 || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+static void recent_load(const char* UID, ReservationRing* ring) {
+    memset(ring, 0, sizeof(*ring));
+    if (recent_read_file(UID, ring) == SUCCESS) return;
+    recent_scan_directory(UID, ring);
+    recent_write_file(UID, ring);
+}
+
+// Returns the user's ring, loading it on first use; called with its UID's lock held
+static ReservationRing* recent_ring(UserEntry* entry, const char* UID) {
+    if (entry->recent == NULL) {
+        ReservationRing* ring = malloc(sizeof(ReservationRing));
+        if (ring == NULL) return NULL;
+        recent_load(UID, ring);
+        entry->recent = ring;
+    }
+    return entry->recent;
+}
+
+static pthread_mutex_t* recent_lock(const char* UID) {
+    return &recent_locks[uid_key(UID) % RECENT_LOCKS];
+}
+
+int add_recent_reservation(char* UID, char* EID, int num_seats, const char* datetime) {
+    UserEntry* entry = user_lookup(UID);
+    if (entry == NULL) return ERROR;
+
+    ReservationEntry reservation = {.seats = num_seats};
+    snprintf(reservation.eid, sizeof(reservation.eid), "%s", EID);
+    snprintf(reservation.datetime, sizeof(reservation.datetime), "%s", datetime);
+
+    pthread_mutex_t* lock = recent_lock(UID);
+    pthread_mutex_lock(lock);
+    ReservationRing* ring = recent_ring(entry, UID);
+    int status = ERROR;
+    if (ring != NULL) {
+        // A ring first loaded from RESERVED/ already holds this reservation
+        if (!recent_contains(ring, &reservation)) recent_push(ring, &reservation);
+        status = recent_write_file(UID, ring);
+    }
+    pthread_mutex_unlock(lock);
+    return status;
+}
+
+void replay_recent_reservation(char* UID, char* EID, int num_seats, const char* datetime) {
+    ReservationRing ring;
+    ReservationEntry reservation = {.seats = num_seats};
+    snprintf(reservation.eid, sizeof(reservation.eid), "%s", EID);
+    snprintf(reservation.datetime, sizeof(reservation.datetime), "%s", datetime);
+
+    recent_load(UID, &ring);
+    if (recent_contains(&ring, &reservation)) return;
+    recent_push(&ring, &reservation);
+    recent_write_file(UID, &ring);
+}
+
+int has_reservations(char* UID){
+    UserEntry* entry = user_lookup(UID);
+    if (entry == NULL) return FALSE;
+
+    pthread_mutex_t* lock = recent_lock(UID);
+    pthread_mutex_lock(lock);
+    ReservationRing* ring = recent_ring(entry, UID);
+    int count = ring ? ring->count : 0;
+    pthread_mutex_unlock(lock);
+    return count > 0 ? TRUE : FALSE;
+}
+
+int format_list_of_user_reservations(char* UID, char* response, size_t response_size) {
+    UserEntry* entry = user_lookup(UID);
+    if (entry == NULL) return ERROR;
+
+    pthread_mutex_t* lock = recent_lock(UID);
+    pthread_mutex_lock(lock);
+    ReservationRing* ring = recent_ring(entry, UID);
+    if (ring == NULL) {
+        pthread_mutex_unlock(lock);
+        return ERROR;
+    }
+
+    // PROTOCOL: RMR OK [EID date time seats]*, oldest first
+    size_t len = snprintf(response, response_size, "RMR OK");
+    for (int i = 0; i < ring->count && len < response_size; i++) {
+        ReservationEntry* reservation = &ring->entries[(ring->head + i) % RECENT_RESERVATIONS];
+        len += snprintf(response + len, response_size - len, " %s %s %d",
+                        reservation->eid, reservation->datetime, reservation->seats);
     }
+    int count = ring->count;
+    pthread_mutex_unlock(lock);
 
-    free(namelist);
-    strncat(response, "\n", response_size - strlen(response) - 1);
+    // A truncated list would read as a complete one, refuse it instead
+    if (len + 2 > response_size) return ERROR;
+    memcpy(response + len, "\n", 2);
     return count;
 }
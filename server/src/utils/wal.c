@@ -0,0 +1,307 @@
+#define _GNU_SOURCE
+#include "../../include/utils.h"
+#include "../../include/globals.h"
+#include <stdarg.h>
+
+// Append-only log of every state mutation. Handlers append records to an
+// in-memory batch; a flusher thread writes the batch and fdatasync()s it, so
+// one sync covers every record that arrived while the previous one ran.
+static int wal_fd = -1;
+static char* wal_batch;
+static size_t wal_batch_len;
+static size_t wal_batch_cap;
+static uint64_t wal_appended;    // LSN of the last appended record
+static uint64_t wal_durable;     // LSN of the last record known to be on disk
+static int wal_broken;           // a write or sync failed, nothing is durable any more
+static size_t wal_size;          // bytes written since the last checkpoint, flusher only
+static pthread_mutex_t wal_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wal_pending = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t wal_synced = PTHREAD_COND_INITIALIZER;
+static WalWaiter* wal_waiters;   // parked requests, finished by the flusher
+
+// LSN of the last record appended by the calling thread, 0 if none
+static _Thread_local uint64_t thread_lsn;
+
+static void wal_append(const char* format, ...) {
+    char record[WAL_RECORD_SIZE];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(record, sizeof(record), format, args);
+    va_end(args);
+    if (len < 0 || (size_t)len >= sizeof(record)) {
+        server_log("WAL record too long, dropped", NULL);
+        return;
+    }
+
+    pthread_mutex_lock(&wal_lock);
+    if (wal_broken) {
+        // The record can never become durable, the caller's reply is refused
+        thread_lsn = ++wal_appended;
+        pthread_mutex_unlock(&wal_lock);
+        return;
+    }
+    if (wal_batch_cap - wal_batch_len < (size_t)len) {
+        size_t new_cap = wal_batch_cap ? wal_batch_cap * 2 : WAL_BATCH_SIZE;
+        while (new_cap - wal_batch_len < (size_t)len) new_cap *= 2;
+        char* grown = realloc(wal_batch, new_cap);
+        if (grown == NULL) {
+            pthread_mutex_unlock(&wal_lock);
+            server_log("WAL batch allocation failed", NULL);
+            return;
+        }
+        wal_batch = grown;
+        wal_batch_cap = new_cap;
+    }
+    memcpy(wal_batch + wal_batch_len, record, len);
+    wal_batch_len += len;
+    thread_lsn = ++wal_appended;
+    pthread_cond_signal(&wal_pending);
+    pthread_mutex_unlock(&wal_lock);
+}
+
+// Makes every logged change durable in the USERS/ and EVENTS/ files and
+// empties the log. Handlers log and apply their changes while they hold the
+// state lock shared, so holding it exclusively means every record in the log
+// has been applied.
+// A busy lock is retried after the next flush, until the log is so far past
+// the limit that the flusher waits for it.
+static void wal_checkpoint() {
+    if (!state_lock_exclusive(wal_size >= 4 * WAL_CHECKPOINT_SIZE)) return;
+
+    // User file changes are applied by the persister thread, after the fact
+    wait_user_files();
+    if (syncfs(wal_fd) != 0 || ftruncate(wal_fd, 0) != 0) {
+        server_log("WAL checkpoint failed, keeping the log", NULL);
+    } else {
+        wal_size = 0;
+        if (set.verbose) printf("WAL checkpointed\n");
+    }
+    state_unlock();
+}
+
+static void* wal_flusher_main(void* arg) {
+    (void)arg;
+    char* spare = NULL;
+    size_t spare_cap = 0;
+
+    while (1) {
+        pthread_mutex_lock(&wal_lock);
+        while (wal_batch_len == 0)
+            pthread_cond_wait(&wal_pending, &wal_lock);
+
+        // Take the whole batch, appenders continue into the spare buffer
+        char* batch = wal_batch;
+        size_t len = wal_batch_len;
+        size_t cap = wal_batch_cap;
+        uint64_t target = wal_appended;
+        wal_batch = spare;
+        wal_batch_cap = spare_cap;
+        wal_batch_len = 0;
+        pthread_mutex_unlock(&wal_lock);
+
+        // A failed write may leave a torn record in the middle of the log, so
+        // the log is given up for good rather than retried
+        int failed = tcp_write(wal_fd, batch, len) == ERROR || fdatasync(wal_fd) != 0;
+        if (failed) server_log("WAL write failed, refusing further changes", NULL);
+
+        spare = batch;
+        spare_cap = cap;
+
+        pthread_mutex_lock(&wal_lock);
+        if (failed) {
+            wal_broken = TRUE;
+            wal_batch_len = 0;
+        } else {
+            wal_durable = target;
+        }
+        pthread_cond_broadcast(&wal_synced);
+
+        // Take the parked requests this sync settled, whether durable or failed
+        WalWaiter* settled = NULL;
+        for (WalWaiter** link = &wal_waiters; *link != NULL; ) {
+            WalWaiter* waiter = *link;
+            if (failed || waiter->lsn <= target) {
+                *link = waiter->next;
+                waiter->next = settled;
+                settled = waiter;
+            } else {
+                link = &waiter->next;
+            }
+        }
+        pthread_mutex_unlock(&wal_lock);
+
+        while (settled != NULL) {
+            WalWaiter* waiter = settled;
+            settled = waiter->next;
+            waiter->done(&waiter->req, !failed);
+            free(waiter);
+        }
+        // UDP replies finished above were batched by this thread
+        send_udp_replies();
+
+        // Records appended meanwhile wait in the batch and go to the emptied log
+        if (!failed) wal_size += len;
+        if (!failed && wal_size >= WAL_CHECKPOINT_SIZE) wal_checkpoint();
+    }
+    return NULL;
+}
+
+// Re-applies one logged mutation to the USERS/ and EVENTS/ files.
+// Records carry absolute values, so applying one twice is harmless.
+static void wal_replay_record(char* line) {
+    char type[COMMAND_LENGTH + 1], uid[UID_LENGTH + 1], eid[EID_LENGTH + 1];
+    char password[PASSWORD_LENGTH + 1], name[MAX_EVENT_NAME + 1];
+    char file_name[FILE_NAME_LENGTH + 1], seats[SEAT_COUNT_LENGTH + 1];
+    char date[DAY_STR_SIZE + 1], time_str[TIME_STR_SIZE + 4];
+    char datetime[EVENT_DATE_LENGHT_W_SECONDS + 1];
+    int num_seats, total;
+
+    if (sscanf(line, "%3s", type) != 1) return;
+
+    if (strcmp(type, "REG") == 0 && sscanf(line, "REG %6s", uid) == 1) {
+        create_user(uid);
+    } else if (strcmp(type, "UNR") == 0 && sscanf(line, "UNR %6s", uid) == 1) {
+        char dirname[32];
+        snprintf(dirname, sizeof(dirname), "USERS/%s", uid);
+        if (dir_exists(dirname)) remove_directory(dirname);
+    } else if (strcmp(type, "LIN") == 0 && sscanf(line, "LIN %6s", uid) == 1) {
+        write_user_file(PERSIST_LOGIN, uid, NULL);
+    } else if (strcmp(type, "LOU") == 0 && sscanf(line, "LOU %6s", uid) == 1) {
+        write_user_file(PERSIST_LOGOUT, uid, NULL);
+    } else if (strcmp(type, "CPS") == 0 && sscanf(line, "CPS %6s %8s", uid, password) == 2) {
+        write_user_file(PERSIST_PASSWORD, uid, password);
+    } else if (strcmp(type, "CRE") == 0 &&
+               sscanf(line, "CRE %3s %6s %10s %24s %3s %10s %5s", eid, uid, name,
+                      file_name, seats, date, time_str) == 7) {
+        char event_date[EVENT_DATE_LENGTH + 1];
+        snprintf(event_date, sizeof(event_date), "%s %.5s", date, time_str);
+        create_eid_dir(atoi(eid));
+        write_event_start_file(eid, uid, name, file_name, seats, event_date);
+        write_event_information_file(eid, uid, name, file_name, seats, event_date);
+        update_reservations_file(eid, 0);
+    } else if (strcmp(type, "RES") == 0 &&
+               sscanf(line, "RES %3s %6s %d %d %10s %8s", eid, uid, &num_seats, &total,
+                      date, time_str) == 6) {
+        snprintf(datetime, sizeof(datetime), "%s %s", date, time_str);
+        update_reservations_file(eid, total);
+        write_reservation(uid, eid, num_seats, total, datetime);
+        replay_recent_reservation(uid, eid, num_seats, datetime);
+    } else if (strcmp(type, "CLS") == 0 &&
+               sscanf(line, "CLS %3s %10s %8s", eid, date, time_str) == 3) {
+        snprintf(datetime, sizeof(datetime), "%s %s", date, time_str);
+        write_event_end_file(eid, datetime);
+    }
+}
+
+int wal_setup() {
+    wal_fd = open(WAL_PATH, O_RDWR | O_CREAT | O_APPEND, 0600);
+    if (wal_fd < 0) {
+        perror("Failed to open WAL");
+        return ERROR;
+    }
+
+    // Bring the files up to date with everything acknowledged before a crash
+    FILE* fp = fopen(WAL_PATH, "r");
+    if (fp != NULL) {
+        char line[WAL_RECORD_SIZE];
+        int replayed = 0;
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            // A torn final record was never acknowledged
+            if (strchr(line, '\n') == NULL) break;
+            wal_replay_record(line);
+            replayed++;
+        }
+        fclose(fp);
+
+        if (replayed > 0) {
+            // The replayed files must reach the disk before the log goes
+            syncfs(wal_fd);
+            if (set.verbose) printf("Replayed %d WAL records\n", replayed);
+        }
+    }
+    if (ftruncate(wal_fd, 0) != 0) {
+        perror("Failed to truncate WAL");
+        return ERROR;
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, wal_flusher_main, NULL) != 0) {
+        perror("Failed to create WAL flusher");
+        return ERROR;
+    }
+    pthread_detach(thread);
+    return SUCCESS;
+}
+
+uint64_t wal_take_thread_lsn() {
+    uint64_t lsn = thread_lsn;
+    thread_lsn = 0;
+    return lsn;
+}
+
+void wal_park(uint64_t lsn, Request* req, void (*done)(Request* req, int durable)) {
+    WalWaiter* waiter = malloc(sizeof(WalWaiter));
+
+    pthread_mutex_lock(&wal_lock);
+    if (wal_durable < lsn && !wal_broken) {
+        if (waiter != NULL) {
+            waiter->lsn = lsn;
+            waiter->done = done;
+            waiter->req = *req;
+            waiter->next = wal_waiters;
+            wal_waiters = waiter;
+            pthread_mutex_unlock(&wal_lock);
+            return;
+        }
+        // Nowhere to park it: waiting here is all that keeps the reply behind the sync
+        server_log("WAL waiter allocation failed", NULL);
+        while (wal_durable < lsn && !wal_broken)
+            pthread_cond_wait(&wal_synced, &wal_lock);
+    }
+    int durable = wal_durable >= lsn;
+    pthread_mutex_unlock(&wal_lock);
+
+    free(waiter);
+    done(req, durable);
+}
+
+int wal_writable() {
+    pthread_mutex_lock(&wal_lock);
+    int writable = !wal_broken;
+    pthread_mutex_unlock(&wal_lock);
+    return writable;
+}
+
+void wal_log_register(const char* UID) {
+    wal_append("REG %s\n", UID);
+}
+
+void wal_log_unregister(const char* UID) {
+    wal_append("UNR %s\n", UID);
+}
+
+void wal_log_login(const char* UID) {
+    wal_append("LIN %s\n", UID);
+}
+
+void wal_log_logout(const char* UID) {
+    wal_append("LOU %s\n", UID);
+}
+
+void wal_log_password(const char* UID, const char* password) {
+    wal_append("CPS %s %s\n", UID, password);
+}
+
+void wal_log_create(const char* EID, const char* UID, const char* event_name,
+                    const char* file_name, const char* seat_count, const char* event_date) {
+    wal_append("CRE %s %s %s %s %s %s\n", EID, UID, event_name, file_name, seat_count, event_date);
+}
+
+void wal_log_reserve(const char* EID, const char* UID, int num_seats, int reserved_total,
+                     const char* datetime) {
+    wal_append("RES %s %s %d %d %s\n", EID, UID, num_seats, reserved_total, datetime);
+}
+
+void wal_log_close(const char* EID, const char* datetime) {
+    wal_append("CLS %s %s\n", EID, datetime);
+}
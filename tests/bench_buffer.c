@@ -0,0 +1,116 @@
+#include "harness.h"
+#include "buffer.h"
+#include <stdlib.h>
+#include <time.h>
+
+// read() calls and time per message when splitting a stream of requests and
+// an RLS reply into fields, byte by byte as tcp_read_field() used to and
+// through a ReadBuffer. Calls are counted with syscr from /proc/thread-self/io.
+
+#define REQUEST_ROUNDS 2000
+#define LIST_EVENTS 200
+
+static const char* const requests[] = {
+    "RID 123456 password 001 2\n",
+    "LIN 123456 password\n",
+    "SED 014\n",
+    "CRE 123456 password Party 25-12-2099 14:30 100 desc.txt 12 hello world!\n",
+    "LST\n",
+};
+
+static unsigned long long read_calls() {
+    FILE* fp = fopen("/proc/thread-self/io", "r");
+    if (fp == NULL) return 0;
+    char line[64];
+    unsigned long long calls = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "syscr: %llu", &calls) == 1) break;
+    }
+    fclose(fp);
+    return calls;
+}
+
+// tcp_read_field() before ReadBuffer: one read() per byte
+static int byte_read_field(int fd, char* buffer, size_t max_len) {
+    size_t i = 0;
+    char c;
+    if (read(fd, &c, 1) <= 0) return ERROR;
+    if (c != ' ') buffer[i++] = c;
+    while (i < max_len) {
+        if (read(fd, &c, 1) <= 0) return ERROR;
+        if (c == ' ' || c == '\n') {
+            buffer[i] = '\0';
+            return c == ' ' ? SUCCESS : EOM;
+        }
+        buffer[i++] = c;
+    }
+    buffer[i] = '\0';
+    return SUCCESS;
+}
+
+static int buffered_read_field(ReadBuffer* rb, char* buffer, size_t max_len) {
+    return tcp_read_field(rb, buffer, max_len);
+}
+
+// Parses every message in the file, returns how many ended
+static int parse(FILE* file, int buffered) {
+    int fd = fileno(file);
+    lseek(fd, 0, SEEK_SET);
+    ReadBuffer rb;
+    read_buffer_init(&rb, fd, READ_BUFFER_SIZE);
+
+    char field[BUFFER_SIZE];
+    int messages = 0, status;
+    while (1) {
+        status = buffered ? buffered_read_field(&rb, field, 32)
+                          : byte_read_field(fd, field, 32);
+        if (status == ERROR) break;
+        if (status == EOM) messages++;
+    }
+    read_buffer_free(&rb);
+    return messages;
+}
+
+static void bench(const char* name, FILE* file) {
+    for (int buffered = 0; buffered <= 1; buffered++) {
+        struct timespec start, end;
+        unsigned long long before = read_calls();
+        unsigned long long probe = read_calls() - before;    // cost of reading the counter
+        before = read_calls();
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int messages = parse(file, buffered);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        unsigned long long calls = read_calls() - before - probe;
+
+        double us = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+        printf("%-8s %-10s %9.3f read()/message %9.3f us/message\n", name,
+               buffered ? "ReadBuffer" : "bytewise", (double)calls / messages, us / messages);
+    }
+}
+
+int main() {
+    FILE* stream = tmpfile();
+    FILE* list = tmpfile();
+    if (stream == NULL || list == NULL) return EXIT_FAILURE;
+
+    for (int round = 0; round < REQUEST_ROUNDS; round++) {
+        for (size_t i = 0; i < sizeof(requests) / sizeof(requests[0]); i++)
+            fputs(requests[i], stream);
+    }
+    fflush(stream);
+
+    // RLS replies as the client parses them
+    for (int round = 0; round < 20; round++) {
+        fputs("RLS OK", list);
+        for (int eid = 1; eid <= LIST_EVENTS; eid++)
+            fprintf(list, " %03d Event%d %d 25-12-2099 14:30", eid, eid, eid % 4);
+        fputc('\n', list);
+    }
+    fflush(list);
+
+    bench("requests", stream);
+    bench("RLS", list);
+    fclose(stream);
+    fclose(list);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+#include "harness.h"
+#include <stdlib.h>
+#include <time.h>
+
+// Time per lookup of the packed-code switches against the strncmp chains they
+// replaced, over a request and reply mix like the server's and client's
+
+#define SAMPLES 4096
+#define PASSES 2000
+
+// In the order the old chains tested them
+static const char* const request_chain[] = {
+    "LIN", "CPS", "UNR", "LOU", "CRE", "CLS", "LME", "LST", "SED", "RID", "LMR",
+};
+static const char* const status_chain[] = {
+    "ERR", "OK", "NOK", "REG", "NLG", "WRP", "UNR", "NID", "NOE", "SLD", "PST",
+    "CLS", "ACC", "REJ", "CLO",
+};
+
+// Reservations and listings dominate, with some logins and event lookups
+static const char* const request_mix[] = {
+    "RID 100001 password 001 2\n", "RID 100002 password 014 1\n", "LST\n", "LST\n",
+    "SED 001\n", "SED 014\n", "LIN 100001 password\n", "LME 100001 password\n",
+    "LMR 100001 password\n", "CRE 100001 password ...", "LOU 100001 password\n", "XYZ\n",
+};
+static const char* const status_mix[] = {
+    "OK", "OK", "OK", "ACC", "ACC", "REJ", "SLD", "NOK", "NLG", "WRP", "ERR", "CLO",
+};
+
+static const char* samples[SAMPLES];
+
+static int request_by_chain(const char* code) {
+    for (size_t i = 0; i < sizeof(request_chain) / sizeof(request_chain[0]); i++)
+        if (strncmp(code, request_chain[i], 3) == 0) return (int)i;
+    return UNKNOWN;
+}
+
+static int status_by_chain(const char* code) {
+    for (size_t i = 0; i < sizeof(status_chain) / sizeof(status_chain[0]); i++)
+        if (strcmp(code, status_chain[i]) == 0) return (int)i;
+    return STATUS_UNEXPECTED_RESPONSE;
+}
+
+static int request_by_switch(const char* code) { return identify_command_request((char*)code); }
+static int status_by_switch(const char* code) { return identify_status_code(code); }
+
+static double ns_per_lookup(int (*identify)(const char*)) {
+    struct timespec start, end;
+    volatile int sink = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int pass = 0; pass < PASSES; pass++) {
+        for (int i = 0; i < SAMPLES; i++) sink += identify(samples[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    (void)sink;
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    return ns / ((double)PASSES * SAMPLES);
+}
+
+static void bench(const char* name, const char* const* mix, size_t mix_len,
+                  int (*by_switch)(const char*), int (*by_chain)(const char*)) {
+    unsigned seed = 7;
+    for (int i = 0; i < SAMPLES; i++) samples[i] = mix[rand_r(&seed) % mix_len];
+    printf("%-9s switch %5.2f ns  strcmp chain %5.2f ns\n", name,
+           ns_per_lookup(by_switch), ns_per_lookup(by_chain));
+}
+
+int main() {
+    bench("requests", request_mix, sizeof(request_mix) / sizeof(request_mix[0]),
+          request_by_switch, request_by_chain);
+    bench("statuses", status_mix, sizeof(status_mix) / sizeof(status_mix[0]),
+          status_by_switch, status_by_chain);
+    return EXIT_SUCCESS;
+}
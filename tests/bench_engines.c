@@ -0,0 +1,80 @@
+#include "harness.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+// LST and SED requests per second on the epoll engine and on io_uring (-u),
+// from concurrent TCP clients against the same event table
+
+#define CLIENTS 8
+#define REQUESTS_PER_CLIENT 500
+#define EVENTS 200
+#define DESCRIPTION_SIZE 65536
+
+static TestServer server;
+
+typedef struct {
+    const char* request;
+    int failures;
+} Client;
+
+static void* client_main(void* arg) {
+    Client* client = arg;
+    size_t reply_size = DESCRIPTION_SIZE + BUFFER_SIZE;
+    char* reply = malloc(reply_size);
+    for (int i = 0; i < REQUESTS_PER_CLIENT; i++) {
+        ssize_t len = tcp_exchange(&server, client->request, strlen(client->request),
+                                   reply, reply_size);
+        if (len <= 0 || (strncmp(reply, "RLS OK", 6) != 0 && strncmp(reply, "RSE OK", 6) != 0))
+            client->failures++;
+    }
+    free(reply);
+    return NULL;
+}
+
+static void bench(const char* engine, const char* name, const char* request) {
+    pthread_t threads[CLIENTS];
+    Client clients[CLIENTS];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < CLIENTS; i++) {
+        clients[i] = (Client){.request = request};
+        pthread_create(&threads[i], NULL, client_main, &clients[i]);
+    }
+    int failures = 0;
+    for (int i = 0; i < CLIENTS; i++) {
+        pthread_join(threads[i], NULL);
+        failures += clients[i].failures;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%-8s %s %9.0f requests/s%s\n", engine, name,
+           CLIENTS * REQUESTS_PER_CLIENT / seconds, failures ? "  (failures)" : "");
+}
+
+int main() {
+    static const struct {
+        const char* name;
+        const char* args[2];
+    } engines[] = {
+        {"epoll", {NULL}},
+        {"io_uring", {"-u", NULL}},
+    };
+
+    for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+        if (server_start(&server, engines[e].args) == ERROR) return EXIT_FAILURE;
+
+        char reply[BUFFER_SIZE];
+        udp_exchange(&server, "LIN 100001 password\n", reply, sizeof(reply));
+        for (int i = 0; i < EVENTS; i++)
+            create_event(&server, "100001", "password", 100, i == 0 ? DESCRIPTION_SIZE : 1,
+                         reply, sizeof(reply));
+
+        bench(engines[e].name, "LST", "LST\n");
+        bench(engines[e].name, "SED", "SED 001\n");
+        server_stop(&server);
+    }
+    return EXIT_SUCCESS;
+}
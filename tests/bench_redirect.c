@@ -0,0 +1,83 @@
+#include "harness.h"
+#include <stdlib.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+// Loss rate of LME under a burst of UDP requests, for a list that fits one
+// datagram and for one that is redirected to TCP. Every request in a burst
+// is sent before any reply is read; redirected requests are then fetched
+// over TCP like the client does.
+
+#define BURST 256
+#define ROUNDS 20
+#define LONG_LIST_EVENTS 240
+
+static TestServer server;
+
+// Sends a burst of LMEs, returns how many replies arrived and how many of
+// them were redirects
+static int burst(const char* request, int* redirects) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(server.port),
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    for (int i = 0; i < BURST; i++)
+        sendto(fd, request, strlen(request), 0, (struct sockaddr*)&addr, sizeof(addr));
+
+    int replies = 0;
+    char reply[2048];
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    while (replies < BURST && poll(&pfd, 1, 200) > 0) {
+        ssize_t n = recv(fd, reply, sizeof(reply) - 1, 0);
+        if (n <= 0) break;
+        reply[n] = '\0';
+        replies++;
+        if (strcmp(reply, "RME TCP\n") == 0) (*redirects)++;
+    }
+    close(fd);
+    return replies;
+}
+
+static void bench(const char* name) {
+    const char* request = "LME 100001 password\n";
+    int replies = 0, redirects = 0, fetched = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < ROUNDS; round++) {
+        int round_redirects = 0;
+        replies += burst(request, &round_redirects);
+        redirects += round_redirects;
+        for (int i = 0; i < round_redirects; i++) {
+            char reply[TCP_BUFFER_SIZE * 4];
+            if (tcp_exchange(&server, request, strlen(request), reply, sizeof(reply)) > 0 &&
+                strncmp(reply, "RME OK ", 7) == 0)
+                fetched++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    int sent = BURST * ROUNDS;
+    int complete = replies - redirects + fetched;
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    const char* engine = getenv("SERVER_ARGS");
+    printf("LME %-6s %5.1f%% lost  %5.1f%% via TCP  %8.0f complete lists/s%s%s\n", name,
+           100.0 * (sent - replies) / sent, 100.0 * redirects / sent, complete / seconds,
+           engine && engine[0] ? "  " : "", engine ? engine : "");
+}
+
+int main() {
+    if (server_start(&server, NULL) == ERROR) return EXIT_FAILURE;
+
+    char reply[BUFFER_SIZE];
+    udp_exchange(&server, "LIN 100001 password\n", reply, sizeof(reply));
+    create_event(&server, "100001", "password", 999, 1, reply, sizeof(reply));
+    bench("short");
+
+    for (int i = 2; i <= LONG_LIST_EVENTS; i++)
+        create_event(&server, "100001", "password", 999, 1, reply, sizeof(reply));
+    bench("long");
+
+    server_stop(&server);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+#define _GNU_SOURCE
+#include "harness.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <time.h>
+
+// SED throughput for a MAX_FILE_SIZE description on each send path, the
+// fallbacks forced with the refuse_io.so shim as in test_sed
+
+#define DOWNLOADS 20
+
+static const struct {
+    const char* name;
+    const char* refuse;
+} paths[] = {
+    {"sendfile", NULL},
+    {"splice", "sendfile"},
+    {"copy", "sendfile,splice"},
+};
+
+int main() {
+    char shim[PATH_MAX];
+    if (realpath("refuse_io.so", shim) == NULL) {
+        perror("refuse_io.so");
+        return EXIT_FAILURE;
+    }
+    size_t reply_size = MAX_FILE_SIZE + BUFFER_SIZE;
+    char* sed_reply = malloc(reply_size);
+    if (sed_reply == NULL) return EXIT_FAILURE;
+
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        TestServer server;
+        if (paths[i].refuse != NULL) {
+            setenv("LD_PRELOAD", shim, 1);
+            setenv("REFUSE_IO", paths[i].refuse, 1);
+        }
+        int started = server_start(&server, NULL);
+        unsetenv("LD_PRELOAD");
+        unsetenv("REFUSE_IO");
+        if (started == ERROR) return EXIT_FAILURE;
+
+        char reply[BUFFER_SIZE];
+        udp_exchange(&server, "LIN 100001 password\n", reply, sizeof(reply));
+        create_event(&server, "100001", "password", 100, MAX_FILE_SIZE, reply, sizeof(reply));
+
+        struct timespec start, end;
+        size_t bytes = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int d = 0; d < DOWNLOADS; d++) {
+            ssize_t len = tcp_exchange(&server, "SED 001\n", 8, sed_reply, reply_size);
+            if (len > 0) bytes += len;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        server_stop(&server);
+
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        const char* engine = getenv("SERVER_ARGS");
+        printf("SED %-8s %8.1f MB/s  %6.2f ms per 10 MB file%s%s\n", paths[i].name,
+               bytes / seconds / (1024 * 1024), seconds * 1000 / DOWNLOADS,
+               engine && engine[0] ? "  " : "", engine ? engine : "");
+    }
+    free(sed_reply);
+    return EXIT_SUCCESS;
+}
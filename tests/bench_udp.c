@@ -0,0 +1,69 @@
+#include "harness.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+// LIN/LOU requests per second from concurrent UDP clients, each logging its
+// own user in and out, with one event loop and with one per core (-w)
+
+#define CLIENTS 32
+#define REQUESTS_PER_CLIENT 1000
+
+static TestServer server;
+
+typedef struct {
+    int index;
+    int failures;
+} Client;
+
+static void* client_main(void* arg) {
+    Client* client = arg;
+    char login[64], logout[64], reply[BUFFER_SIZE];
+    snprintf(login, sizeof(login), "LIN %06d password\n", 200000 + client->index);
+    snprintf(logout, sizeof(logout), "LOU %06d password\n", 200000 + client->index);
+
+    for (int i = 0; i < REQUESTS_PER_CLIENT; i += 2) {
+        // The first login registers the user
+        if (udp_exchange(&server, login, reply, sizeof(reply)) <= 0 ||
+            (strcmp(reply, "RLI OK\n") != 0 && strcmp(reply, "RLI REG\n") != 0))
+            client->failures++;
+        if (udp_exchange(&server, logout, reply, sizeof(reply)) <= 0 ||
+            strcmp(reply, "RLO OK\n") != 0)
+            client->failures++;
+    }
+    return NULL;
+}
+
+static void bench(const char* name, const char* const* args) {
+    if (server_start(&server, args) == ERROR) exit(EXIT_FAILURE);
+
+    pthread_t threads[CLIENTS];
+    Client clients[CLIENTS];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < CLIENTS; i++) {
+        clients[i] = (Client){.index = i};
+        pthread_create(&threads[i], NULL, client_main, &clients[i]);
+    }
+    int failures = 0;
+    for (int i = 0; i < CLIENTS; i++) {
+        pthread_join(threads[i], NULL);
+        failures += clients[i].failures;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    server_stop(&server);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    const char* engine = getenv("SERVER_ARGS");
+    printf("LIN/LOU %-8s %9.0f requests/s%s%s%s\n", name,
+           CLIENTS * REQUESTS_PER_CLIENT / seconds, failures ? "  (failures)" : "",
+           engine && engine[0] ? "  " : "", engine ? engine : "");
+}
+
+int main() {
+    const char* const loops[] = {"-w", "4", NULL};
+    bench("1 loop", NULL);
+    bench("4 loops", loops);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,238 @@
+#define _GNU_SOURCE
+#include "harness.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <ftw.h>
+#include <limits.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define MAX_SERVER_ARGS 16
+#define START_ATTEMPTS 5
+#define REPLY_TIMEOUT_SECONDS 5
+
+int test_failures;
+
+static struct sockaddr_in server_addr(TestServer* srv) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(srv->port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return addr;
+}
+
+static void set_timeout(int fd) {
+    struct timeval tv = {.tv_sec = REPLY_TIMEOUT_SECONDS};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+// Splits SERVER_ARGS on spaces into argv, returns the next free slot
+static int environment_args(char** argv, int argc, char* copy, size_t copy_size) {
+    const char* extra = getenv("SERVER_ARGS");
+    if (extra == NULL) return argc;
+    snprintf(copy, copy_size, "%s", extra);
+    char* save = NULL;
+    for (char* arg = strtok_r(copy, " ", &save); arg && argc < MAX_SERVER_ARGS - 1;
+         arg = strtok_r(NULL, " ", &save))
+        argv[argc++] = arg;
+    return argc;
+}
+
+static pid_t spawn_server(TestServer* srv, const char* es_path, const char* const* extra_args) {
+    char port[8], env_copy[256];
+    char* argv[MAX_SERVER_ARGS];
+    int argc = 0;
+
+    snprintf(port, sizeof(port), "%d", srv->port);
+    argv[argc++] = (char*)es_path;
+    argv[argc++] = "-p";
+    argv[argc++] = port;
+    argc = environment_args(argv, argc, env_copy, sizeof(env_copy));
+    for (int i = 0; extra_args && extra_args[i] && argc < MAX_SERVER_ARGS - 1; i++)
+        argv[argc++] = (char*)extra_args[i];
+    argv[argc] = NULL;
+
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+
+    // Keep test output readable, the server logs to stdout
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    if (chdir(srv->dir) != 0) _exit(EXIT_FAILURE);
+    execv(es_path, argv);
+    _exit(EXIT_FAILURE);
+}
+
+// The server is up once an unknown UDP request is answered with ERR
+static int wait_until_ready(TestServer* srv) {
+    for (int i = 0; i < 50; i++) {
+        int status;
+        if (waitpid(srv->pid, &status, WNOHANG) == srv->pid) return ERROR;
+
+        char reply[16];
+        struct timespec pause = {.tv_nsec = 20 * 1000 * 1000};
+        nanosleep(&pause, NULL);
+
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        struct timeval tv = {.tv_usec = 100 * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        struct sockaddr_in addr = server_addr(srv);
+        sendto(fd, "XXX\n", 4, 0, (struct sockaddr*)&addr, sizeof(addr));
+        ssize_t n = recv(fd, reply, sizeof(reply), 0);
+        close(fd);
+        if (n > 0) return SUCCESS;
+    }
+    return ERROR;
+}
+
+int server_start(TestServer* srv, const char* const* extra_args) {
+    char es_path[PATH_MAX];
+    if (realpath("../server/ES", es_path) == NULL) {
+        perror("../server/ES");
+        return ERROR;
+    }
+
+    snprintf(srv->dir, sizeof(srv->dir), "/tmp/es_test_XXXXXX");
+    if (mkdtemp(srv->dir) == NULL) return ERROR;
+    char path[128];
+    snprintf(path, sizeof(path), "%s/USERS", srv->dir);
+    mkdir(path, 0700);
+    snprintf(path, sizeof(path), "%s/EVENTS", srv->dir);
+    mkdir(path, 0700);
+
+    // A port taken by someone else makes the server exit, try another one
+    srand((unsigned)getpid() ^ (unsigned)time(NULL));
+    for (int attempt = 0; attempt < START_ATTEMPTS; attempt++) {
+        srv->port = 20000 + rand() % 40000;
+        srv->pid = spawn_server(srv, es_path, extra_args);
+        if (srv->pid < 0) break;
+        if (wait_until_ready(srv) == SUCCESS) return SUCCESS;
+        kill(srv->pid, SIGKILL);
+        waitpid(srv->pid, NULL, 0);
+    }
+    fprintf(stderr, "Could not start the server\n");
+    srv->pid = -1;
+    server_stop(srv);
+    return ERROR;
+}
+
+static int remove_entry(const char* path, const struct stat* sb, int flag, struct FTW* ftw) {
+    (void)sb;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+void server_stop(TestServer* srv) {
+    if (srv->pid > 0) {
+        kill(srv->pid, SIGINT);
+        waitpid(srv->pid, NULL, 0);
+        srv->pid = -1;
+    }
+    if (srv->dir[0] != '\0' && getenv("KEEP_TEST_DIR") == NULL)
+        nftw(srv->dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+int udp_exchange(TestServer* srv, const char* request, char* reply, size_t reply_size) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return ERROR;
+    set_timeout(fd);
+
+    struct sockaddr_in addr = server_addr(srv);
+    ssize_t n = -1;
+    if (sendto(fd, request, strlen(request), 0, (struct sockaddr*)&addr, sizeof(addr)) >= 0)
+        n = recv(fd, reply, reply_size - 1, 0);
+    close(fd);
+    if (n < 0) return ERROR;
+    reply[n] = '\0';
+    return (int)n;
+}
+
+int tcp_connect(TestServer* srv) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return ERROR;
+    set_timeout(fd);
+
+    struct sockaddr_in addr = server_addr(srv);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return ERROR;
+    }
+    return fd;
+}
+
+ssize_t tcp_exchange(TestServer* srv, const char* request, size_t request_len,
+                     char* reply, size_t reply_size) {
+    int fd = tcp_connect(srv);
+    if (fd == ERROR) return ERROR;
+
+    for (size_t sent = 0; sent < request_len; ) {
+        ssize_t n = send(fd, request + sent, request_len - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            close(fd);
+            return ERROR;
+        }
+        sent += n;
+    }
+
+    size_t len = 0;
+    while (len < reply_size - 1) {
+        ssize_t n = recv(fd, reply + len, reply_size - 1 - len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += n;
+    }
+    close(fd);
+    reply[len] = '\0';
+    return (ssize_t)len;
+}
+
+ssize_t create_event(TestServer* srv, const char* UID, const char* password, int seats,
+                     size_t file_size, char* reply, size_t reply_size) {
+    char header[BUFFER_SIZE];
+    int header_len = snprintf(header, sizeof(header),
+                              "CRE %s %s Party 25-12-2099 14:30 %d desc.txt %zu ",
+                              UID, password, seats, file_size);
+
+    char* request = malloc(header_len + file_size + 1);
+    if (request == NULL) return ERROR;
+    memcpy(request, header, header_len);
+    for (size_t i = 0; i < file_size; i++) request[header_len + i] = 'a' + i % 26;
+    request[header_len + file_size] = '\n';
+
+    ssize_t n = tcp_exchange(srv, request, header_len + file_size + 1, reply, reply_size);
+    free(request);
+    return n;
+}
+
+const char* sed_file_data(const char* reply, size_t reply_len, size_t* size) {
+    // RSE OK UID name date time total reserved file_name size data
+    if (reply_len < 7 || strncmp(reply, "RSE OK ", 7) != 0) return NULL;
+    const char* field = reply;
+    for (int spaces = 0; spaces < 9; spaces++) {
+        field = memchr(field, ' ', reply + reply_len - field);
+        if (field == NULL) return NULL;
+        field++;
+    }
+    const char* data = memchr(field, ' ', reply + reply_len - field);
+    if (data == NULL) return NULL;
+    *size = strtoul(field, NULL, 10);
+    data++;
+    if ((size_t)(reply + reply_len - data) != *size + 1 || data[*size] != '\n') return NULL;
+    return data;
+}
+
+int test_summary(const char* name) {
+    const char* engine = getenv("SERVER_ARGS");
+    printf("%s %s%s%s\n", test_failures == 0 ? "PASS" : "FAIL", name,
+           engine && engine[0] ? " " : "", engine ? engine : "");
+    return test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,113 @@
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "common.h"
+
+// A server started for one test, in a fresh working directory
+typedef struct {
+    pid_t pid;
+    int port;
+    char dir[64];
+} TestServer;
+
+extern int test_failures;
+
+// Records a failed check with its location, the test keeps running
+#define CHECK(cond, ...) do {                                              \
+        if (!(cond)) {                                                     \
+            test_failures++;                                               \
+            fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__,         \
+                    __LINE__, #cond);                                      \
+            fprintf(stderr, __VA_ARGS__);                                  \
+            fputc('\n', stderr);                                           \
+        }                                                                  \
+    } while (0)
+
+/**
+ * @brief Starts ../server/ES on a free port in an empty USERS/ EVENTS/ tree.
+ *
+ * Arguments in the SERVER_ARGS environment variable (e.g. "-u") are passed
+ * after the port, followed by extra_args.
+ *
+ * @param srv Filled with the server's pid, port and working directory
+ * @param extra_args NULL-terminated list of arguments, or NULL
+ * @return int SUCCESS once the server answers, ERROR otherwise
+ */
+int server_start(TestServer* srv, const char* const* extra_args);
+
+/**
+ * @brief Stops the server and removes its working directory.
+ *
+ * @param srv Server started with server_start()
+ */
+void server_stop(TestServer* srv);
+
+/**
+ * @brief Sends one UDP request and waits for its reply.
+ *
+ * @param srv Server
+ * @param request Request text, newline included
+ * @param reply Buffer for the NUL-terminated reply
+ * @param reply_size Size of reply
+ * @return int Reply length, ERROR on timeout or failure
+ */
+int udp_exchange(TestServer* srv, const char* request, char* reply, size_t reply_size);
+
+/**
+ * @brief Opens a TCP connection to the server.
+ *
+ * @param srv Server
+ * @return int Connected socket, ERROR on failure
+ */
+int tcp_connect(TestServer* srv);
+
+/**
+ * @brief Sends a TCP request and reads the reply until the server closes.
+ *
+ * @param srv Server
+ * @param request Request bytes
+ * @param request_len Length of request
+ * @param reply Buffer for the NUL-terminated reply
+ * @param reply_size Size of reply
+ * @return ssize_t Reply length, ERROR on failure
+ */
+ssize_t tcp_exchange(TestServer* srv, const char* request, size_t request_len,
+                     char* reply, size_t reply_size);
+
+/**
+ * @brief Sends a CRE with a generated description file.
+ *
+ * @param srv Server
+ * @param UID Creator's UID, logged in
+ * @param password Creator's password
+ * @param seats Seat count
+ * @param file_size Size of the description file
+ * @param reply Buffer for the NUL-terminated reply
+ * @param reply_size Size of reply
+ * @return ssize_t Reply length, ERROR on failure
+ */
+ssize_t create_event(TestServer* srv, const char* UID, const char* password, int seats,
+                     size_t file_size, char* reply, size_t reply_size);
+
+/**
+ * @brief Finds the description file in an RSE OK reply.
+ *
+ * @param reply Reply to SED
+ * @param reply_len Length of reply
+ * @param size Set to the file size announced in the header
+ * @return const char* First byte of the file, NULL if the reply is not a
+ *         complete RSE OK
+ */
+const char* sed_file_data(const char* reply, size_t reply_len, size_t* size);
+
+/**
+ * @brief Prints the test's result.
+ *
+ * @param name Test name
+ * @return int Process exit status, 0 if every check passed
+ */
+int test_summary(const char* name);
+
+#endif
@@ -0,0 +1,43 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+
+// LD_PRELOAD shim for the server: the calls named in REFUSE_IO (e.g.
+// "sendfile,splice") fail with EINVAL, as on a filesystem or socket that does
+// not support them. The first refusal of each call leaves a refused_<call>
+// file in the server's working directory, so the test can tell the fallback
+// really ran.
+
+static int refused(const char* call) {
+    const char* list = getenv("REFUSE_IO");
+    if (list == NULL || strstr(list, call) == NULL) return 0;
+
+    char marker[32];
+    snprintf(marker, sizeof(marker), "refused_%s", call);
+    int fd = open(marker, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd >= 0) close(fd);
+    errno = EINVAL;
+    return 1;
+}
+
+ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count) {
+    static ssize_t (*next)(int, int, off_t*, size_t);
+    if (refused("sendfile")) return -1;
+    if (next == NULL) next = (ssize_t (*)(int, int, off_t*, size_t))dlsym(RTLD_NEXT, "sendfile");
+    return next(out_fd, in_fd, offset, count);
+}
+
+ssize_t splice(int fd_in, loff_t* off_in, int fd_out, loff_t* off_out, size_t len,
+               unsigned int flags) {
+    static ssize_t (*next)(int, loff_t*, int, loff_t*, size_t, unsigned int);
+    if (refused("splice")) return -1;
+    if (next == NULL)
+        next = (ssize_t (*)(int, loff_t*, int, loff_t*, size_t, unsigned int))dlsym(RTLD_NEXT, "splice");
+    return next(fd_in, off_in, fd_out, off_out, len, flags);
+}
@@ -0,0 +1,35 @@
+#ifndef SCALAR_NAMES_H
+#define SCALAR_NAMES_H
+
+// ../common/verifications.c is built a second time without __SSE2__ and with
+// SCALAR_VERIFICATIONS, forcing this header in first: its symbols get a
+// scalar_ prefix so both builds link into the same test
+
+#ifdef SCALAR_VERIFICATIONS
+#define char_class scalar_char_class
+#define is_number scalar_is_number
+#define is_valid_port scalar_is_valid_port
+#define is_valid_seat_count scalar_is_valid_seat_count
+#define verify_uid_format scalar_verify_uid_format
+#define verify_eid_format scalar_verify_eid_format
+#define verify_password_format scalar_verify_password_format
+#define verify_session_token_format scalar_verify_session_token_format
+#define verify_credential_format scalar_verify_credential_format
+#define verify_argument_count scalar_verify_argument_count
+#define verify_event_name_format scalar_verify_event_name_format
+#define verify_event_date_format scalar_verify_event_date_format
+#define verify_seat_count scalar_verify_seat_count
+#define verify_reserved_seats scalar_verify_reserved_seats
+#define verify_file_name_format scalar_verify_file_name_format
+#define verify_file_size scalar_verify_file_size
+#define convert_to_3_digit scalar_convert_to_3_digit
+#else
+// The validators that have an SSE2 path, as built without it
+int scalar_verify_uid_format(char* uid);
+int scalar_verify_password_format(char* password);
+int scalar_verify_session_token_format(char* token);
+int scalar_verify_credential_format(char* credential);
+int scalar_verify_event_date_format(char* date_str);
+#endif
+
+#endif
@@ -0,0 +1,131 @@
+#include "harness.h"
+#include "buffer.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+
+// ReadBuffer on input cut into small pieces: the writer waits for the pipe
+// to drain before sending the next piece, so every read() returns at most
+// one piece and fields and file data straddle refills
+
+#define STREAM \
+    "CRE 123456 password Party 25-12-2099 14:30 100 desc.txt 12 hello world!\n" \
+    "LST\n" \
+    "RID 123456 password 001 2\n" \
+    "SED 0123456789\n"
+
+typedef struct {
+    int fd;
+    size_t max_piece;
+    unsigned seed;
+} Writer;
+
+// Writes STREAM in pieces of 1 to max_piece bytes, then closes the pipe
+static void* writer_main(void* arg) {
+    Writer* writer = arg;
+    const char* stream = STREAM;
+    size_t len = strlen(stream);
+    for (size_t sent = 0; sent < len; ) {
+        size_t piece = 1 + rand_r(&writer->seed) % writer->max_piece;
+        if (piece > len - sent) piece = len - sent;
+        if (write(writer->fd, stream + sent, piece) != (ssize_t)piece) break;
+        sent += piece;
+
+        // A reader that stopped early is not waited for long
+        int pending = 1;
+        for (int spins = 0; spins < 100000 && pending > 0; spins++) {
+            if (ioctl(writer->fd, FIONREAD, &pending) < 0) break;
+            if (pending > 0) sched_yield();
+        }
+    }
+    close(writer->fd);
+    return NULL;
+}
+
+static void expect_field(ReadBuffer* rb, size_t max_len, const char* expected, int status) {
+    const char* field;
+    size_t len;
+    int got = read_buffer_slice(rb, &field, &len, max_len);
+    CHECK(got == status && len == strlen(expected) && memcmp(field, expected, len) == 0,
+          "slice %d \"%.*s\", expected %d \"%s\"", got, got == ERROR ? 0 : (int)len,
+          got == ERROR ? "" : field, status, expected);
+}
+
+static void parse_stream(int fd, size_t capacity) {
+    ReadBuffer rb;
+    CHECK(read_buffer_init(&rb, fd, capacity) == SUCCESS, "init");
+
+    const char* cre[] = {"CRE", "123456", "password", "Party", "25-12-2099", "14:30",
+                         "100", "desc.txt", "12"};
+    for (size_t i = 0; i < sizeof(cre) / sizeof(cre[0]); i++)
+        expect_field(&rb, 16, cre[i], SUCCESS);
+    const char* data = read_buffer_take(&rb, 12);
+    CHECK(data != NULL && memcmp(data, "hello world!", 12) == 0, "file data");
+    expect_field(&rb, 16, "", EOM);
+
+    expect_field(&rb, 3, "LST", SUCCESS);     // cut at max_len, the newline stays
+    expect_field(&rb, 16, "", EOM);
+
+    const char* rid[] = {"RID", "123456", "password", "001"};
+    for (size_t i = 0; i < sizeof(rid) / sizeof(rid[0]); i++)
+        expect_field(&rb, 16, rid[i], SUCCESS);
+    expect_field(&rb, 16, "2", EOM);
+
+    // Bytes dropped from the middle of the unread ones are never handed out
+    expect_field(&rb, 16, "SED", SUCCESS);
+    while (read_buffer_length(&rb) < 11) {
+        if (read_buffer_fill(&rb) <= 0) break;
+    }
+    read_buffer_drop(&rb, 2, 6);
+    expect_field(&rb, 16, "0189", EOM);
+
+    // The peer closed: nothing more to hand out
+    const char* field;
+    size_t len;
+    CHECK(read_buffer_slice(&rb, &field, &len, 16) == ERROR, "slice after close");
+    CHECK(read_buffer_take(&rb, 1) == NULL, "take after close");
+
+    read_buffer_free(&rb);
+    close(fd);
+}
+
+int main() {
+    signal(SIGPIPE, SIG_IGN);     // a failed parse stops reading early
+
+    // Whole writes, then pieces down to single bytes, with room for all of it
+    // or a buffer that has to grow and compact
+    const size_t pieces[] = {4096, 16, 7, 1};
+    const size_t capacities[] = {READ_BUFFER_SIZE, 8, 1};
+    for (size_t p = 0; p < sizeof(pieces) / sizeof(pieces[0]); p++) {
+        for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++) {
+            for (unsigned seed = 1; seed <= 20; seed++) {
+                int fds[2];
+                if (pipe(fds) < 0) return EXIT_FAILURE;
+                Writer writer = {.fd = fds[1], .max_piece = pieces[p], .seed = seed};
+                pthread_t thread;
+                pthread_create(&thread, NULL, writer_main, &writer);
+                parse_stream(fds[0], capacities[c]);
+                pthread_join(thread, NULL);
+            }
+        }
+    }
+
+    // A field cut short by the peer closing is an error, not a field
+    int fds[2];
+    if (pipe(fds) == 0) {
+        write(fds[1], "LIN 1234", 8);
+        close(fds[1]);
+        ReadBuffer rb;
+        read_buffer_init(&rb, fds[0], 4);
+        expect_field(&rb, 16, "LIN", SUCCESS);
+        const char* field;
+        size_t len;
+        CHECK(read_buffer_slice(&rb, &field, &len, 16) == ERROR, "truncated field");
+        read_buffer_free(&rb);
+        close(fds[0]);
+    }
+
+    return test_summary("buffer");
+}
@@ -0,0 +1,118 @@
+#include "harness.h"
+#include <stdlib.h>
+
+// Table test of the packed 3-byte code switches: every protocol code maps to
+// its value, and every other short string maps to UNKNOWN (or the status
+// equivalent), exactly as the strcmp chains they replaced
+
+typedef struct {
+    const char* code;
+    int value;
+} CodeEntry;
+
+static const CodeEntry requests[] = {
+    {"LIN", LOGIN}, {"CPS", CHANGEPASS}, {"UNR", UNREGISTER}, {"LOU", LOGOUT},
+    {"CRE", CREATE}, {"CLS", CLOSE}, {"LME", MYEVENTS}, {"LST", LIST},
+    {"SED", SHOW}, {"RID", RESERVE}, {"LMR", MYRESERVATIONS}, {"KAL", KEEPALIVE},
+    {"LSD", LIST_DELTA}, {"SES", SESSION},
+};
+
+static const CodeEntry responses[] = {
+    {"RLI", LOGIN}, {"RCP", CHANGEPASS}, {"RUR", UNREGISTER}, {"RLO", LOGOUT},
+    {"REX", EXIT}, {"RCE", CREATE}, {"RCL", CLOSE}, {"RME", MYEVENTS},
+    {"RLS", LIST}, {"RSE", SHOW}, {"RRI", RESERVE}, {"RMR", MYRESERVATIONS},
+    {"RKA", KEEPALIVE}, {"RLD", LIST_DELTA}, {"RSS", SESSION}, {"ERR", ERROR_REQUEST},
+};
+
+static const CodeEntry statuses[] = {
+    {"ERR", STATUS_ERROR}, {"OK", STATUS_OK}, {"NOK", STATUS_NOK},
+    {"REG", STATUS_REGISTERED}, {"NLG", STATUS_NOT_LOGGED_IN},
+    {"WRP", STATUS_WRONG_PASSWORD}, {"UNR", STATUS_USER_NOT_REGISTERED},
+    {"NID", STATUS_USER_NOT_FOUND}, {"NOE", STATUS_NO_EVENT_ID},
+    {"SLD", STATUS_EVENT_SOLD_OUT}, {"PST", STATUS_PAST_EVENT},
+    {"CLS", STATUS_EVENT_CLOSED}, {"ACC", STATUS_EVENT_RESERVED},
+    {"REJ", STATUS_EVENT_RESERVATION_REJECTION}, {"CLO", STATUS_EVENT_CLOSE_CLOSED},
+    {"TCP", STATUS_USE_TCP},
+};
+
+#define COUNT(table) (sizeof(table) / sizeof(table[0]))
+
+// The strcmp chain the switches replaced: requests compare their first 3
+// bytes, responses and statuses the whole string
+static int reference(const CodeEntry* table, size_t count, const char* code, int exact,
+                     int missing) {
+    for (size_t i = 0; i < count; i++) {
+        if (exact ? strcmp(code, table[i].code) == 0
+                  : strncmp(code, table[i].code, 3) == 0)
+            return table[i].value;
+    }
+    return missing;
+}
+
+static int request_of(const char* code) { return identify_command_request((char*)code); }
+static int response_of(const char* code) { return identify_command_response((char*)code); }
+static int status_of(const char* code) { return identify_status_code(code); }
+
+typedef struct {
+    const char* name;
+    const CodeEntry* table;
+    size_t count;
+    int exact;
+    int missing;
+    int (*identify)(const char*);
+} CodeSet;
+
+static void check_code(const CodeSet* set, const char* code) {
+    int expected = reference(set->table, set->count, code, set->exact, set->missing);
+    int got = set->identify(code);
+    CHECK(got == expected, "%s(\"%s\") = %d, expected %d", set->name, code, got, expected);
+}
+
+// Every string of up to 4 bytes over the letters of the codes, plus bytes
+// that could alias them once packed
+static void check_exhaustive(const CodeSet* set, char* code, size_t len) {
+    static const char alphabet[] = "ABCDEFGIJKLMNOPRSTUWXZ\n a\x80\xff";
+    code[len] = '\0';
+    check_code(set, code);
+    if (len == 4) return;
+    for (size_t i = 0; i < sizeof(alphabet) - 1; i++) {
+        code[len] = alphabet[i];
+        check_exhaustive(set, code, len + 1);
+    }
+}
+
+int main() {
+    const CodeSet sets[] = {
+        {"identify_command_request", requests, COUNT(requests), FALSE, UNKNOWN, request_of},
+        {"identify_command_response", responses, COUNT(responses), TRUE, UNKNOWN, response_of},
+        {"identify_status_code", statuses, COUNT(statuses), TRUE,
+         STATUS_UNEXPECTED_RESPONSE, status_of},
+    };
+
+    for (size_t i = 0; i < COUNT(sets); i++) {
+        // Every code, alone and followed by what the parsers leave after it
+        for (size_t j = 0; j < sets[i].count; j++) {
+            char code[8];
+            const char* suffixes[] = {"", " ", "\n", "X"};
+            for (size_t k = 0; k < COUNT(suffixes); k++) {
+                snprintf(code, sizeof(code), "%s%s", sets[i].table[j].code, suffixes[k]);
+                check_code(&sets[i], code);
+            }
+        }
+        char code[5];
+        check_exhaustive(&sets[i], code, 0);
+    }
+
+    // The reverse tables give back the same codes
+    for (size_t j = 0; j < COUNT(requests); j++)
+        CHECK(strcmp(get_command_request(requests[j].value), requests[j].code) == 0,
+              "get_command_request(%d)", requests[j].value);
+    for (size_t j = 0; j < COUNT(responses); j++)
+        CHECK(strcmp(get_command_response_code(responses[j].value), responses[j].code) == 0,
+              "get_command_response_code(%d)", responses[j].value);
+    for (size_t j = 0; j < COUNT(statuses); j++)
+        CHECK(strcmp(get_status_code(statuses[j].value), statuses[j].code) == 0,
+              "get_status_code(%d)", statuses[j].value);
+
+    return test_summary("codes");
+}
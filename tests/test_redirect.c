@@ -0,0 +1,96 @@
+#include "harness.h"
+#include <stdlib.h>
+
+// RME and RMR replies too long for one datagram: UDP answers "<code> TCP",
+// the same request over TCP gets the whole list, and the client follows the
+// redirect on its own
+
+#define REPLY_LIMIT 1400    // the server's UDP_REPLY_LIMIT
+#define EVENTS 240          // " EID state" each, about 1440 bytes of RME
+#define RESERVATIONS 50     // the RMR ring, " EID date time seats" each
+
+static TestServer server;
+
+// Counts the space-separated fields of a reply
+static int count_fields(const char* reply) {
+    int fields = 0;
+    for (const char* c = reply; *c != '\0' && *c != '\n'; c++) {
+        if (*c != ' ' && (c == reply || c[-1] == ' ')) fields++;
+    }
+    return fields;
+}
+
+static void check_redirect(const char* request, const char* code, int entries, int entry_fields) {
+    char redirect[32], reply[TCP_BUFFER_SIZE * 4];
+    snprintf(redirect, sizeof(redirect), "%s TCP\n", code);
+
+    udp_exchange(&server, request, reply, sizeof(reply));
+    CHECK(strcmp(reply, redirect) == 0, "%s over UDP: %.40s", code, reply);
+
+    ssize_t len = tcp_exchange(&server, request, strlen(request), reply, sizeof(reply));
+    char header[16];
+    snprintf(header, sizeof(header), "%s OK ", code);
+    CHECK(len > REPLY_LIMIT && strncmp(reply, header, strlen(header)) == 0 &&
+          reply[len - 1] == '\n', "%s over TCP: %zd bytes %.40s", code, len, reply);
+    CHECK(count_fields(reply) == 2 + entries * entry_fields, "%s over TCP: %d fields",
+          code, count_fields(reply));
+}
+
+// Runs the user client against the server and returns its output
+static size_t run_client(const char* commands, char* output, size_t output_size) {
+    char command[256];
+    snprintf(command, sizeof(command),
+             "printf '%s' | ../user/user -n 127.0.0.1 -p %d 2>&1", commands, server.port);
+    FILE* client = popen(command, "r");
+    if (client == NULL) return 0;
+    size_t len = fread(output, 1, output_size - 1, client);
+    output[len] = '\0';
+    pclose(client);
+    return len;
+}
+
+int main() {
+    if (server_start(&server, NULL) == ERROR) return EXIT_FAILURE;
+
+    char reply[TCP_BUFFER_SIZE];
+    udp_exchange(&server, "LIN 100001 password\n", reply, sizeof(reply));
+
+    // Short lists still fit a datagram
+    create_event(&server, "100001", "password", 999, 1, reply, sizeof(reply));
+    udp_exchange(&server, "LME 100001 password\n", reply, sizeof(reply));
+    CHECK(strcmp(reply, "RME OK 001 1\n") == 0, "short RME: %s", reply);
+
+    for (int i = 2; i <= EVENTS; i++)
+        create_event(&server, "100001", "password", 999, 1, reply, sizeof(reply));
+    CHECK(strncmp(reply, "RCE OK ", 7) == 0, "create %d: %s", EVENTS, reply);
+    check_redirect("LME 100001 password\n", "RME", EVENTS, 2);
+
+    // Three-digit seat counts make the full ring pass the limit
+    for (int i = 1; i <= RESERVATIONS; i++) {
+        char request[64];
+        snprintf(request, sizeof(request), "RID 100001 password %03d %d\n", i, 100 + i);
+        tcp_exchange(&server, request, strlen(request), reply, sizeof(reply));
+        CHECK(strcmp(reply, "RRI ACC\n") == 0, "reserve %d: %s", i, reply);
+    }
+    check_redirect("LMR 100001 password\n", "RMR", RESERVATIONS, 4);
+
+    // The client asks again over TCP and lists every entry
+    char output[32768];
+    run_client("login 100001 password\\nmyevents\\nmyreservations\\nlogout\\nexit\\n",
+               output, sizeof(output));
+    int events = 0, reservations = 0;
+    for (char* line = strtok(output, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+        int eid, day, month, year, hour, minute, second, seats;
+        char state[16];
+        if (sscanf(line, "%d %d-%d-%d %d:%d:%d %d", &eid, &day, &month, &year,
+                   &hour, &minute, &second, &seats) == 8)
+            reservations++;
+        else if (sscanf(line, "%d %15s", &eid, state) == 2 && strcmp(state, "Active") == 0)
+            events++;
+    }
+    CHECK(events == EVENTS, "client listed %d events", events);
+    CHECK(reservations == RESERVATIONS, "client listed %d reservations", reservations);
+
+    server_stop(&server);
+    return test_summary("redirect");
+}
@@ -0,0 +1,129 @@
+#include "harness.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <dirent.h>
+
+// Concurrent RIDs against one event: the seats handed out must add up to the
+// event's capacity exactly, as seen by the clients, SED and the record files
+
+#define EVENT_SEATS 200
+#define CLIENTS 16
+#define CLIENT_USERS 4
+
+static TestServer server;
+
+typedef struct {
+    int index;
+    int accepted_seats;
+    int accepted_count;
+    int errors;
+} Client;
+
+static const char* user_uid(int i) {
+    static const char* uids[CLIENT_USERS] = {"100001", "100002", "100003", "100004"};
+    return uids[i % CLIENT_USERS];
+}
+
+static void* client_main(void* arg) {
+    Client* client = arg;
+    const char* UID = user_uid(client->index);
+    unsigned seed = (unsigned)client->index * 7919u + 1;
+
+    // Reserve until the event is sold out, shrinking requests that are rejected
+    int want = 1 + rand_r(&seed) % 5;
+    while (1) {
+        char request[BUFFER_SIZE], reply[BUFFER_SIZE];
+        snprintf(request, sizeof(request), "RID %s password 001 %d\n", UID, want);
+        if (tcp_exchange(&server, request, strlen(request), reply, sizeof(reply)) <= 0) {
+            client->errors++;
+            break;
+        }
+
+        int available;
+        if (strcmp(reply, "RRI ACC\n") == 0) {
+            client->accepted_seats += want;
+            client->accepted_count++;
+            want = 1 + rand_r(&seed) % 5;
+        } else if (sscanf(reply, "RRI REJ %d", &available) == 1) {
+            CHECK(available < want, "REJ with %d seats left for %d", available, want);
+            if (available <= 0) break;
+            want = available;
+        } else if (strcmp(reply, "RRI SLD\n") == 0) {
+            break;
+        } else {
+            client->errors++;
+            fprintf(stderr, "unexpected reply: %s", reply);
+            break;
+        }
+    }
+    return NULL;
+}
+
+static int count_record_files(const char* path) {
+    DIR* dir = opendir(path);
+    if (dir == NULL) return ERROR;
+    int count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+int main() {
+    // Enough workers for the reservations to really run side by side
+    const char* const args[] = {"-t", "8", NULL};
+    if (server_start(&server, args) == ERROR) return EXIT_FAILURE;
+
+    char request[BUFFER_SIZE], reply[TCP_BUFFER_SIZE];
+    for (int i = 0; i < CLIENT_USERS; i++) {
+        snprintf(request, sizeof(request), "LIN %s password\n", user_uid(i));
+        CHECK(udp_exchange(&server, request, reply, sizeof(reply)) > 0 &&
+              strcmp(reply, "RLI REG\n") == 0, "login %s: %s", user_uid(i), reply);
+    }
+    create_event(&server, "100001", "password", EVENT_SEATS, 100, reply, sizeof(reply));
+    CHECK(strcmp(reply, "RCE OK 001\n") == 0, "create: %s", reply);
+
+    pthread_t threads[CLIENTS];
+    Client clients[CLIENTS];
+    for (int i = 0; i < CLIENTS; i++) {
+        clients[i] = (Client){.index = i};
+        pthread_create(&threads[i], NULL, client_main, &clients[i]);
+    }
+
+    int accepted_seats = 0, accepted_count = 0;
+    for (int i = 0; i < CLIENTS; i++) {
+        pthread_join(threads[i], NULL);
+        CHECK(clients[i].errors == 0, "client %d had %d errors", i, clients[i].errors);
+        accepted_seats += clients[i].accepted_seats;
+        accepted_count += clients[i].accepted_count;
+    }
+    CHECK(accepted_seats == EVENT_SEATS, "%d seats accepted for %d", accepted_seats, EVENT_SEATS);
+
+    // SED reports the reserved total and the event as sold out in LST
+    int total = 0, reserved = 0;
+    tcp_exchange(&server, "SED 001\n", 8, reply, sizeof(reply));
+    CHECK(sscanf(reply, "RSE OK %*s %*s %*s %*s %d %d", &total, &reserved) == 2 &&
+          total == EVENT_SEATS && reserved == EVENT_SEATS, "SED: %.60s", reply);
+    tcp_exchange(&server, "LST\n", 4, reply, sizeof(reply));
+    CHECK(strstr(reply, "001 Party 2 ") != NULL, "LST: %s", reply);
+
+    // One record per accepted reservation on the event's side and on the users',
+    // even for reservations made in the same second
+    char path[128];
+    snprintf(path, sizeof(path), "%s/EVENTS/001/RESERVATIONS", server.dir);
+    int records = count_record_files(path);
+    CHECK(records == accepted_count, "%d event records for %d reservations",
+          records, accepted_count);
+    int user_records = 0;
+    for (int i = 0; i < CLIENT_USERS; i++) {
+        snprintf(path, sizeof(path), "%s/USERS/%s/RESERVED", server.dir, user_uid(i));
+        user_records += count_record_files(path);
+    }
+    CHECK(user_records == accepted_count, "%d user records for %d reservations",
+          user_records, accepted_count);
+
+    server_stop(&server);
+    return test_summary("reserve");
+}
@@ -0,0 +1,96 @@
+#define _GNU_SOURCE
+#include "harness.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+// SED downloads on every send path: sendfile(), splice() when sendfile() is
+// refused, and plain copies when both are. The refusals come from the
+// refuse_io.so shim preloaded into the server; the description must arrive
+// byte for byte whichever path carried it. The io_uring engine reads the
+// file on its ring and calls neither, so it has nothing to fall back from.
+
+#define FILE_SIZES 3
+
+static const size_t file_sizes[FILE_SIZES] = {1, 70000, MAX_FILE_SIZE};
+
+typedef struct {
+    const char* name;
+    const char* refuse;         // REFUSE_IO for the shim, NULL to run without it
+    const char* markers[2];     // refused_<call> files the fallback must leave
+} SendPath;
+
+static const SendPath paths[] = {
+    {"sendfile", NULL, {NULL, NULL}},
+    {"splice", "sendfile", {"refused_sendfile", NULL}},
+    {"copy", "sendfile,splice", {"refused_sendfile", "refused_splice"}},
+};
+
+static int marker_exists(TestServer* srv, const char* marker) {
+    char path[128];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", srv->dir, marker);
+    return stat(path, &st) == 0;
+}
+
+static int uses_uring() {
+    const char* args = getenv("SERVER_ARGS");
+    return args != NULL && strstr(args, "-u") != NULL;
+}
+
+static void check_path(const SendPath* send_path, const char* shim) {
+    TestServer server;
+    if (send_path->refuse != NULL) {
+        setenv("LD_PRELOAD", shim, 1);
+        setenv("REFUSE_IO", send_path->refuse, 1);
+    }
+    int started = server_start(&server, NULL);
+    unsetenv("LD_PRELOAD");
+    unsetenv("REFUSE_IO");
+    CHECK(started == SUCCESS, "%s: server start", send_path->name);
+    if (started == ERROR) return;
+
+    char reply[BUFFER_SIZE];
+    udp_exchange(&server, "LIN 100001 password\n", reply, sizeof(reply));
+    size_t reply_size = MAX_FILE_SIZE + BUFFER_SIZE;
+    char* sed_reply = malloc(reply_size);
+
+    for (int i = 0; i < FILE_SIZES; i++) {
+        create_event(&server, "100001", "password", 100, file_sizes[i], reply, sizeof(reply));
+        CHECK(strncmp(reply, "RCE OK ", 7) == 0, "%s: create: %s", send_path->name, reply);
+
+        char request[16];
+        snprintf(request, sizeof(request), "SED %.3s\n", reply + 7);
+        ssize_t len = tcp_exchange(&server, request, strlen(request), sed_reply, reply_size);
+
+        size_t size = 0;
+        const char* data = len > 0 ? sed_file_data(sed_reply, len, &size) : NULL;
+        CHECK(data != NULL && size == file_sizes[i], "%s: %zu byte file: %zd byte reply %.40s",
+              send_path->name, file_sizes[i], len, len > 0 ? sed_reply : "");
+        if (data == NULL) continue;
+
+        // create_event() writes the alphabet over and over
+        size_t wrong = 0;
+        while (wrong < size && data[wrong] == (char)('a' + wrong % 26)) wrong++;
+        CHECK(wrong == size, "%s: %zu byte file differs at byte %zu",
+              send_path->name, size, wrong);
+    }
+
+    for (int i = 0; i < 2 && send_path->markers[i] != NULL && !uses_uring(); i++)
+        CHECK(marker_exists(&server, send_path->markers[i]), "%s: %s never refused",
+              send_path->name, send_path->markers[i] + strlen("refused_"));
+
+    free(sed_reply);
+    server_stop(&server);
+}
+
+int main() {
+    char shim[PATH_MAX];
+    if (realpath("refuse_io.so", shim) == NULL) {
+        perror("refuse_io.so");
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) check_path(&paths[i], shim);
+    return test_summary("sed");
+}
@@ -0,0 +1,91 @@
+#include "harness.h"
+#include "scalar_names.h"
+#include "verifications.h"
+#include <ctype.h>
+#include <stdlib.h>
+
+// Differential fuzz: every SSE2 validator must give the scalar build's answer
+// and leave its argument in the same state, on random and mutated input
+
+#define ROUNDS 400000
+#define MAX_INPUT 24
+
+typedef int (*Validator)(char*);
+
+typedef struct {
+    const char* name;
+    Validator simd;
+    Validator scalar;
+    const char* valid;      // mutated to reach the interesting edges
+} ValidatorPair;
+
+static const ValidatorPair validators[] = {
+    {"uid", verify_uid_format, scalar_verify_uid_format, "123456"},
+    {"password", verify_password_format, scalar_verify_password_format, "aB3dE6g8"},
+    {"token", verify_session_token_format, scalar_verify_session_token_format, "0123456789abcdef"},
+    {"credential", verify_credential_format, scalar_verify_credential_format, "9f8e7d6c5b4a3210"},
+    {"date", verify_event_date_format, scalar_verify_event_date_format, "29-02-2096 23:59"},
+};
+
+// Bytes that sit on the class and range boundaries the lanes compare against
+static const char edges[] = "09/:@AZ[`afgz{-. \n_\x7f\x80\xff";
+
+static char random_byte(unsigned* seed) {
+    int pick = rand_r(seed) % 4;
+    if (pick == 0) return (char)(1 + rand_r(seed) % 255);
+    return edges[rand_r(seed) % (sizeof(edges) - 1)];
+}
+
+// A random string, or the valid sample with a few bytes replaced, cut or extended
+static void make_input(char* out, const char* valid, unsigned* seed) {
+    size_t len;
+    if (rand_r(seed) % 3 == 0) {
+        len = rand_r(seed) % MAX_INPUT;
+        for (size_t i = 0; i < len; i++) out[i] = random_byte(seed);
+    } else {
+        len = strlen(valid);
+        memcpy(out, valid, len);
+        for (int edits = rand_r(seed) % 3; edits > 0; edits--)
+            out[rand_r(seed) % len] = random_byte(seed);
+        if (rand_r(seed) % 4 == 0) len = rand_r(seed) % (len + 1);
+        if (rand_r(seed) % 4 == 0) out[len++] = rand_r(seed) % 2 ? '\n' : random_byte(seed);
+    }
+    out[len] = '\0';
+}
+
+static void fuzz(const ValidatorPair* pair, unsigned seed) {
+    int mismatches = 0, valid = 0;
+    for (int round = 0; round < ROUNDS && mismatches < 5; round++) {
+        char input[MAX_INPUT + 2], simd_arg[MAX_INPUT + 2], scalar_arg[MAX_INPUT + 2];
+        make_input(input, pair->valid, &seed);
+        memcpy(simd_arg, input, sizeof(input));
+        memcpy(scalar_arg, input, sizeof(input));
+
+        int simd = pair->simd(simd_arg);
+        int scalar = pair->scalar(scalar_arg);
+        valid += scalar == VALID;
+        if (simd != scalar || memcmp(simd_arg, scalar_arg, sizeof(input)) != 0) {
+            mismatches++;
+            CHECK(FALSE, "%s(\"%s\"): SSE2 %d, scalar %d", pair->name, input, simd, scalar);
+        }
+    }
+    // The mutations must keep hitting both answers, or the fuzz proves little
+    CHECK(valid > 0 && valid < ROUNDS, "%s: %d of %d inputs valid", pair->name, valid, ROUNDS);
+}
+
+// The class table must agree with <ctype.h> in the "C" locale it replaced
+static void check_char_class() {
+    for (int c = 0; c < 256; c++) {
+        int hex = isdigit(c) || (c >= 'a' && c <= 'f');
+        CHECK(!has_class((char)c, CLASS_DIGIT) == !isdigit(c), "digit class of %d", c);
+        CHECK(!has_class((char)c, CLASS_ALNUM) == !isalnum(c), "alnum class of %d", c);
+        CHECK(!has_class((char)c, CLASS_HEX) == !hex, "hex class of %d", c);
+    }
+}
+
+int main() {
+    check_char_class();
+    for (size_t i = 0; i < sizeof(validators) / sizeof(validators[0]); i++)
+        fuzz(&validators[i], 0x5eed + (unsigned)i);
+    return test_summary("validators");
+}
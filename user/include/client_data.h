@@ -6,8 +6,10 @@
 
 extern char current_uid[UID_LENGTH + 1];
 extern char current_password[PASSWORD_LENGTH + 1];
+extern char current_token[SESSION_TOKEN_LENGTH + 1];
 extern int is_logged_in;
 extern char IP[MAX_HOSTNAME_LENGTH];
 extern char PORT[6];
+extern int keep_alive;
 
 #endif
\ No newline at end of file
@@ -277,9 +277,9 @@ void show_event_details(char* eid, char* uid, char* event_name, char* event_date
 /**
  * @brief Displays the list of all events from the server.
  * 
- * @param tcp_fd TCP socket file descriptor
+ * @param rb Input buffer of the TCP connection
  */
-void show_events_list(int tcp_fd);
+void show_events_list(ReadBuffer* rb);
 
 /**
  * @brief Displays reservation result information.
@@ -336,10 +336,32 @@ ReplyStatus udp_send_receive(int udp_fd, struct sockaddr_in* server_udp_addr,
                             socklen_t udp_addr_len, char* request, char* response, 
                             size_t response_size);
 
+/**
+ * @brief Gets a TCP connection to the server for one command.
+ * 
+ * In keep-alive mode (-k) the first call connects and sends KAL, later calls
+ * reuse that connection while the server keeps it open. Otherwise every call
+ * opens a new connection.
+ * 
+ * @return ReadBuffer* Buffer reading from the connection (its fd is used for
+ *         sending), NULL if the server cannot be reached
+ */
+ReadBuffer* tcp_session_open();
+
+/**
+ * @brief Finishes a command on a connection from tcp_session_open().
+ * 
+ * @param rb Connection buffer
+ * @param reusable TRUE if the whole reply was consumed, so the connection may
+ *        carry the next command in keep-alive mode; FALSE closes it
+ */
+void tcp_session_end(ReadBuffer* rb, int reusable);
+
 /**
  * @brief Sends a TCP request and receives the response.
  * 
- * Opens connection, sends request, receives response, and closes connection.
+ * Sends the request over the command's connection and reads the one-line
+ * response.
  * 
  * @param request Request message to send
  * @param response Buffer to store response
@@ -434,16 +456,16 @@ ReplyStatus parse_response_header(char** cursor, RequestType request_type);
  * 
  * Verifies they match the expected command and parses the status.
  * 
- * @param tcp_fd TCP socket file descriptor
+ * @param rb Input buffer of the TCP connection
  * @param expected_command Expected command type
  * @return ReplyStatus Parsed status or STATUS_UNEXPECTED_RESPONSE
  */
-ReplyStatus read_cmd_status(int tcp_fd, RequestType expected_command);
+ReplyStatus read_cmd_status(ReadBuffer* rb, RequestType expected_command);
 
 /**
  * @brief Reads the show event response header fields.
  * 
- * @param tcp_fd TCP socket file descriptor
+ * @param rb Input buffer of the TCP connection
  * @param uid Buffer to store creator UID
  * @param event_name Buffer to store event name
  * @param event_date Buffer to store event date
@@ -453,7 +475,7 @@ ReplyStatus read_cmd_status(int tcp_fd, RequestType expected_command);
  * @param file_size Buffer to store file size
  * @return ReplyStatus STATUS_OK on success, error on failure
  */
-ReplyStatus read_show_response_header(int tcp_fd,
+ReplyStatus read_show_response_header(ReadBuffer* rb,
                                        char* uid, char* event_name,
                                        char* event_date, char* attendance_size,
                                        char* reserved_seats, char* file_name,
@@ -462,7 +484,7 @@ ReplyStatus read_show_response_header(int tcp_fd,
 /**
  * @brief Reads a single event entry from the events list.
  * 
- * @param fd_tcp TCP socket file descriptor
+ * @param rb Input buffer of the TCP connection
  * @param eid Buffer to store event ID
  * @param name Buffer to store event name
  * @param state Buffer to store event state
@@ -470,7 +492,7 @@ ReplyStatus read_show_response_header(int tcp_fd,
  * @param event_time Buffer to store event time
  * @return ReplyStatus STATUS_OK if more events, EOM at end of list
  */
-ReplyStatus read_events_list(int fd_tcp, char* eid, char* name, char* state,
+ReplyStatus read_events_list(ReadBuffer* rb, char* eid, char* name, char* state,
                               char* event_day, char* event_time);
 
 #endif
\ No newline at end of file
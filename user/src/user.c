@@ -16,10 +16,12 @@
 
 char current_uid[UID_LENGTH + 1] = "";
 char current_password[PASSWORD_LENGTH + 1] = "";
+char current_token[SESSION_TOKEN_LENGTH + 1] = "";
 int is_logged_in = LOGGED_OUT;
 
 char IP[MAX_HOSTNAME_LENGTH] = DEFAULT_IP;
 char PORT[6] = DEFAULT_PORT;
+int keep_alive = FALSE;
 volatile sig_atomic_t stop = 0;
 
 
@@ -30,7 +32,7 @@ void sig_detected(int signum) {
     
 void parse_arguments(int argc, char *argv[]) {   
     int opt;
-    while ((opt = getopt(argc, argv, "-p:-n:")) != -1) {
+    while ((opt = getopt(argc, argv, "-p:-n:k")) != -1) {
         switch (opt) {
             case 'p':
                 if (optarg[0] == '-') {
@@ -56,6 +58,9 @@ void parse_arguments(int argc, char *argv[]) {
                 }
                 strcpy(IP, optarg);
                 break;
+            case 'k':
+                keep_alive = TRUE;
+                break;
             default:
                 usage(argv[0]);
                 exit(EXIT_FAILURE);
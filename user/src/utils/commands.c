@@ -5,10 +5,12 @@
 #include <sys/socket.h>
 #include <sys/stat.h>   // stat, S_ISREG
 #include <unistd.h>    // access, R_OK
+#include <time.h>
 
 #include "utils.h"
 #include "../../common/parser.h"
 #include "../../common/common.h"
+#include "../../common/verifications.h"
 
 #include "client_data.h"
 
@@ -25,6 +27,38 @@ int verify_file(char* file_name) {
     return VALID;
 }
 
+// Time of the last request that carried credentials, the server extends the
+// session on each of them
+static time_t credential_used_at;
+
+// The session token stands in for the password while the server still holds
+// the session; after a long pause the password is sent once, which revives it
+static const char* current_credential() {
+    time_t now = time(NULL);
+    int stale = now - credential_used_at >= SESSION_TIMEOUT_SECONDS - TIMEOUT_SECONDS;
+    credential_used_at = now;
+    if (current_token[0] == '\0' || stale) return current_password;
+    return current_token;
+}
+
+// Asks for a session token after logging in. Servers without sessions answer
+// ERR, the client then keeps sending the password.
+static void open_session(int udp_fd, struct sockaddr_in* server_udp_addr,
+                         socklen_t udp_addr_len) {
+    char request[64], response[64];
+    snprintf(request, sizeof(request), "SES %s %s\n", current_uid, current_password);
+    current_token[0] = '\0';
+    if (udp_send_receive(udp_fd, server_udp_addr, udp_addr_len, request, response,
+                         sizeof(response)) != STATUS_UNASSIGNED) return;
+
+    // PROTOCOL: RSS OK <token>
+    char token[64];
+    if (sscanf(response, "RSS OK %63s", token) == 1 && verify_session_token_format(token)) {
+        strcpy(current_token, token);
+        credential_used_at = time(NULL);
+    }
+}
+
 // --------------- UDP ----------------
 ReplyStatus login_handler(char** cursor, int udp_fd, struct sockaddr_in* server_udp_addr,
             socklen_t udp_addr_len) {
@@ -70,6 +104,7 @@ ReplyStatus login_handler(char** cursor, int udp_fd, struct sockaddr_in* server_
         is_logged_in = 1;
         strcpy(current_password, password);
         strcpy(current_uid, uid);
+        open_session(udp_fd, server_udp_addr, udp_addr_len);
     }
     return status;
 }
@@ -83,7 +118,7 @@ ReplyStatus unregister_handler(char** cursor, int udp_fd, struct sockaddr_in* se
     // PROTOCOL: UNR <uid> <password>
     char request[256], response[256];
     ssize_t response_size = 256;
-    snprintf(request, sizeof(request), "UNR %s %s\n", current_uid, current_password);
+    snprintf(request, sizeof(request), "UNR %s %s\n", current_uid, current_credential());
 
     // Send request to server and receive response
     ReplyStatus status = udp_send_receive(udp_fd, server_udp_addr, udp_addr_len,
@@ -113,6 +148,7 @@ ReplyStatus unregister_handler(char** cursor, int udp_fd, struct sockaddr_in* se
         status == STATUS_WRONG_PASSWORD){
         is_logged_in = 0;
         memset(current_password, 0, sizeof(current_password));
+        memset(current_token, 0, sizeof(current_token));
         memset(current_uid, 0, sizeof(current_uid));
     }
     return status;
@@ -129,7 +165,7 @@ ReplyStatus logout_handler(char** cursor, int udp_fd, struct sockaddr_in* server
     ssize_t response_size = 256;
 
     // PROTOCOL: LOU <uid> <password>
-    snprintf(request, sizeof(request), "LOU %s %s\n", current_uid, current_password);
+    snprintf(request, sizeof(request), "LOU %s %s\n", current_uid, current_credential());
 
     // Send request to server and receive response
     ReplyStatus status = udp_send_receive(udp_fd, server_udp_addr, udp_addr_len,
@@ -160,12 +196,28 @@ ReplyStatus logout_handler(char** cursor, int udp_fd, struct sockaddr_in* server
         status == STATUS_WRONG_PASSWORD) {
         is_logged_in = 0;
         memset(current_password, 0, sizeof(current_password));
+        memset(current_token, 0, sizeof(current_token));
         memset(current_uid, 0, sizeof(current_uid));
     }
 
     return status;
 }
 
+// Parses the header of an LME/LMR reply. A list too long for one datagram is
+// answered with TCP instead, so the request is sent again over TCP and its
+// reply replaces the UDP one.
+static ReplyStatus parse_list_response_header(char* request, char* response,
+                                              size_t response_size, char** resp_cursor,
+                                              RequestType request_type) {
+    ReplyStatus status = parse_response_header(resp_cursor, request_type);
+    if (status != STATUS_USE_TCP || !is_end_of_message(resp_cursor)) return status;
+
+    status = tcp_send_receive(request, response, response_size);
+    if (status != STATUS_UNASSIGNED) return status;
+    *resp_cursor = response;
+    return parse_response_header(resp_cursor, request_type);
+}
+
 ReplyStatus myevent_handler(char** cursor, int udp_fd, struct sockaddr_in* server_udp_addr,
                             socklen_t udp_addr_len) {
     ssize_t n;
@@ -174,7 +226,7 @@ ReplyStatus myevent_handler(char** cursor, int udp_fd, struct sockaddr_in* serve
 
     // PROTOCOL: LME <uid> <password>
     char request[256];
-    snprintf(request, sizeof(request), "LME %s %s\n", current_uid, current_password);
+    snprintf(request, sizeof(request), "LME %s %s\n", current_uid, current_credential());
     if (sendto(udp_fd, request, strlen(request), 0, (struct sockaddr*)server_udp_addr,
                 udp_addr_len) == ERROR) return STATUS_SEND_FAILED;
 
@@ -185,7 +237,8 @@ ReplyStatus myevent_handler(char** cursor, int udp_fd, struct sockaddr_in* serve
      
     // Parse response
     char *resp_cursor = response;
-    ReplyStatus status = parse_response_header(&resp_cursor, MYEVENTS);
+    ReplyStatus status = parse_list_response_header(request, response, sizeof(response),
+                                                    &resp_cursor, MYEVENTS);
     
     // Expected responses: OK / NOK / NLG / WRP
     if(status != STATUS_OK &&
@@ -205,6 +258,7 @@ ReplyStatus myevent_handler(char** cursor, int udp_fd, struct sockaddr_in* serve
          status == STATUS_NOT_LOGGED_IN)){
             is_logged_in = 0;
             memset(current_password, 0, sizeof(current_password));
+            memset(current_token, 0, sizeof(current_token));
             memset(current_uid, 0, sizeof(current_uid));
     }
     if (status != STATUS_OK && is_end_of_message(&resp_cursor)) return status;   
@@ -250,7 +304,7 @@ ReplyStatus myreservations_handler(char** cursor, int udp_fd,
 
     // PROTOCOL: LMR <uid> <password>
     char request[256];
-    snprintf(request, sizeof(request), "LMR %s %s\n", current_uid, current_password);
+    snprintf(request, sizeof(request), "LMR %s %s\n", current_uid, current_credential());
 
     if (sendto(udp_fd, request, strlen(request), 0, (struct sockaddr*)server_udp_addr,
                 udp_addr_len) == ERROR) return STATUS_SEND_FAILED;
@@ -262,7 +316,8 @@ ReplyStatus myreservations_handler(char** cursor, int udp_fd,
 
     // PROTOCOL: RMR <status> [<event1ID date value> ...]
     char *resp_cursor = response;
-    ReplyStatus status = parse_response_header(&resp_cursor, MYRESERVATIONS);
+    ReplyStatus status = parse_list_response_header(request, response, sizeof(response),
+                                                    &resp_cursor, MYRESERVATIONS);
     
     // Expected responses: OK / NOK / NLG / WRP
     if(status != STATUS_OK &&
@@ -280,10 +335,11 @@ ReplyStatus myreservations_handler(char** cursor, int udp_fd,
          status == STATUS_NOT_LOGGED_IN)){
             is_logged_in = 0;
             memset(current_password, 0, sizeof(current_password));
+            memset(current_token, 0, sizeof(current_token));
             memset(current_uid, 0, sizeof(current_uid));
     }
-    if (!is_end_of_message(&resp_cursor)) return STATUS_MALFORMED_RESPONSE;
-    if (status != STATUS_OK) return status;
+    if (status != STATUS_OK && is_end_of_message(&resp_cursor)) return status;
+    else if (is_end_of_message(&resp_cursor)) return STATUS_MALFORMED_RESPONSE;
     return show_myreservations(resp_cursor);
 }
 
@@ -322,6 +378,7 @@ ReplyStatus changepass_handler(char** cursor) {
     if (status == STATUS_NOT_LOGGED_IN || status == STATUS_USER_NOT_FOUND){
         is_logged_in = 0;
         memset(current_password, 0, sizeof(current_password));
+        memset(current_token, 0, sizeof(current_token));
         memset(current_uid, 0, sizeof(current_uid));
     }
     // Update global state on successful password change
@@ -338,8 +395,8 @@ ReplyStatus create_event_handler(char** cursor, char** extra_info) {
     ReplyStatus status = parse_create_event(cursor, event_name, file_name, date, num_seats);
     if (status != STATUS_UNASSIGNED) return status;
     
-    int tcp_fd = connect_tcp(IP, PORT);
-    if (tcp_fd == -1) return STATUS_SEND_FAILED;
+    ReadBuffer* rb = tcp_session_open();
+    if (rb == NULL) return STATUS_SEND_FAILED;
 
     // PROTOCOL: CRE <uid> <password> <name> <event_date> <attendance_size> <Fname> <Fsize> <Fdata>
     // Get file size
@@ -351,23 +408,26 @@ ReplyStatus create_event_handler(char** cursor, char** extra_info) {
     char request_header[512];
 
     snprintf(request_header, sizeof(request_header), "CRE %s %s %s %s %s %s %ld ",
-             current_uid, current_password, event_name, date, num_seats, file_name, file_size);
+             current_uid, current_credential(), event_name, date, num_seats, file_name, file_size);
     
     // Send request header to server
-    if (tcp_send_message(tcp_fd, request_header) == ERROR) {
-        close(tcp_fd);
+    if (tcp_send_message(rb->fd, request_header) == ERROR) {
+        tcp_session_end(rb, FALSE);
         return STATUS_SEND_FAILED;
     }
 
     // Send file to server
-    if (tcp_send_file(tcp_fd, file_name) == ERROR) {
-        close(tcp_fd);
+    if (tcp_send_file(rb->fd, file_name) == ERROR) {
+        tcp_session_end(rb, FALSE);
         return STATUS_SEND_FAILED;
     }   
 
     // Read server response
-    tcp_read(tcp_fd, request_header, sizeof(request_header));
-    close(tcp_fd);
+    if (tcp_read_line(rb, request_header, sizeof(request_header)) == ERROR) {
+        tcp_session_end(rb, FALSE);
+        return STATUS_RECV_FAILED;
+    }
+    tcp_session_end(rb, request_header[strlen(request_header) - 1] == '\n');
     char response_code[4], reply_status[4], eid[4];
     char *cursor_resp = request_header;
     
@@ -401,6 +461,7 @@ ReplyStatus create_event_handler(char** cursor, char** extra_info) {
     if(status == STATUS_WRONG_PASSWORD || status == STATUS_NOT_LOGGED_IN){
         is_logged_in = 0;
         memset(current_password, 0, sizeof(current_password));
+        memset(current_token, 0, sizeof(current_token));
         memset(current_uid, 0, sizeof(current_uid));
     }
     if (status == STATUS_OK){
@@ -425,7 +486,7 @@ ReplyStatus close_event_handler(char** cursor) {
 
     // PROTOCOL: CLO <uid> <password> <eid>
     char request[256], response[256];
-    snprintf(request, sizeof(request), "CLS %s %s %s\n", current_uid, current_password, eid);
+    snprintf(request, sizeof(request), "CLS %s %s %s\n", current_uid, current_credential(), eid);
 
     status = tcp_send_receive(request, response, 256);
     if(status != STATUS_UNASSIGNED) return status;
@@ -453,6 +514,7 @@ ReplyStatus close_event_handler(char** cursor) {
     if(status == STATUS_WRONG_PASSWORD || status == STATUS_NOT_LOGGED_IN){
         is_logged_in = 0;
         memset(current_password, 0, sizeof(current_password));
+        memset(current_token, 0, sizeof(current_token));
         memset(current_uid, 0, sizeof(current_uid));
     }
 
@@ -467,33 +529,34 @@ ReplyStatus list_handler(char** cursor) {
     snprintf(request, sizeof(request), "LST\n");
 
     // Send request to server and receive response
-    int tcp_fd = connect_tcp(IP, PORT);
-    if (tcp_fd == -1) return STATUS_SEND_FAILED;
+    ReadBuffer* rb = tcp_session_open();
+    if (rb == NULL) return STATUS_SEND_FAILED;
     
     // Send request header to server
-    if (tcp_send_message(tcp_fd, request) == ERROR) {
-        close(tcp_fd);
+    if (tcp_send_message(rb->fd, request) == ERROR) {
+        tcp_session_end(rb, FALSE);
         return STATUS_SEND_FAILED;
     }
 
     // Read server response command and status
-    ReplyStatus status = read_cmd_status(tcp_fd, LIST);
+    ReplyStatus status = read_cmd_status(rb, LIST);
     
     // Expected responses: OK / NOK
     if(status != STATUS_OK &&
        status != STATUS_NOK &&
        status != STATUS_ERROR &&
        status != STATUS_MALFORMED_RESPONSE) {
-        close(tcp_fd);
+        tcp_session_end(rb, FALSE);
         return STATUS_UNEXPECTED_RESPONSE;
     }
     if (status != STATUS_OK){
-        close(tcp_fd);
+        tcp_session_end(rb, status == STATUS_NOK || status == STATUS_ERROR);
         return status;  
     }
 
-    show_events_list(tcp_fd);
-    close(tcp_fd);
+    show_events_list(rb);
+    // The list is over once its closing newline was consumed
+    tcp_session_end(rb, rb->start > 0 && rb->data[rb->start - 1] == '\n');
     return STATUS_CUSTOM_OUTPUT;
 }
 
@@ -511,12 +574,12 @@ ReplyStatus show_handler(char** cursor){
     snprintf(request, sizeof(request), "SED %s\n", eid);
     
     // Send request to server and receive response
-    int tcp_fd = connect_tcp(IP, PORT);
-    if (tcp_fd == -1) return STATUS_SEND_FAILED;
+    ReadBuffer* rb = tcp_session_open();
+    if (rb == NULL) return STATUS_SEND_FAILED;
     
     // Send request header to server
-    if (tcp_send_message(tcp_fd, request) == ERROR) {
-        close(tcp_fd);
+    if (tcp_send_message(rb->fd, request) == ERROR) {
+        tcp_session_end(rb, FALSE);
         return STATUS_SEND_FAILED;
     }
 
@@ -528,7 +591,7 @@ ReplyStatus show_handler(char** cursor){
     char reserved_seats[SEAT_COUNT_LENGTH + 1];
     char file_name[FILE_NAME_LENGTH + 1];
     char file_size[FILE_SIZE_LENGTH + 1];
-    status = read_show_response_header(tcp_fd,
+    status = read_show_response_header(rb,
                                        uid, event_name,
                                        event_date, attendance_size,
                                        reserved_seats, file_name,
@@ -538,21 +601,23 @@ ReplyStatus show_handler(char** cursor){
        status != STATUS_NOK &&
        status != STATUS_ERROR &&
        status != STATUS_MALFORMED_RESPONSE) {
-        close(tcp_fd);
+        tcp_session_end(rb, FALSE);
         return STATUS_UNEXPECTED_RESPONSE;
     }
     if (status != STATUS_OK){
-        close(tcp_fd);       
+        tcp_session_end(rb, status == STATUS_NOK || status == STATUS_ERROR);
         return status;
     }
 
     // Expected responses: OK / NOK
     long file_size_long = atol(file_size);
-    if(tcp_read_file(tcp_fd, file_name, file_size_long) == ERROR) {
-        close(tcp_fd);
+    if(tcp_read_file(rb, file_name, file_size_long) == ERROR) {
+        tcp_session_end(rb, FALSE);
         return STATUS_RECV_FAILED;
     }
-    close(tcp_fd);
+    // The file data is followed by the closing newline
+    const char* end = read_buffer_take(rb, 1);
+    tcp_session_end(rb, end != NULL && *end == '\n');
     // Display event details
     show_event_details(eid, uid, event_name, event_date,
                       attendance_size, reserved_seats,
@@ -573,17 +638,17 @@ ReplyStatus reserve_handler(char** cursor) {
     // PROTOCOL: RID <uid> <password> <EID> <people>.
     char request[256];
     snprintf(request, sizeof(request), "RID %s %s %s %s\n",
-             current_uid, current_password, padded_eid, num_seats);
+             current_uid, current_credential(), padded_eid, num_seats);
 
-    int tcp_fd = connect_tcp(IP, PORT);
-    if (tcp_fd == -1) return STATUS_SEND_FAILED;
+    ReadBuffer* rb = tcp_session_open();
+    if (rb == NULL) return STATUS_SEND_FAILED;
     
     // Send request header to server
-    if (tcp_send_message(tcp_fd, request) == ERROR) {
-        close(tcp_fd);
+    if (tcp_send_message(rb->fd, request) == ERROR) {
+        tcp_session_end(rb, FALSE);
         return STATUS_SEND_FAILED;
     }
-    status = read_cmd_status(tcp_fd, RESERVE);
+    status = read_cmd_status(rb, RESERVE);
     
     // Expected responses: ACC / REJ / CLS / SLD / PST / NOK / NLG / WRP
     if(status != STATUS_EVENT_RESERVATION_REJECTION &&
@@ -596,7 +661,7 @@ ReplyStatus reserve_handler(char** cursor) {
        status != STATUS_WRONG_PASSWORD &&
        status != STATUS_ERROR &&
        status != STATUS_MALFORMED_RESPONSE) {
-        close(tcp_fd);
+        tcp_session_end(rb, FALSE);
         return STATUS_UNEXPECTED_RESPONSE;
     }
 
@@ -604,21 +669,22 @@ ReplyStatus reserve_handler(char** cursor) {
     if(status == STATUS_WRONG_PASSWORD || status == STATUS_NOT_LOGGED_IN){
         is_logged_in = 0;
         memset(current_password, 0, sizeof(current_password));
+        memset(current_token, 0, sizeof(current_token));
         memset(current_uid, 0, sizeof(current_uid));
     }
 
     if(status != STATUS_EVENT_RESERVATION_REJECTION){
-        close(tcp_fd);
+        tcp_session_end(rb, status != STATUS_MALFORMED_RESPONSE);
         return status;  
     }
 
     char seats_left[4];
-    if(tcp_read_field(tcp_fd, seats_left, sizeof(seats_left)) == ERROR ||
+    if(tcp_read_field(rb, seats_left, sizeof(seats_left)) == ERROR ||
        !verify_reserved_seats(seats_left, "999")) {
-        close(tcp_fd);
+        tcp_session_end(rb, FALSE);
         return STATUS_RECV_FAILED;
     }
     show_event_reservations(seats_left, eid);
-    close(tcp_fd);
+    tcp_session_end(rb, TRUE);
     return STATUS_CUSTOM_OUTPUT;
 }
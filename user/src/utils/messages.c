@@ -6,9 +6,10 @@
 #include <stdio.h>
 
 void usage(const char *prog_name) {
-    fprintf(stdout, "Usage: %s [-n server_ip] [-p server_port]\n", prog_name);
+    fprintf(stdout, "Usage: %s [-n server_ip] [-p server_port] [-k]\n", prog_name);
     fprintf(stdout, "  -n server_ip    Specify the server IP address\n");
     fprintf(stdout, "  -p server_port  Specify the server port number\n");
+    fprintf(stdout, "  -k              Keep one TCP connection open for all commands\n");
 }
 
 void print_result(RequestType command, ReplyStatus status, char* extra_info) {
@@ -212,7 +213,7 @@ void show_event_details(char* eid, char* uid, char* event_name, char* event_date
     printf("===================================\n\n");
 }
 
-void show_events_list(int tcp_fd) {
+void show_events_list(ReadBuffer* rb) {
     ReplyStatus status;
     char eid[4], name[MAX_EVENT_NAME + 1];
     char state[2];
@@ -221,7 +222,7 @@ void show_events_list(int tcp_fd) {
     printf("\n%-5s %-20s %-12s %-20s\n", "EID", "Name", "State", "Date & Time");
     printf("------------------------------------------------------------\n");
     
-    status = read_events_list(tcp_fd, eid, name, state, event_day, event_time);
+    status = read_events_list(rb, eid, name, state, event_day, event_time);
     while (status == STATUS_UNASSIGNED) {
         const char* state_str;
         switch (state[0]) {
@@ -232,7 +233,7 @@ void show_events_list(int tcp_fd) {
             default: state_str = "Unknown"; break;
         }
         printf("%-5s %-20s %-12s %s %s\n", eid, name, state_str, event_day, event_time);
-        status = read_events_list(tcp_fd, eid, name, state, event_day, event_time);
+        status = read_events_list(rb, eid, name, state, event_day, event_time);
     }
 }
 
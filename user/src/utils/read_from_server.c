@@ -14,11 +14,11 @@
 #include "../../common/data.h"
 #include "../../common/verifications.h"
 
-ReplyStatus read_cmd_status(int tcp_fd, RequestType expected_command) {
+ReplyStatus read_cmd_status(ReadBuffer* rb, RequestType expected_command) {
     char command[COMMAND_LENGTH + 1];
-    char rep_status[4];
+    char rep_status[5];
     // Response command
-    if(tcp_read_field(tcp_fd, command, COMMAND_LENGTH + 1) == ERROR)
+    if(tcp_read_field(rb, command, COMMAND_LENGTH + 1) == ERROR)
         return STATUS_RECV_FAILED;
 
     // Confirm command
@@ -26,29 +26,30 @@ ReplyStatus read_cmd_status(int tcp_fd, RequestType expected_command) {
     if (req == ERROR_REQUEST) return CMD_ERROR;
     if (req != expected_command) return STATUS_UNEXPECTED_RESPONSE;
 
-    // Response status
-    if(tcp_read_field(tcp_fd, rep_status, 3) == ERROR) return STATUS_RECV_FAILED;
+    // Response status, one byte longer than any status so the delimiter
+    // after it is always consumed
+    if(tcp_read_field(rb, rep_status, 4) == ERROR) return STATUS_RECV_FAILED;
     return identify_status_code(rep_status);
 }
 
-ReplyStatus read_show_response_header(int tcp_fd,
+ReplyStatus read_show_response_header(ReadBuffer* rb,
                                        char* uid, char* event_name,
                                        char* event_date, char* attendance_size,
                                        char* reserved_seats, char* file_name,
                                        char* file_size) {
-    ReplyStatus status = read_cmd_status(tcp_fd, SHOW);
+    ReplyStatus status = read_cmd_status(rb, SHOW);
     if (status != STATUS_OK) return status;
     
     char str_day[DAY_STR_SIZE + 1], str_time[TIME_STR_SIZE + 1];
     // Read remaining fields
-    if(tcp_read_field(tcp_fd, uid, UID_LENGTH) != SUCCESS ||
-       tcp_read_field(tcp_fd, event_name, MAX_EVENT_NAME) != SUCCESS ||
-       tcp_read_field(tcp_fd, str_day, DAY_STR_SIZE) != SUCCESS ||
-       tcp_read_field(tcp_fd, str_time, TIME_STR_SIZE) != SUCCESS ||
-       tcp_read_field(tcp_fd, attendance_size, SEAT_COUNT_LENGTH) != SUCCESS ||
-       tcp_read_field(tcp_fd, reserved_seats, SEAT_COUNT_LENGTH) != SUCCESS ||
-       tcp_read_field(tcp_fd, file_name, FILE_NAME_LENGTH) != SUCCESS ||
-       tcp_read_field(tcp_fd, file_size, FILE_SIZE_LENGTH) != SUCCESS){
+    if(tcp_read_field(rb, uid, UID_LENGTH) != SUCCESS ||
+       tcp_read_field(rb, event_name, MAX_EVENT_NAME) != SUCCESS ||
+       tcp_read_field(rb, str_day, DAY_STR_SIZE) != SUCCESS ||
+       tcp_read_field(rb, str_time, TIME_STR_SIZE) != SUCCESS ||
+       tcp_read_field(rb, attendance_size, SEAT_COUNT_LENGTH) != SUCCESS ||
+       tcp_read_field(rb, reserved_seats, SEAT_COUNT_LENGTH) != SUCCESS ||
+       tcp_read_field(rb, file_name, FILE_NAME_LENGTH) != SUCCESS ||
+       tcp_read_field(rb, file_size, FILE_SIZE_LENGTH) != SUCCESS){
         return STATUS_MALFORMED_RESPONSE;
     }
     snprintf(event_date, EVENT_DATE_LENGTH + 1, "%s %s", str_day, str_time);
@@ -62,18 +63,18 @@ ReplyStatus read_show_response_header(int tcp_fd,
     return STATUS_OK;
 }    
 
-ReplyStatus read_events_list(int fd_tcp, char* eid, char* name, char* state,
+ReplyStatus read_events_list(ReadBuffer* rb, char* eid, char* name, char* state,
                               char* event_day, char* event_time) {
                                 
-    if(tcp_read_field(fd_tcp, eid, EID_LENGTH) != SUCCESS)
+    if(tcp_read_field(rb, eid, EID_LENGTH) != SUCCESS)
         return STATUS_MALFORMED_RESPONSE;
-    if(tcp_read_field(fd_tcp, name, MAX_EVENT_NAME) != SUCCESS)
+    if(tcp_read_field(rb, name, MAX_EVENT_NAME) != SUCCESS)
         return STATUS_MALFORMED_RESPONSE;
-    if(tcp_read_field(fd_tcp, state, 2) != SUCCESS)
+    if(tcp_read_field(rb, state, 2) != SUCCESS)
         return STATUS_MALFORMED_RESPONSE;
-    if(tcp_read_field(fd_tcp, event_day, DAY_STR_SIZE) != SUCCESS)
+    if(tcp_read_field(rb, event_day, DAY_STR_SIZE) != SUCCESS)
         return STATUS_MALFORMED_RESPONSE;   
-    if(tcp_read_field(fd_tcp, event_time, TIME_STR_SIZE) != SUCCESS)
+    if(tcp_read_field(rb, event_time, TIME_STR_SIZE) != SUCCESS)
         return STATUS_MALFORMED_RESPONSE;
     return STATUS_UNASSIGNED;
 }
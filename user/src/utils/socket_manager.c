@@ -8,6 +8,7 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
+#include <errno.h>
 #include "../include/client_data.h"
 #include "../../include/utils.h"
 #include "../../common/common.h"
@@ -83,23 +84,71 @@ ReplyStatus udp_send_receive(int udp_fd, struct sockaddr_in* server_udp_addr,
     return STATUS_UNASSIGNED;
 }
 
+// Connection to the server, kept between commands in keep-alive mode (-k)
+static ReadBuffer session = {.fd = -1};
+
+// Asks the server to keep the connection open, FALSE if it does not support it
+static int request_keep_alive(ReadBuffer* rb) {
+    char response[16];
+    if (tcp_send_message(rb->fd, "KAL\n") == ERROR ||
+        tcp_read_line(rb, response, sizeof(response)) == ERROR) return FALSE;
+    return strcmp(response, "RKA OK\n") == 0;
+}
+
+static int session_connect() {
+    int tcp_fd = connect_tcp(IP, PORT);
+    if (tcp_fd == -1) return ERROR;
+    if (read_buffer_init(&session, tcp_fd, READ_BUFFER_SIZE) == ERROR) {
+        close(tcp_fd);
+        session.fd = -1;
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+ReadBuffer* tcp_session_open() {
+    if (session.fd >= 0) {
+        // Reuse the connection unless the server closed it while idle
+        char probe;
+        ssize_t n = recv(session.fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return &session;
+        tcp_session_end(&session, FALSE);
+    }
+
+    if (session_connect() == ERROR) return NULL;
+    if (keep_alive && !request_keep_alive(&session)) {
+        // Older servers answer ERR and close, fall back to one connection per command
+        keep_alive = FALSE;
+        tcp_session_end(&session, FALSE);
+        if (session_connect() == ERROR) return NULL;
+    }
+    return &session;
+}
+
+void tcp_session_end(ReadBuffer* rb, int reusable) {
+    if (keep_alive && reusable) return;
+    close(rb->fd);
+    read_buffer_free(rb);
+    rb->fd = -1;
+}
+
 ReplyStatus tcp_send_receive(char* message, char* response, 
                             size_t response_size) {
-    int tcp_fd = connect_tcp(IP, PORT);
-    if (tcp_fd == -1) return STATUS_SEND_FAILED;
+    ReadBuffer* rb = tcp_session_open();
+    if (rb == NULL) return STATUS_SEND_FAILED;
     
     // Send request header to server
-    if (tcp_send_message(tcp_fd, message) == ERROR) {
-        close(tcp_fd);
+    if (tcp_send_message(rb->fd, message) == ERROR) {
+        tcp_session_end(rb, FALSE);
         return STATUS_SEND_FAILED;
     }
 
     // Read server response
-    if (tcp_read(tcp_fd, response, response_size) == ERROR) {
-        close(tcp_fd);
+    if (tcp_read_line(rb, response, response_size) == ERROR) {
+        tcp_session_end(rb, FALSE);
         return STATUS_RECV_FAILED;
     }
-    close(tcp_fd);
+    tcp_session_end(rb, response[strlen(response) - 1] == '\n');
     return STATUS_UNASSIGNED;
 }
 